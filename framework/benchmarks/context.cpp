@@ -0,0 +1,213 @@
+#include <benchmark/benchmark.h>
+
+#include "framework/context.h"
+#include "framework/tracing.h"
+
+#include <chrono>
+#include <type_traits>
+#include <utility>
+
+using namespace pt;
+
+// What every message pays to get through Context, with 1, 4 and 16 handlers of each event and
+// request, on one thread and on a work stealing pool of 4. Each reports throughput as items per
+// second, and p50 and p99 latency in microseconds.
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Ping {
+        // set when the latency to each handler is wanted
+        Clock::time_point sent;
+        tracing::LatencyHistogram* latencies;
+    };
+
+    // every Pinger answers, so it's asked of as many handlers as Ping is
+    struct Echo {
+        using ResponseT = int;
+        int x;
+
+        static int reduce(int a, int b) {return a + b;}
+    };
+
+    struct EmitPings {
+        using ResponseT = int;
+        int n;
+        tracing::LatencyHistogram* latencies;
+    };
+
+    struct MakeRequests {
+        using ResponseT = int;
+        int n;
+        tracing::LatencyHistogram* latencies;
+    };
+
+    template<size_t I>
+    struct Pinger {
+        EVENT(Ping) {
+            // only the first records, the others may be running on other threads at the same time
+            if (I == 0 && event.latencies) {
+                event.latencies->record(Clock::now() - event.sent);
+            }
+            co_return;
+        }
+
+        REQUEST(Echo) {
+            co_return request.x;
+        }
+    };
+
+    // makes requests and emits from inside a handler, the way handlers talk to each other
+    struct Driver {
+        REQUEST(EmitPings) {
+            for (int i = 0; i < request.n; i++) {
+                auto start = Clock::now();
+                co_await ctx.emit_await(Ping{});
+                request.latencies->record(Clock::now() - start);
+            }
+            co_return request.n;
+        }
+
+        REQUEST(MakeRequests) {
+            int total = 0;
+            for (int i = 0; i < request.n; i++) {
+                auto start = Clock::now();
+                total += co_await ctx(Echo{i});
+                request.latencies->record(Clock::now() - start);
+            }
+            co_return total;
+        }
+    };
+
+    using SingleThreaded = FixedCoroutineThreadPool<1>;
+    using WorkStealing = WorkStealingCoroutineThreadPool;
+
+    template<typename PoolT>
+    auto pool_args() {
+        if constexpr (std::is_same_v<PoolT, WorkStealing>) {
+            return thread_pool_args<PoolT>(4);
+        } else {
+            return thread_pool_args<PoolT>();
+        }
+    }
+
+    template<typename PoolT, size_t...Is>
+    auto make_context_with(std::index_sequence<Is...>) {
+        return make_context(pool_args<PoolT>(), Driver{}, Pinger<Is>{}...);
+    }
+
+    // a Driver, and Handlers handlers of Ping and Echo
+    template<typename PoolT, size_t Handlers>
+    auto make_pingers() {
+        return make_context_with<PoolT>(std::make_index_sequence<Handlers>{});
+    }
+
+    void report(benchmark::State& state, const tracing::LatencyHistogram& latencies) {
+        auto us = [](std::chrono::nanoseconds d) {return static_cast<double>(d.count()) / 1000.0;};
+        state.counters["p50_us"] = us(latencies.percentile(50));
+        state.counters["p99_us"] = us(latencies.percentile(99));
+    }
+}
+
+// latency is from emit until the first handler runs
+template<typename PoolT, size_t Handlers>
+static void BM_ContextEmit(benchmark::State& state) {
+    constexpr size_t n = 1000;
+    auto ctx = make_pingers<PoolT, Handlers>();
+    tracing::LatencyHistogram latencies;
+    for (auto _ : state) {
+        for (size_t i = 0; i < n; i++) {
+            ctx.emit(Ping{Clock::now(), &latencies});
+        }
+        ctx.wait_for_all_events_to_finish();
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+    report(state, latencies);
+}
+
+BENCHMARK_TEMPLATE(BM_ContextEmit, SingleThreaded, 1)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextEmit, SingleThreaded, 4)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextEmit, SingleThreaded, 16)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextEmit, WorkStealing, 1)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextEmit, WorkStealing, 4)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextEmit, WorkStealing, 16)->UseRealTime();
+
+template<typename PoolT, size_t Handlers>
+static void BM_ContextEmitSync(benchmark::State& state) {
+    auto ctx = make_pingers<PoolT, Handlers>();
+    tracing::LatencyHistogram latencies;
+    for (auto _ : state) {
+        auto start = Clock::now();
+        ctx.emit_sync(Ping{});
+        latencies.record(Clock::now() - start);
+    }
+    state.SetItemsProcessed(state.iterations());
+    report(state, latencies);
+}
+
+BENCHMARK_TEMPLATE(BM_ContextEmitSync, SingleThreaded, 1)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextEmitSync, SingleThreaded, 4)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextEmitSync, SingleThreaded, 16)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextEmitSync, WorkStealing, 1)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextEmitSync, WorkStealing, 4)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextEmitSync, WorkStealing, 16)->UseRealTime();
+
+// emit_await from inside a handler, until every handler has finished
+template<typename PoolT, size_t Handlers>
+static void BM_ContextEmitAwait(benchmark::State& state) {
+    constexpr int n = 1000;
+    auto ctx = make_pingers<PoolT, Handlers>();
+    tracing::LatencyHistogram latencies;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ctx.request_sync(EmitPings{n, &latencies}));
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+    report(state, latencies);
+}
+
+BENCHMARK_TEMPLATE(BM_ContextEmitAwait, SingleThreaded, 1)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextEmitAwait, SingleThreaded, 4)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextEmitAwait, SingleThreaded, 16)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextEmitAwait, WorkStealing, 1)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextEmitAwait, WorkStealing, 4)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextEmitAwait, WorkStealing, 16)->UseRealTime();
+
+// co_await ctx(request) from inside a handler, gathered from every handler when there's more than one
+template<typename PoolT, size_t Handlers>
+static void BM_ContextRequest(benchmark::State& state) {
+    constexpr int n = 1000;
+    auto ctx = make_pingers<PoolT, Handlers>();
+    tracing::LatencyHistogram latencies;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ctx.request_sync(MakeRequests{n, &latencies}));
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+    report(state, latencies);
+}
+
+BENCHMARK_TEMPLATE(BM_ContextRequest, SingleThreaded, 1)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextRequest, SingleThreaded, 4)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextRequest, SingleThreaded, 16)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextRequest, WorkStealing, 1)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextRequest, WorkStealing, 4)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextRequest, WorkStealing, 16)->UseRealTime();
+
+template<typename PoolT, size_t Handlers>
+static void BM_ContextRequestSync(benchmark::State& state) {
+    auto ctx = make_pingers<PoolT, Handlers>();
+    tracing::LatencyHistogram latencies;
+    for (auto _ : state) {
+        auto start = Clock::now();
+        benchmark::DoNotOptimize(ctx.request_sync(Echo{1}));
+        latencies.record(Clock::now() - start);
+    }
+    state.SetItemsProcessed(state.iterations());
+    report(state, latencies);
+}
+
+BENCHMARK_TEMPLATE(BM_ContextRequestSync, SingleThreaded, 1)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextRequestSync, SingleThreaded, 4)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextRequestSync, SingleThreaded, 16)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextRequestSync, WorkStealing, 1)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextRequestSync, WorkStealing, 4)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ContextRequestSync, WorkStealing, 16)->UseRealTime();
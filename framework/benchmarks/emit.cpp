@@ -0,0 +1,127 @@
+#include <benchmark/benchmark.h>
+
+#include "framework/context.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace pt;
+
+struct Ping {};
+struct EmitPings {
+    using ResponseT = int;
+    int n;
+};
+
+struct PingHandler {
+    EVENT(Ping) {
+        co_return;
+    }
+};
+
+struct PingLoopHandler {
+    REQUEST(EmitPings) {
+        for (int i = 0; i < request.n; i++) {
+            co_await ctx.emit_await(Ping{});
+        }
+        co_return request.n;
+    }
+};
+
+static void BM_EmitSync(benchmark::State& state) {
+    auto ctx = make_context(PingHandler{});
+    for (auto _ : state) {
+        ctx.emit_sync(Ping{});
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_EmitSync)->UseRealTime();
+
+static void BM_EmitAsync(benchmark::State& state) {
+    auto ctx = make_context(PingHandler{});
+    for (auto _ : state) {
+        for (size_t i = 0; i < 1000; i++) {
+            ctx.emit(Ping{});
+        }
+        ctx.wait_for_all_events_to_finish();
+    }
+    state.SetItemsProcessed(state.iterations() * 1000);
+}
+
+BENCHMARK(BM_EmitAsync)->UseRealTime();
+
+// emit_await from inside a handler, how a frame loop emits its events
+static void BM_EmitAwait(benchmark::State& state) {
+    auto ctx = make_context(PingHandler{}, PingLoopHandler{});
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ctx.request_sync(EmitPings{1000}));
+    }
+    state.SetItemsProcessed(state.iterations() * 1000);
+}
+
+BENCHMARK(BM_EmitAwait)->UseRealTime();
+
+static void BM_EmitAwaitTwoHandlers(benchmark::State& state) {
+    auto ctx = make_context(PingHandler{}, PingHandler{}, PingLoopHandler{});
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ctx.request_sync(EmitPings{1000}));
+    }
+    state.SetItemsProcessed(state.iterations() * 1000);
+}
+
+BENCHMARK(BM_EmitAwaitTwoHandlers)->UseRealTime();
+
+
+// The event in flight counting on its own, the way Context used to do it and the way it does now.
+// Several threads start and end events while nobody is waiting.
+struct MutexEventCounter {
+    void start() {
+        std::unique_lock l(m);
+        in_progress++;
+    }
+
+    void end() {
+        size_t prev;
+        {
+            std::unique_lock l(m);
+            prev = in_progress--;
+        }
+        if (prev == 1) {
+            cv.notify_all();
+        }
+    }
+
+    std::mutex m;
+    std::condition_variable cv;
+    size_t in_progress = 0;
+};
+
+struct AtomicEventCounter {
+    void start() {
+        in_progress.fetch_add(1);
+    }
+
+    void end() {
+        if (in_progress.fetch_sub(1) == 1) {
+            in_progress.notify_all();
+        }
+    }
+
+    std::atomic<size_t> in_progress = 0;
+};
+
+template<typename CounterT>
+static void BM_EventCounter(benchmark::State& state) {
+    static CounterT counter;
+    for (auto _ : state) {
+        counter.start();
+        counter.end();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(BM_EventCounter, MutexEventCounter)->ThreadRange(1, 8);
+BENCHMARK_TEMPLATE(BM_EventCounter, AtomicEventCounter)->ThreadRange(1, 8);
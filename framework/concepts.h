@@ -1,5 +1,6 @@
 #pragma once
 #include <concepts>
+#include <type_traits>
 #include "thread_pool/promise.h"
 
 namespace pt {
@@ -17,6 +18,17 @@ concept Request = requires(T t) { typename T::ResponseT; } && Response<typename
 template<typename T>
 concept IsContext = true;
 
+// Requests are told apart with ==, except empty ones which are all the same
+template<Request R>
+bool same_request(const R& a, const R& b) {
+    static_assert(std::is_empty_v<R> || std::equality_comparable<R>, "Requests have to be empty or have == to be told apart");
+    if constexpr (std::is_empty_v<R>) {
+        return true;
+    } else {
+        return a == b;
+    }
+}
+
 
 template<typename T, typename C, typename E>
 concept HandlesEvent = IsContext<C> && Event<E> && requires(T t, C& c, const E& e) {
@@ -3,6 +3,16 @@
 namespace pt {
 
 namespace context::detail {
+    void report_event_exception(std::exception_ptr e) {
+        try {
+            std::rethrow_exception(e);
+        } catch (const std::exception& e) {
+            std::cout << "Exception while handling event: " << e.what() << std::endl;
+        } catch (...) {
+            std::cout << "Unknown exception while handling event" << std::endl;
+        }
+    }
+
     joinable make_joinable(Task<>&& task, std::atomic<int>& running_count, std::coroutine_handle<>& continuation) {
         co_await task;
     }
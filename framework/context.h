@@ -10,19 +10,31 @@
 #include <chrono>
 #include <typeinfo>
 #include <typeindex>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <concepts>
+#include <cstdint>
 
 #include "thread_pool/thread_pool.h"
+#include "thread_pool/work_stealing_thread_pool.h"
 #include "thread_pool/promise.h"
+#include "thread_pool/strand.h"
+#include "thread_pool/span.h"
 
 #include "framework/concepts.h"
+#include "framework/flight_recorder.h"
+#include "framework/gather.h"
 #include "framework/handler_set.h"
+#include "framework/in_flight.h"
+#include "framework/request_cache.h"
+#include "framework/tracing.h"
 
 namespace pt {
 
 namespace context::detail {
-    template<size_t I, size_t...Is>
-    constexpr size_t get_first(std::index_sequence<I, Is...>) {return I;}
-
+    // exceptions from event handlers don't go anywhere, they're just logged
+    void report_event_exception(std::exception_ptr e);
 
     struct joinable {
         struct promise_type;
@@ -42,7 +54,7 @@ namespace context::detail {
             promise_type* promise;
         };
 
-        struct promise_type {
+        struct promise_type: FrameAllocated {
             promise_type(Task<>&&, std::atomic<int>& running_count, std::coroutine_handle<>& continuation):
                 running_count(&running_count),
                 continuation(&continuation) {
@@ -58,18 +70,16 @@ namespace context::detail {
                 return final_awaitable{this};
             }
             void unhandled_exception() {
-                try {
-                    std::rethrow_exception(std::current_exception());
-                } catch (const std::exception& e) {
-                    std::cout << "Exception while handling event: " << e.what() << std::endl;
-                } catch (...) {
-                    std::cout << "Unknown exception while handling event" << std::endl;
-                }
+                report_event_exception(std::current_exception());
             }
 
             std::atomic<int>* running_count;
             std::coroutine_handle<>* continuation;
             CoroutineThreadPool* pool;
+#ifdef PT_TRACING
+            // the join's, so the handler's task inherits it
+            uint64_t span = 0;
+#endif
         };
         
         struct awaitable {
@@ -77,6 +87,9 @@ namespace context::detail {
             template<typename U>
             std::coroutine_handle<> await_suspend(std::coroutine_handle<U> h) noexcept {
                 promise->pool = h.promise().pool;
+#ifdef PT_TRACING
+                promise->span = h.promise().span;
+#endif
                 promise->pool->push(std::coroutine_handle<promise_type>::from_promise(*promise));
                 return h;
             }
@@ -100,26 +113,36 @@ namespace context::detail {
     joinable make_joinable(Task<>&& task, std::atomic<int>& running_count, std::coroutine_handle<>& continuation);
 
     struct joined {
+        using pool_aware = void;
+
         struct promise_type;
 
         struct final_awaitable {
             bool await_ready() noexcept {return false;}
-            std::coroutine_handle<> await_suspend(std::coroutine_handle<>) noexcept {
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) noexcept {
                 void* expected = nullptr;
                 if (!promise->continuation.compare_exchange_strong(expected, this)) {
-                    return std::coroutine_handle<>::from_address(promise->continuation.load());
-                } else {
-                    return std::noop_coroutine();
+                    if (expected == &detached) {
+                        // nothing's going to await it
+                        h.destroy();
+                        return std::noop_coroutine();
+                    }
+                    // the last handler can finish anywhere, make sure the awaiter carries on on its own pool
+                    return promise->continuation_pool->schedule(std::coroutine_handle<>::from_address(expected), promise->continuation_priority);
                 }
+                return std::noop_coroutine();
             }
             void await_resume() noexcept {}
 
             promise_type* promise;
         };
 
-        struct promise_type {
+        struct promise_type: FrameAllocated {
             template<typename...Ts>
-            promise_type(CoroutineThreadPool& pool, Ts&&...):pool(&pool) {
+            promise_type(CoroutineThreadPool& pool, [[maybe_unused]] uint64_t span, Ts&&...):pool(&pool) {
+#ifdef PT_TRACING
+                this->span = span;
+#endif
             }
 
             joined get_return_object() {
@@ -139,6 +162,14 @@ namespace context::detail {
 
             std::atomic<void*> continuation;
             CoroutineThreadPool* pool;
+#ifdef PT_TRACING
+            // the handlers' parent span, the handlers start before the join is awaited so it can't
+            // be inherited
+            uint64_t span;
+#endif
+            // the awaiter's pool and priority, set before continuation
+            CoroutineThreadPool* continuation_pool;
+            Priority continuation_priority;
         };
 
 
@@ -148,6 +179,13 @@ namespace context::detail {
 
         template<typename U>
         bool await_suspend(std::coroutine_handle<U> handle) noexcept {
+            promise->continuation_pool = handle.promise().pool;
+            promise->continuation_priority = current_priority();
+#ifdef PT_TRACING
+            if constexpr (requires {handle.promise().span;}) {
+                continuation_span = &handle.promise().span;
+            }
+#endif
             void* expected = nullptr;
             if (promise->continuation.compare_exchange_strong(expected, handle.address())) {
                 return true;
@@ -156,11 +194,23 @@ namespace context::detail {
             }
         }
 
-        void await_resume() noexcept {}
+        void await_resume() noexcept {
+#ifdef PT_TRACING
+            if (continuation_span) {
+                // resumed by the pool, which doesn't know whose span this is
+                thread_pool::detail::set_running_span(*continuation_span);
+            }
+#endif
+        }
 
         ~joined() {
             if (promise) {
-                std::coroutine_handle<promise_type>::from_promise(*promise).destroy();
+                // if the handlers are still running the frame is left for the last of them to
+                // destroy, otherwise it's finished with
+                void* expected = nullptr;
+                if (!promise->continuation.compare_exchange_strong(expected, &detached)) {
+                    std::coroutine_handle<promise_type>::from_promise(*promise).destroy();
+                }
             }
         }
 
@@ -175,10 +225,20 @@ namespace context::detail {
         }
         joined& operator=(joined&& o) {
             std::swap(this->promise, o.promise);
+#ifdef PT_TRACING
+            std::swap(this->continuation_span, o.continuation_span);
+#endif
             return *this;
         }
 
         promise_type* promise;
+#ifdef PT_TRACING
+        // the awaiter's, set once suspended
+        const uint64_t* continuation_span = nullptr;
+#endif
+
+        // what continuation is set to when the joined is dropped before it finishes
+        static inline char detached;
     };
 
     struct wait_for_joined {
@@ -204,14 +264,117 @@ namespace context::detail {
     };
 
     template<typename F, Event E, IsContext C, typename...HandlerTs>
-    joined join(CoroutineThreadPool& pool, F&& done_cb, C& ctx, E event, HandlerTs&...handlers) {
+    joined join(CoroutineThreadPool& pool, uint64_t span, F done_cb, C& ctx, E event, HandlerTs&...handlers) {
         std::atomic<int> running_count = 0;
         std::coroutine_handle<> continuation;
 
-        (co_await make_joinable(handlers.handle(ctx, event), running_count, continuation), ..., co_await wait_for_joined{&running_count, &continuation, sizeof...(HandlerTs)});
+        (co_await make_joinable(ctx.invoke(handlers, event), running_count, continuation), ..., co_await wait_for_joined{&running_count, &continuation, sizeof...(HandlerTs)});
         done_cb(ctx);
     }
 
+    // Pushes task onto its pool rather than starting it in place, the join may not be running on
+    // a pool thread
+    struct push_task {
+        bool await_ready() noexcept {return false;}
+
+        template<typename U>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<U> h) noexcept {
+            promise::detail::attach(*task.promise, h);
+            return task.promise->pool->schedule(std::coroutine_handle<Task<>::promise_type>::from_promise(*task.promise), task.promise->start_priority());
+        }
+
+        void await_resume() {
+            if (task.promise->exception) {
+                std::rethrow_exception(task.promise->exception);
+            }
+        }
+
+        Task<>& task;
+    };
+
+    // When only one handler handles an event there's nothing to join so the handler's task is
+    // started straight away, run right here if the emit is already on the handler's pool and
+    // only pushed from other threads.
+    template<typename F, Event E, IsContext C, typename HandlerT>
+    joined join_one(CoroutineThreadPool& pool, uint64_t span, F done_cb, C& ctx, E event, HandlerT& handler) {
+        // kept out here, gcc destroys a task inside a temporary awaiter twice
+        auto task = ctx.invoke(handler, event);
+        try {
+            co_await push_task{task};
+        } catch (...) {
+            report_event_exception(std::current_exception());
+        }
+        done_cb(ctx);
+    }
+
+    // ends a request's flight recorder record once its handlers have finished, see Task::on_finish
+    inline void end_record(void* seq, void*) {
+        flight_recorder::end({reinterpret_cast<uintptr_t>(seq)});
+    }
+
+    // For a cached request, once its handlers have finished the response is remembered and the
+    // record ended, see Task::on_finish
+    template<CachedRequest R>
+    struct Remember: FrameAllocated {
+        Remember(RequestCache& cache, const R& request, flight_recorder::Ticket ticket):
+            cache(&cache), request(request), seen(request_cache::detail::now<R>()), ticket(ticket) {}
+
+        static void finished(void* remember, void* response) {
+            std::unique_ptr<Remember> r{static_cast<Remember*>(remember)};
+            if (response) {
+                r->cache->insert(r->request, r->seen, *static_cast<typename R::ResponseT*>(response));
+            }
+            flight_recorder::end(r->ticket);
+        }
+
+        RequestCache* cache;
+        R request;
+        request_cache::detail::Seen<R> seen;
+        flight_recorder::Ticket ticket;
+    };
+
+#ifdef PT_TRACING
+    // records how long handler took to handle message, see tracing.h
+    template<typename HandlerT, typename MessageT, typename T>
+    Task<T> traced(Task<T> task) {
+        tracing::SpanScope span{co_await get_span{}, Request<MessageT> ? tracing::Kind::Request : tracing::Kind::Event, typeid(MessageT), &typeid(HandlerT)};
+        task.set_span(span.id);
+        co_return co_await std::move(task);
+    }
+
+    // An emit of E, from when it's emitted until all its handlers have finished. The handlers
+    // start straight away so its parent is whatever span is running on the emitting thread.
+    template<typename E>
+    struct EmitSpan {
+        uint64_t id() const {return scope->id;}
+        void end() {scope.reset();}
+
+        std::unique_ptr<tracing::SpanScope> scope = std::make_unique<tracing::SpanScope>(
+            thread_pool::detail::running_span, tracing::Kind::Emit, typeid(E), nullptr
+        );
+    };
+#else
+    template<typename E>
+    struct EmitSpan {
+        uint64_t id() const {return 0;}
+        void end() {}
+    };
+#endif
+
+    // Events and requests can have a priority of their own,
+    //
+    //      struct Autosave {
+    //          static constexpr Priority priority = Priority::Background;
+    //      };
+    template<typename T>
+    constexpr std::optional<Priority> priority_of() {
+        if constexpr (requires {{T::priority} -> std::convertible_to<Priority>;}) {
+            return T::priority;
+        } else {
+            return std::nullopt;
+        }
+    }
+
     template<IsContext C, Event E>
     struct EventPred {
         template<typename Handler>
@@ -239,6 +402,19 @@ namespace context::detail {
     template<typename...Ts>
     struct is_ctor_args<CtorArgs<Ts...>>: std::true_type {};
 
+    using ThreadPoolFactory = std::function<std::unique_ptr<CoroutineThreadPool>()>;
+
+    template<typename T>
+    struct ThreadPoolArgs {
+        ThreadPoolFactory factory;
+    };
+
+    template<typename T>
+    struct is_thread_pool_args: std::false_type {};
+
+    template<typename T>
+    struct is_thread_pool_args<ThreadPoolArgs<T>>: std::true_type {};
+
     struct make_context_friend;
 }
 
@@ -247,10 +423,34 @@ context::detail::CtorArgs<T, ArgTs...> ctor_args(ArgTs&&...args) {
     return context::detail::CtorArgs<T, ArgTs...>(std::forward<ArgTs>(args)...);
 }
 
+// Pass as the first argument to make_context to choose the thread pool handlers run on, the
+// default is FixedCoroutineThreadPool<1>.
+//
+//      make_context(thread_pool_args<WorkStealingCoroutineThreadPool>(4), Handler1{}, ...)
+template<typename T, typename...ArgTs>
+context::detail::ThreadPoolArgs<T> thread_pool_args(ArgTs&&...args) {
+    return {
+        [args = std::make_tuple(std::forward<ArgTs>(args)...)]() -> std::unique_ptr<CoroutineThreadPool> {
+            return std::apply([](const auto&...args){return std::make_unique<T>(args...);}, args);
+        }
+    };
+}
 
+
+// Sees every event emitted into a context it's been added to, before any handler does. For
+// anything that needs the events themselves, what was emitted and when is always in the flight
+// recorder (see flight_recorder.h).
 class ContextObserver {
 public:
     virtual void event(void* event, std::type_index type) {}
+
+private:
+    // contexts keep their observers in a list through these, so a context without any has
+    // nothing to do
+    ContextObserver* next = nullptr;
+
+    template<typename...HandlerTs>
+    friend class Context;
 };
 
 template<typename...HandlerTs>
@@ -264,53 +464,128 @@ public:
 
     template<bool AllowUnhandled=true, Event E>
     void emit(E&& event) {
-        run_awaitable_async(state->thread_pool, emit_await<AllowUnhandled>(std::forward<E>(event)));
+        run_awaitable_async(*state->thread_pool, emit_await<AllowUnhandled>(std::forward<E>(event)));
+    }
+
+    template<bool AllowUnhandled=true, Event E>
+    void emit(E&& event, Priority priority) {
+        run_awaitable_async(*state->thread_pool, emit_await<AllowUnhandled>(std::forward<E>(event), priority));
     }
 
     template<bool AllowUnhandled=true, Event E>
     void emit_sync(E&& event) {
-        run_awaitable_sync(state->thread_pool, emit_await<AllowUnhandled>(std::forward<E>(event)));
+        run_awaitable_sync(*state->thread_pool, emit_await<AllowUnhandled>(std::forward<E>(event)));
+    }
+
+    template<bool AllowUnhandled=true, Event E>
+    void emit_sync(E&& event, Priority priority) {
+        run_awaitable_sync(*state->thread_pool, emit_await<AllowUnhandled>(std::forward<E>(event), priority));
     }
 
+    // The handlers are started as soon as emit_await is called, not when what it returns is
+    // awaited, and awaiting it waits for all of them to finish. Dropping it without awaiting
+    // doesn't stop them. Handlers run at E's priority if it has one, otherwise at the priority
+    // emit_await was called at. See context::detail::priority_of.
     template<bool AllowUnhandled=true, Event E>
     auto emit_await(E&& event) {
+        return emit_await<AllowUnhandled>(std::forward<E>(event), context::detail::priority_of<std::remove_cvref_t<E>>());
+    }
+
+    template<bool AllowUnhandled=true, Event E>
+    auto emit_await(E&& event, std::optional<Priority> priority) {
         assert(!state->stopped);
 
-        for (auto* o: observers) {
+        for (auto* o = observers; o; o = o->next) {
             o->event(static_cast<void*>(&event), typeid(event));
         }
 
         constexpr auto indexes = handler_set.template true_indexes<context::detail::EventPred<Context, E>>();
         static_assert(indexes.size() != 0 || AllowUnhandled, "Nothing to handle event E");
+        request_cache::detail::invalidate<std::remove_cvref_t<E>>();
+        auto ticket = flight_recorder::begin(flight_recorder::Kind::Event, typeid(E), indexes.size());
         if constexpr (indexes.size() != 0) {
+            context::detail::EmitSpan<std::remove_cvref_t<E>> span;
+            uint64_t span_id = span.id();
+            auto done = [ticket, span = std::move(span)](Context& ctx) mutable {
+                span.end();
+                request_cache::detail::invalidate<std::remove_cvref_t<E>>();
+                flight_recorder::end(ticket);
+                ctx.end_event();
+            };
             start_event();
+
+            // the handlers are pushed straight away, at whatever priority is current
+            std::optional<thread_pool::detail::PriorityScope> scope;
+            if (priority) {
+                scope.emplace(*priority);
+            }
             return handler_set.call_with(
                 indexes,
                 [&](auto&...handlers) {
-                    return context::detail::join(
-                        state->thread_pool,
-                        [](Context& ctx){ctx.end_event();},
-                        *this,
-                        std::forward<E>(event),
-                        handlers...
-                    );
+                    if constexpr (sizeof...(handlers) == 1) {
+                        return context::detail::join_one(
+                            *state->thread_pool,
+                            span_id,
+                            std::move(done),
+                            *this,
+                            std::forward<E>(event),
+                            handlers...
+                        );
+                    } else {
+                        return context::detail::join(
+                            *state->thread_pool,
+                            span_id,
+                            std::move(done),
+                            *this,
+                            std::forward<E>(event),
+                            handlers...
+                        );
+                    }
                 }
             );
         } else {
+            flight_recorder::end(ticket);
             return std::suspend_never{};
         }
     }
 
+    // The handler runs at R's priority if it has one, otherwise at the priority of whatever
+    // awaits it. If R is cached (see request_cache.h) and there's a response for it already the
+    // handler isn't asked at all. Only gathered requests (see gather.h) can have more than one
+    // handler.
     template<Request R>
     auto operator()(const R& request) {
+        return (*this)(request, context::detail::priority_of<R>());
+    }
+
+    template<Request R>
+    auto operator()(const R& request, std::optional<Priority> priority) {
         assert(!state->stopped);
         constexpr auto indexes = handler_set.template true_indexes<context::detail::RequestPred<Context, R>>();
         static_assert(indexes.size() != 0, "Nothing to handle request R");
-        static_assert(indexes.size() < 2, "More than one handler for request R");
+        static_assert(indexes.size() < 2 || GatheredRequest<R>, "More than one handler for request R, and no R::reduce to combine their responses");
+
+        if constexpr (indexes.size() == 1 || (indexes.size() > 1 && GatheredRequest<R>)) {
+            if constexpr (CachedRequest<R>) {
+                if (auto response = state->request_cache.find(request)) {
+                    // recorded as handled by nothing
+                    flight_recorder::end(flight_recorder::begin(flight_recorder::Kind::Request, typeid(R), 0));
+                    return CachedResponse<typename R::ResponseT>(std::move(*response));
+                }
+            }
 
-        if constexpr (indexes.size() == 1) {
-            auto& handler = handler_set.template get<context::detail::get_first(indexes)>();
-            return handler.handle(*this, request);
+            auto task = ask(indexes, request);
+            auto ticket = flight_recorder::begin(flight_recorder::Kind::Request, typeid(R), indexes.size());
+            if (priority) {
+                task.set_priority(*priority);
+            }
+            if constexpr (CachedRequest<R>) {
+                task.on_finish(context::detail::Remember<R>::finished, new context::detail::Remember<R>(state->request_cache, request, ticket));
+                return CachedResponse<typename R::ResponseT>(std::move(task));
+            } else {
+                task.on_finish(context::detail::end_record, reinterpret_cast<void*>(static_cast<uintptr_t>(ticket.seq)));
+                return task;
+            }
         } else {
             // the static asserts have already failed but to stop unhelpful compiler error messages we
             // still return something from this function
@@ -318,10 +593,33 @@ public:
         }
     }
 
+    // Like operator() except that a request equal to one already in flight waits for that one's
+    // response instead of asking the handler again, so the handler runs once however many ask at
+    // the same time. They all share the one response. The handler is started straight away by
+    // whoever asks first, and runs to the end whether or not anyone awaits it, counting as an
+    // event in progress until then.
+    template<Request R>
+    typename Flight<typename R::ResponseT>::awaiter coalesced(const R& request) {
+        assert(!state->stopped);
+        auto [flight, first] = state->in_flight_requests.join(request);
+        if (first) {
+            start_event();
+            auto done = [](Context& ctx) {ctx.end_event();};
+            run_awaitable_async(*state->thread_pool, in_flight::detail::fly(done, *this, state->in_flight_requests, flight, request));
+        }
+        return {std::move(flight)};
+    }
+
     template<Request R>
     auto request_sync(const R& request) {
         assert(!state->stopped);
-        return run_awaitable_sync(state->thread_pool, (*this)(request));
+        return run_awaitable_sync(*state->thread_pool, (*this)(request));
+    }
+
+    template<Request R>
+    auto request_sync(const R& request, Priority priority) {
+        assert(!state->stopped);
+        return run_awaitable_sync(*state->thread_pool, (*this)(request, priority));
     }
 
     template<Event E>
@@ -331,8 +629,10 @@ public:
     }
 
     void wait_for_all_events_to_finish() {
-        std::unique_lock l(state->m);
-        state->cv.wait(l, [&]{return state->events_in_progress == 0;});
+        size_t in_progress;
+        while ((in_progress = state->events_in_progress.load()) != 0) {
+            state->events_in_progress.wait(in_progress);
+        }
     }
 
     // should only be called by main or tests
@@ -340,8 +640,14 @@ public:
         state->stopped = true;
     }
 
+    // o has to outlive the context, and can only be added to one
     void addObserver(ContextObserver& o) {
-        observers.push_back(&o);
+        assert(!o.next);
+        auto** last = &observers;
+        while (*last) {
+            last = &(*last)->next;
+        }
+        *last = &o;
     }
 
     ~Context() {
@@ -355,44 +661,108 @@ private:
     HandlerSet<HandlerTs...> handler_set;
 
     struct State {
-        std::mutex m;
-        std::condition_variable cv;
+        State(context::detail::ThreadPoolFactory make_thread_pool):
+            make_thread_pool(std::move(make_thread_pool)),
+            thread_pool(this->make_thread_pool())
+        {
+            // Handlers are written as if they only ever run on one thread. When the pool has more
+            // than one each handler gets a strand, so a handler's coroutines still run one at a
+            // time while different handlers run in parallel.
+            if (thread_pool->num_threads() > 1) {
+                for (size_t i = 0; i < sizeof...(HandlerTs); i++) {
+                    strands.push_back(std::make_unique<Strand>(*thread_pool));
+                }
+            }
+        }
+
+        ~State() {
+            // Stop the pool before the strands go, a pool thread may still be inside a strand
+            // having just finished the last event.
+            thread_pool.reset();
+        }
+
         std::atomic<bool> stopped = false;
-        size_t events_in_progress = 0;
-        FixedCoroutineThreadPool<1> thread_pool;
+        // waited on by wait_for_all_events_to_finish, only notified when it drops to 0
+        std::atomic<size_t> events_in_progress = 0;
+
+        // kept so the contexts make_context builds on top of this one get the same kind of pool
+        context::detail::ThreadPoolFactory make_thread_pool;
+        std::unique_ptr<CoroutineThreadPool> thread_pool;
+
+        // one per handler, empty if the pool only has one thread
+        std::vector<std::unique_ptr<Strand>> strands;
+
+        RequestCache request_cache;
+        InFlightRequests in_flight_requests;
     };
 
     // put this in a unique_ptr so context can be moved
     std::unique_ptr<State> state;
 
-    std::vector<ContextObserver*> observers;
+    // the first, linked through ContextObserver::next
+    ContextObserver* observers = nullptr;
 
     template<typename...OtherHandlerTs, typename NewHandlerT>
     Context(Context<OtherHandlerTs...>&& old, NewHandlerT&& new_handler):
         handler_set(std::move(old.handler_set), std::forward<NewHandlerT>(new_handler)),
-        state(new State)
+        state(new State(old.state->make_thread_pool))
     {}
 
-    Context(): handler_set(), state(new State) {}
+    Context(): Context([]() -> std::unique_ptr<CoroutineThreadPool> {
+        return std::make_unique<FixedCoroutineThreadPool<1>>();
+    }) {}
+
+    Context(context::detail::ThreadPoolFactory make_thread_pool): handler_set(), state(new State(std::move(make_thread_pool))) {}
+
+    template<typename HandlerT, typename T>
+    Task<T> bind_to_strand(const HandlerT& handler, Task<T>&& task) {
+        if (!state->strands.empty()) {
+            task.bind(*state->strands[handler_set.index_of(handler)]);
+        }
+        return std::move(task);
+    }
+
+    template<typename HandlerT, typename MessageT>
+    auto invoke(HandlerT& handler, const MessageT& message) {
+        auto task = bind_to_strand(handler, handler.handle(*this, message));
+#ifdef PT_TRACING
+        return context::detail::traced<HandlerT, MessageT>(std::move(task));
+#else
+        return task;
+#endif
+    }
+
+    // the one handler's task, or every handler's responses combined if R is gathered
+    template<Request R, size_t...Is>
+    Task<typename R::ResponseT> ask(std::index_sequence<Is...>, const R& request) {
+        if constexpr (sizeof...(Is) == 1) {
+            return invoke(handler_set.template get<Is...>(), request);
+        } else {
+            std::vector<Task<typename R::ResponseT>> tasks;
+            tasks.reserve(sizeof...(Is));
+            (tasks.push_back(invoke(handler_set.template get<Is>(), request)), ...);
+            return gather::detail::gather<R>(std::move(tasks));
+        }
+    }
 
     void start_event() {
-        std::unique_lock l(state->m);
-        state->events_in_progress++;
+        state->events_in_progress.fetch_add(1);
     }
 
     void end_event() {
-        size_t prev;
-        {
-            std::unique_lock l(state->m);
-            prev = state->events_in_progress--;
-        }
-        if (prev == 1) {
-            state->cv.notify_all();
+        if (state->events_in_progress.fetch_sub(1) == 1) {
+            state->events_in_progress.notify_all();
         }
     }
 
     friend context::detail::make_context_friend;
 
+    template<typename F, Event E, IsContext C, typename...Ts>
+    friend context::detail::joined context::detail::join(CoroutineThreadPool& pool, uint64_t span, F done_cb, C& ctx, E event, Ts&...handlers);
+
+    template<typename F, Event E, IsContext C, typename T>
+    friend context::detail::joined context::detail::join_one(CoroutineThreadPool& pool, uint64_t span, F done_cb, C& ctx, E event, T& handler);
+
     template<typename...Ts>
     friend class Context;
 };
@@ -421,9 +791,22 @@ namespace context::detail {
             }
         }
 
-        template<template<typename...> typename CtxT, typename...ArgTs>
-        static auto make_context_impl_outer(ArgTs&&...args) {
-            return make_context_impl(CtxT<>(), std::forward<ArgTs>(args)...);
+        template<template<typename...> typename CtxT>
+        static auto make_context_impl_outer() {
+            return CtxT<>();
+        }
+
+        template<template<typename...> typename CtxT, typename FirstT, typename...ArgTs>
+        static auto make_context_impl_outer(FirstT&& first, ArgTs&&...args) {
+            if constexpr (is_thread_pool_args<std::decay_t<FirstT>>::value) {
+                if constexpr (sizeof...(ArgTs) == 0) {
+                    return CtxT<>(std::move(first.factory));
+                } else {
+                    return make_context_impl(CtxT<>(std::move(first.factory)), std::forward<ArgTs>(args)...);
+                }
+            } else {
+                return make_context_impl(CtxT<>(), std::forward<FirstT>(first), std::forward<ArgTs>(args)...);
+            }
         }
     };
 } // context::detail
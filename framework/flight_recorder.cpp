@@ -0,0 +1,201 @@
+#include "framework/flight_recorder.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "framework/tracing.h"
+
+namespace pt {
+
+namespace flight_recorder {
+
+namespace {
+    static_assert((capacity & (capacity - 1)) == 0, "capacity has to be a power of 2");
+
+    // Readers check seq is the same before and after reading the rest, like a seqlock. A slot is
+    // only written by two threads at once if the whole ring is lapped during one write.
+    struct Slot {
+        std::atomic<uint64_t> seq;
+        std::atomic<const std::type_info*> message;
+        std::atomic<Kind> kind;
+        std::atomic<uint32_t> handlers;
+        std::atomic<int64_t> emitted;
+        std::atomic<int64_t> completed;
+    };
+
+    // constant initialised, so it's there before anything is emitted and still there after
+    // everything else has been destroyed
+    std::array<Slot, capacity> slots;
+    std::atomic<uint64_t> last_seq = 0;
+
+    int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool read(const Slot& slot, Record& record) {
+        uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq == 0) {
+            return false;
+        }
+        record.seq = seq;
+        record.message = slot.message.load(std::memory_order_relaxed);
+        record.kind = slot.kind.load(std::memory_order_relaxed);
+        record.handlers = slot.handlers.load(std::memory_order_relaxed);
+        record.emitted = slot.emitted.load(std::memory_order_relaxed);
+        record.completed = slot.completed.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.seq.load(std::memory_order_relaxed) == seq;
+    }
+
+    const char* kind_name(Kind kind) {
+        return kind == Kind::Event ? "event" : "request";
+    }
+
+    // Only async signal safe calls from here on. Lines are built up in a buffer and written
+    // whole, there's no stdio.
+    struct Line {
+        void append(const char* s) {
+            while (*s && size < sizeof(buffer)) {
+                buffer[size++] = *s++;
+            }
+        }
+
+        void append(uint64_t v) {
+            char digits[20];
+            size_t n = 0;
+            do {
+                digits[n++] = static_cast<char>('0' + v % 10);
+                v /= 10;
+            } while (v);
+            while (n && size < sizeof(buffer)) {
+                buffer[size++] = digits[--n];
+            }
+        }
+
+        void write_to(int fd) {
+            size_t written = 0;
+            while (written < size) {
+                auto n = ::write(fd, buffer + written, size - written);
+                if (n <= 0) {
+                    return;
+                }
+                written += static_cast<size_t>(n);
+            }
+        }
+
+        char buffer[512];
+        size_t size = 0;
+    };
+
+    void on_fatal_signal(int sig) {
+        dump(STDERR_FILENO);
+        // the handler was reset when this was called, so this does whatever the signal would have
+        std::raise(sig);
+    }
+}
+
+Ticket begin(Kind kind, const std::type_info& message, uint32_t handlers) {
+    uint64_t seq = last_seq.fetch_add(1, std::memory_order_relaxed) + 1;
+    auto& slot = slots[seq % capacity];
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.message.store(&message, std::memory_order_relaxed);
+    slot.kind.store(kind, std::memory_order_relaxed);
+    slot.handlers.store(handlers, std::memory_order_relaxed);
+    slot.emitted.store(now(), std::memory_order_relaxed);
+    slot.completed.store(0, std::memory_order_relaxed);
+    slot.seq.store(seq, std::memory_order_release);
+    return {seq};
+}
+
+void end(Ticket ticket) {
+    auto& slot = slots[ticket.seq % capacity];
+    if (slot.seq.load(std::memory_order_relaxed) == ticket.seq) {
+        slot.completed.store(now(), std::memory_order_relaxed);
+    }
+}
+
+std::vector<Record> snapshot() {
+    std::vector<Record> records;
+    records.reserve(capacity);
+    for (auto& slot: slots) {
+        Record record;
+        if (read(slot, record)) {
+            records.push_back(record);
+        }
+    }
+    std::sort(records.begin(), records.end(), [](const Record& a, const Record& b){return a.seq < b.seq;});
+    return records;
+}
+
+void dump(std::ostream& os) {
+    auto records = snapshot();
+    int64_t base = records.empty() ? 0 : records.front().emitted;
+    char times[64];
+    for (auto& record: records) {
+        if (record.completed) {
+            std::snprintf(times, sizeof(times), "%12.1f us %10.1f us  ", (record.emitted - base) / 1000.0, (record.completed - record.emitted) / 1000.0);
+        } else {
+            std::snprintf(times, sizeof(times), "%12.1f us    running  ", (record.emitted - base) / 1000.0);
+        }
+        os << times << kind_name(record.kind) << " " << tracing::type_name(*record.message) << " (" << record.handlers << " handlers)\n";
+    }
+}
+
+void dump(int fd) {
+    int64_t at = now();
+    uint64_t last = last_seq.load(std::memory_order_acquire);
+    uint64_t first = last > capacity ? last - capacity + 1 : 1;
+
+    Line header;
+    header.append("flight recorder, most recent last\n");
+    header.write_to(fd);
+
+    for (uint64_t seq = first; seq <= last; seq++) {
+        Record record;
+        if (!read(slots[seq % capacity], record) || record.seq != seq) {
+            continue;
+        }
+
+        Line line;
+        line.append("emitted ");
+        line.append(static_cast<uint64_t>(std::max<int64_t>(0, at - record.emitted) / 1000));
+        line.append(" us ago, ");
+        if (record.completed) {
+            line.append("took ");
+            line.append(static_cast<uint64_t>(std::max<int64_t>(0, record.completed - record.emitted) / 1000));
+            line.append(" us, ");
+        } else {
+            line.append("still running, ");
+        }
+        line.append(kind_name(record.kind));
+        line.append(" ");
+        line.append(record.message->name());
+        line.append(" (");
+        line.append(static_cast<uint64_t>(record.handlers));
+        line.append(" handlers)\n");
+        line.write_to(fd);
+    }
+}
+
+void install_crash_handler() {
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = on_fatal_signal;
+    action.sa_flags = SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+    for (int sig: {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT}) {
+        sigaction(sig, &action, nullptr);
+    }
+}
+
+}
+
+}
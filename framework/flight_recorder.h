@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <typeinfo>
+#include <vector>
+
+namespace pt {
+
+// Always on record of the last few thousand events emitted and requests made, by every context in
+// the process, for working out what was going on just before a hitch or a crash. Each records
+// when it was emitted and when its handlers finished.
+//
+// Records are kept in a fixed ring of slots, the oldest overwritten once it's full. Recording
+// takes no locks and never allocates, and the ring can be dumped from a fatal signal handler
+// (see install_crash_handler).
+namespace flight_recorder {
+    enum class Kind: uint8_t {
+        Event,
+        Request,
+    };
+
+    struct Record {
+        // counts up from 1, in the order they were emitted
+        uint64_t seq;
+        const std::type_info* message;
+        Kind kind;
+        uint32_t handlers;
+        // steady_clock nanoseconds
+        int64_t emitted;
+        // 0 if its handlers haven't finished
+        int64_t completed;
+    };
+
+    constexpr size_t capacity = 4096;
+
+    // given to end, when the handlers have finished
+    struct Ticket {
+        uint64_t seq;
+    };
+
+    Ticket begin(Kind kind, const std::type_info& message, uint32_t handlers);
+    // does nothing if the record has been overwritten already
+    void end(Ticket ticket);
+
+    // what's in the ring, oldest first
+    std::vector<Record> snapshot();
+
+    // one line per record, oldest first
+    void dump(std::ostream& os);
+
+    // The same but safe to call from a signal handler, names aren't demangled and times are
+    // relative to now.
+    void dump(int fd);
+
+    // Dumps the ring to stderr on SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT, before the signal
+    // is raised again to do whatever it would have.
+    void install_crash_handler();
+}
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <concepts>
+#include <utility>
+#include <vector>
+
+#include "thread_pool/promise.h"
+#include "thread_pool/when_all.h"
+
+#include "framework/concepts.h"
+
+namespace pt {
+
+// A request can be handled by more than one handler if it says how to combine their responses,
+// for when each handler only has part of the answer,
+//
+//      struct CountEntities {
+//          using ResponseT = size_t;
+//          static size_t reduce(size_t a, size_t b) {return a + b;}
+//      };
+//
+// Every handler of it is asked at once, spread over the context's pool, and their responses are
+// combined in the order the handlers were given to make_context.
+template<typename R>
+concept GatheredRequest = Request<R> && requires(typename R::ResponseT a, typename R::ResponseT b) {
+    {R::reduce(std::move(a), std::move(b))} -> std::convertible_to<typename R::ResponseT>;
+};
+
+namespace gather::detail {
+    template<GatheredRequest R, typename T = typename R::ResponseT>
+    Task<T> gather(std::vector<Task<T>> tasks) {
+        auto responses = co_await when_all(std::move(tasks));
+        T response = std::move(responses[0]);
+        for (size_t i = 1; i < responses.size(); i++) {
+            response = R::reduce(std::move(response), std::move(responses[i]));
+        }
+        co_return response;
+    }
+}
+
+}
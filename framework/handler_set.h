@@ -81,9 +81,22 @@ public:
         return std::invoke(std::forward<F>(f), handlers.template get<Is>()...);
     }
 
+    // the index of handler, which must be one of the handlers in this set
+    template<typename T>
+    size_t index_of(const T& handler) const {
+        return index_of(handler, std::make_index_sequence<sizeof...(HandlerTs)>{});
+    }
+
     template<typename...Ts>
     friend class HandlerSet;
 private:
+    template<typename T, size_t...Is>
+    size_t index_of(const T& handler, std::index_sequence<Is...>) const {
+        size_t index = 0;
+        ((std::is_same_v<T, HandlerTs> && static_cast<const void*>(&handlers.template get<Is>()) == &handler && (index = Is, true)) || ...);
+        return index;
+    }
+
     OrderedDestructingTuple<HandlerTs...> handlers;
 };
 
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <typeindex>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "thread_pool/promise.h"
+#include "thread_pool/thread_pool.h"
+
+#include "framework/concepts.h"
+
+namespace pt {
+
+// One request's handler running on behalf of everyone who asked for it while it was running.
+// It runs on its own rather than in any of their tasks, and lands once it's finished, resuming
+// everyone waiting with the same response.
+template<typename T>
+class Flight {
+public:
+    // keeps the flight alive until it's been awaited
+    struct awaiter {
+        using pool_aware = void;
+
+        bool await_ready() {
+            std::lock_guard lock{flight->mutex};
+            return flight->landed;
+        }
+
+        template<typename U>
+        bool await_suspend(std::coroutine_handle<U> h) noexcept {
+            std::lock_guard lock{flight->mutex};
+            if (flight->landed) {
+                return false;
+            }
+            flight->waiting.push_back({h, h.promise().pool, current_priority()});
+            return true;
+        }
+
+        std::shared_ptr<const T> await_resume() {
+            if (flight->error) {
+                std::rethrow_exception(flight->error);
+            }
+            return flight->response;
+        }
+
+        // for when a Task is needed, e.g. to await several with when_all
+        operator Task<std::shared_ptr<const T>>() && {
+            return wait_for(std::move(flight));
+        }
+
+        std::shared_ptr<Flight> flight;
+    };
+
+    // only one of response and error is set
+    void land(std::shared_ptr<const T> response, std::exception_ptr error) {
+        std::vector<Waiter> to_resume;
+        {
+            std::lock_guard lock{mutex};
+            this->response = std::move(response);
+            this->error = error;
+            landed = true;
+            to_resume.swap(waiting);
+        }
+        for (auto& w: to_resume) {
+            w.pool->push(w.handle, w.priority);
+        }
+    }
+
+private:
+    static Task<std::shared_ptr<const T>> wait_for(std::shared_ptr<Flight> flight) {
+        // kept out here, gcc destroys the temporary awaiter too early
+        awaiter a{std::move(flight)};
+        auto response = co_await a;
+        co_return response;
+    }
+
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        CoroutineThreadPool* pool;
+        Priority priority;
+    };
+
+    std::mutex mutex;
+    bool landed = false;
+    std::shared_ptr<const T> response;
+    std::exception_ptr error;
+    std::vector<Waiter> waiting;
+};
+
+// The requests a context has in flight for Context::coalesced, one list per request type
+class InFlightRequests {
+public:
+    // the flight request should wait for, and whether it's new and so has to be started by the caller
+    template<Request R>
+    std::pair<std::shared_ptr<Flight<typename R::ResponseT>>, bool> join(const R& request) {
+        std::lock_guard lock{mutex};
+        auto& p = by_type[typeid(R)];
+        if (!p) {
+            p = std::make_unique<FlightsOf<R>>();
+        }
+        auto& flights = static_cast<FlightsOf<R>&>(*p).flights;
+        for (auto& [r, flight]: flights) {
+            if (same_request(r, request)) {
+                return {flight, false};
+            }
+        }
+        auto flight = std::make_shared<Flight<typename R::ResponseT>>();
+        flights.emplace_back(request, flight);
+        return {std::move(flight), true};
+    }
+
+    // anything asking for request from now on starts a new flight
+    template<Request R>
+    void remove(const Flight<typename R::ResponseT>* flight) {
+        std::lock_guard lock{mutex};
+        auto& flights = static_cast<FlightsOf<R>&>(*by_type.at(typeid(R))).flights;
+        std::erase_if(flights, [&](const auto& f){return f.second.get() == flight;});
+    }
+
+private:
+    struct Flights {
+        virtual ~Flights() = default;
+    };
+
+    template<Request R>
+    struct FlightsOf: Flights {
+        static_assert(!std::is_void_v<typename R::ResponseT>, "Requests without a response can't be coalesced");
+
+        std::vector<std::pair<R, std::shared_ptr<Flight<typename R::ResponseT>>>> flights;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<std::type_index, std::unique_ptr<Flights>> by_type;
+};
+
+namespace in_flight::detail {
+    // Asks ctx for request, lands flight with the response then calls done_cb. The handler gets
+    // the copy in this frame as the caller's may be gone before any of the waiters are resumed.
+    template<typename F, IsContext C, Request R, typename T = typename R::ResponseT>
+    Task<> fly(F done_cb, C& ctx, InFlightRequests& in_flight_requests, std::shared_ptr<Flight<T>> flight, R request) {
+        std::shared_ptr<const T> response;
+        std::exception_ptr error;
+        try {
+            response = std::make_shared<const T>(co_await ctx(request));
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        in_flight_requests.remove<R>(flight.get());
+        flight->land(response, error);
+        done_cb(ctx);
+    }
+}
+
+}
@@ -0,0 +1,102 @@
+#include "framework/recording.h"
+
+#include <algorithm>
+
+namespace pt {
+
+namespace recording::detail {
+    namespace {
+        constexpr char magic[] = {'p', 't', 'r', 'e', 'c'};
+        constexpr uint64_t version = 1;
+        // more than these and it's not a recording
+        constexpr uint64_t max_types = 1 << 16;
+        constexpr uint64_t max_name = 1 << 12;
+        constexpr uint64_t max_size = 1 << 20;
+    }
+
+    void write_varint(std::ostream& os, uint64_t v) {
+        char bytes[10];
+        size_t n = 0;
+        do {
+            bytes[n] = static_cast<char>(v & 0x7f);
+            v >>= 7;
+            if (v) {
+                bytes[n] |= 0x80;
+            }
+            n++;
+        } while (v);
+        os.write(bytes, n);
+    }
+
+    std::optional<uint64_t> try_read_varint(std::istream& is) {
+        if (is.peek() == std::istream::traits_type::eof()) {
+            return std::nullopt;
+        }
+        return read_varint(is);
+    }
+
+    uint64_t read_varint(std::istream& is) {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            auto c = is.get();
+            if (c == std::istream::traits_type::eof()) {
+                throw BadRecording("recording ends part way through a record");
+            }
+            v |= static_cast<uint64_t>(c & 0x7f) << shift;
+            if (!(c & 0x80)) {
+                return v;
+            }
+        }
+        throw BadRecording("number in recording is too long");
+    }
+
+    void read_bytes(std::istream& is, void* bytes, size_t size) {
+        is.read(static_cast<char*>(bytes), static_cast<std::streamsize>(size));
+        if (static_cast<size_t>(is.gcount()) != size) {
+            throw BadRecording("recording ends part way through a record");
+        }
+    }
+
+    void write_header(std::ostream& os, const std::vector<Type>& types) {
+        os.write(magic, sizeof(magic));
+        write_varint(os, version);
+        write_varint(os, types.size());
+        for (auto& type: types) {
+            write_varint(os, type.name.size());
+            os.write(type.name.data(), static_cast<std::streamsize>(type.name.size()));
+            write_varint(os, type.size);
+        }
+    }
+
+    std::vector<Type> read_header(std::istream& is) {
+        char m[sizeof(magic)];
+        is.read(m, sizeof(m));
+        if (static_cast<size_t>(is.gcount()) != sizeof(m) || !std::equal(m, m + sizeof(m), magic)) {
+            throw BadRecording("not a recording");
+        }
+        if (read_varint(is) != version) {
+            throw BadRecording("recording is from a different version");
+        }
+
+        uint64_t num_types = read_varint(is);
+        if (num_types > max_types) {
+            throw BadRecording("recording has too many types");
+        }
+        std::vector<Type> types(num_types);
+        for (auto& type: types) {
+            uint64_t name_size = read_varint(is);
+            if (name_size > max_name) {
+                throw BadRecording("recorded type name is too long");
+            }
+            type.name.resize(name_size);
+            read_bytes(is, type.name.data(), type.name.size());
+            type.size = read_varint(is);
+            if (type.size > max_size) {
+                throw BadRecording("recorded type is too big");
+            }
+        }
+        return types;
+    }
+}
+
+}
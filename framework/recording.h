@@ -0,0 +1,184 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include "framework/context.h"
+
+namespace pt {
+
+// Recording of the events emitted into a Context, so a session can be played back into a fresh
+// one as a repeatable load test.
+//
+// A Recorder is given the event types to record (the inputs, MouseButton, KeyPress, WindowResize,
+// NewFrame and so on) and added to a context as an observer. Every emit of one of them is written
+// to the log with when it happened, whoever emitted it. Replay reads the log and emits them again.
+// Handlers that emit these themselves (the window, the framerate driver) should be left out of the
+// context being replayed into, or they'll emit them twice.
+//
+// Events are written as their bytes, so they have to be trivially copyable. The log is only
+// meant to be replayed by the same build that wrote it.
+//
+// Log format, numbers are LEB128:
+//   "ptrec" version
+//   number of types, then for each its mangled name (length, bytes) and size
+//   then records to the end, each: ns since the previous record, type index, the event's bytes
+struct BadRecording: std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+enum class ReplaySpeed {
+    // events are emitted as far apart as they were recorded, without waiting for each other
+    Recorded,
+    // each event is emitted as soon as the last one's handlers have all finished
+    AsFastAsPossible,
+};
+
+namespace recording::detail {
+    struct Type {
+        std::string name;
+        uint64_t size;
+    };
+
+    void write_varint(std::ostream& os, uint64_t v);
+    // throws BadRecording if the log ends first
+    uint64_t read_varint(std::istream& is);
+    // nullopt if the log has ended
+    std::optional<uint64_t> try_read_varint(std::istream& is);
+    void read_bytes(std::istream& is, void* bytes, size_t size);
+
+    void write_header(std::ostream& os, const std::vector<Type>& types);
+    std::vector<Type> read_header(std::istream& is);
+
+    template<typename E>
+    Type type_of() {
+        static_assert(std::is_trivially_copyable_v<E>, "recorded events are written as their bytes");
+        return {typeid(E).name(), sizeof(E)};
+    }
+}
+
+template<typename...EventTs>
+class Recorder: public ContextObserver {
+public:
+    // os has to outlive the recorder
+    Recorder(std::ostream& os): os(&os), last(std::chrono::steady_clock::now()) {
+        recording::detail::write_header(os, {recording::detail::type_of<EventTs>()...});
+    }
+
+    void event(void* event, std::type_index type) override {
+        size_t i = 0;
+        ((type == typeid(EventTs) ? write(i, static_cast<const EventTs*>(event)) : void(), i++), ...);
+    }
+
+private:
+    template<typename E>
+    void write(size_t index, const E* event) {
+        // events can be emitted from any thread
+        std::lock_guard l(m);
+        auto now = std::chrono::steady_clock::now();
+        recording::detail::write_varint(*os, std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count());
+        recording::detail::write_varint(*os, index);
+        os->write(reinterpret_cast<const char*>(event), sizeof(E));
+        last = now;
+    }
+
+    std::mutex m;
+    std::ostream* os;
+    std::chrono::steady_clock::time_point last;
+};
+
+// Plays a log written by a Recorder. EventTs are the types to emit, recorded events of any other
+// type are skipped.
+template<typename...EventTs>
+class Replay {
+public:
+    // reads the log's header, throws BadRecording if it isn't a log or a recorded type has changed size
+    Replay(std::istream& is): is(&is) {
+        auto types = recording::detail::read_header(is);
+        std::vector<recording::detail::Type> ours = {recording::detail::type_of<EventTs>()...};
+        for (auto& type: types) {
+            std::optional<size_t> index;
+            for (size_t i = 0; i < ours.size(); i++) {
+                if (ours[i].name == type.name) {
+                    if (ours[i].size != type.size) {
+                        throw BadRecording("recorded event " + type.name + " has changed size");
+                    }
+                    index = i;
+                }
+            }
+            recorded.push_back({index, type.size});
+        }
+    }
+
+    // Emits every event left in the log into ctx and waits for their handlers to finish, returns
+    // how many were emitted.
+    template<IsContext C>
+    size_t play(C& ctx, ReplaySpeed speed = ReplaySpeed::Recorded) {
+        size_t played = 0;
+        auto at = std::chrono::steady_clock::now();
+        std::vector<unsigned char> bytes;
+        while (auto since_last = recording::detail::try_read_varint(*is)) {
+            uint64_t index = recording::detail::read_varint(*is);
+            if (index >= recorded.size()) {
+                throw BadRecording("record of unknown type " + std::to_string(index));
+            }
+            auto& type = recorded[index];
+            bytes.resize(type.size);
+            recording::detail::read_bytes(*is, bytes.data(), bytes.size());
+            // skipped events still take up their time
+            at += std::chrono::nanoseconds(*since_last);
+            if (!type.index) {
+                continue;
+            }
+
+            if (speed == ReplaySpeed::Recorded) {
+                std::this_thread::sleep_until(at);
+            }
+            emit(ctx, *type.index, bytes.data(), speed, std::index_sequence_for<EventTs...>{});
+            played++;
+        }
+        ctx.wait_for_all_events_to_finish();
+        return played;
+    }
+
+private:
+    struct RecordedType {
+        // into EventTs, nullopt if it isn't being replayed
+        std::optional<size_t> index;
+        uint64_t size;
+    };
+
+    template<IsContext C, size_t...Is>
+    static void emit(C& ctx, size_t index, const unsigned char* bytes, ReplaySpeed speed, std::index_sequence<Is...>) {
+        ((index == Is ? emit<EventTs>(ctx, bytes, speed) : void()), ...);
+    }
+
+    template<typename E, IsContext C>
+    static void emit(C& ctx, const unsigned char* bytes, ReplaySpeed speed) {
+        E event;
+        std::memcpy(static_cast<void*>(&event), bytes, sizeof(E));
+        if (speed == ReplaySpeed::Recorded) {
+            ctx.emit(std::move(event));
+        } else {
+            ctx.emit_sync(std::move(event));
+        }
+    }
+
+    std::istream* is;
+    std::vector<RecordedType> recorded;
+};
+
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <concepts>
+#include <coroutine>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "thread_pool/promise.h"
+
+#include "framework/concepts.h"
+
+namespace pt {
+
+// A request whose response only changes when certain events are emitted can say which, and
+// Context remembers its responses instead of asking the handler every time,
+//
+//      struct GetWindowFramebufferSize {
+//          using ResponseT = Extent2D;
+//          using InvalidatedBy = std::tuple<WindowResize>;
+//      };
+//
+// or in a .msg file, `request GetWindowFramebufferSize -> Extent2D cached until WindowResize {}`.
+// A response is forgotten once one of InvalidatedBy is emitted into any context, and if
+// InvalidatedBy is empty the handler is asked once per context. Requests are told apart with
+// same_request.
+template<typename R>
+concept CachedRequest = Request<R> && requires {typename R::InvalidatedBy;};
+
+namespace request_cache::detail {
+    // Bumped when E is emitted and again when its handlers have finished, so a response worked
+    // out while they were running isn't kept either.
+    template<typename E>
+    inline std::atomic<uint64_t> generation = 0;
+
+    // Set the first time a request E invalidates is asked for. Until then nothing can have been
+    // remembered that E would make stale, so emitting E leaves generation alone.
+    template<typename E>
+    inline std::atomic<bool> watched = false;
+
+    template<typename E>
+    void invalidate() {
+        if (watched<E>.load()) {
+            generation<E>.fetch_add(1);
+        }
+    }
+
+    // before generation is read, so an emit that didn't see watched is over before the read
+    template<typename E>
+    void watch() {
+        if (!watched<E>.load(std::memory_order_relaxed)) {
+            watched<E>.store(true);
+        }
+    }
+
+    template<typename Tuple>
+    struct Generations;
+
+    template<typename...Es>
+    struct Generations<std::tuple<Es...>> {
+        using Type = std::array<uint64_t, sizeof...(Es)>;
+
+        static Type now() {
+            (watch<Es>(), ...);
+            return {generation<Es>.load()...};
+        }
+    };
+
+    // what InvalidatedBy's generations were when a response was asked for
+    template<CachedRequest R>
+    using Seen = typename Generations<typename R::InvalidatedBy>::Type;
+
+    template<CachedRequest R>
+    Seen<R> now() {
+        return Generations<typename R::InvalidatedBy>::now();
+    }
+}
+
+// The responses a context has remembered, one list per request type
+class RequestCache {
+public:
+    template<CachedRequest R>
+    std::optional<typename R::ResponseT> find(const R& request) {
+        auto now = request_cache::detail::now<R>();
+        std::lock_guard lock{mutex};
+        auto* entries = entries_of<R>();
+        if (!entries) {
+            return std::nullopt;
+        }
+
+        // every entry of R has the same InvalidatedBy so anything stale can go now
+        std::erase_if(entries->entries, [&](const auto& entry){return entry.seen != now;});
+        for (auto& entry: entries->entries) {
+            if (same_request(entry.request, request)) {
+                return entry.response;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // seen is from before the handler started, if anything in InvalidatedBy has been emitted
+    // since then the response is dropped
+    template<CachedRequest R>
+    void insert(const R& request, request_cache::detail::Seen<R> seen, const typename R::ResponseT& response) {
+        if (seen != request_cache::detail::now<R>()) {
+            return;
+        }
+
+        std::lock_guard lock{mutex};
+        auto& p = by_type[typeid(R)];
+        if (!p) {
+            p = std::make_unique<EntriesOf<R>>();
+        }
+        auto& entries = static_cast<EntriesOf<R>&>(*p).entries;
+        for (auto& entry: entries) {
+            if (same_request(entry.request, request)) {
+                entry.response = response;
+                entry.seen = seen;
+                return;
+            }
+        }
+        entries.push_back({request, response, seen});
+    }
+
+private:
+    struct Entries {
+        virtual ~Entries() = default;
+    };
+
+    template<CachedRequest R>
+    struct EntriesOf: Entries {
+        static_assert(!std::is_void_v<typename R::ResponseT>, "Requests without a response can't be cached");
+
+        struct Entry {
+            R request;
+            typename R::ResponseT response;
+            request_cache::detail::Seen<R> seen;
+        };
+
+        std::vector<Entry> entries;
+    };
+
+    template<CachedRequest R>
+    EntriesOf<R>* entries_of() {
+        auto it = by_type.find(typeid(R));
+        if (it == by_type.end()) {
+            return nullptr;
+        }
+        return static_cast<EntriesOf<R>*>(it->second.get());
+    }
+
+    std::mutex mutex;
+    std::unordered_map<std::type_index, std::unique_ptr<Entries>> by_type;
+};
+
+// What co_await ctx(request) gives for a cached request, the remembered response or else the
+// handler's task. A remembered response is given back without starting a coroutine, unless
+// it's turned into a Task to pass to something like when_all.
+template<typename T>
+class CachedResponse {
+public:
+    using pool_aware = void;
+    using task_type = Task<T>;
+
+    CachedResponse(T response): value(std::in_place_index<0>, std::move(response)) {}
+    CachedResponse(Task<T> task): value(std::in_place_index<1>, std::move(task)) {}
+
+    bool await_ready() const noexcept {
+        return value.index() == 0;
+    }
+
+    template<typename U>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<U> h) noexcept {
+        return task_awaitable().await_suspend(h);
+    }
+
+    T await_resume() {
+        if (value.index() == 0) {
+            return std::move(std::get<0>(value));
+        }
+        return task_awaitable().await_resume();
+    }
+
+    // see Task::set_priority, a remembered response has nothing to run
+    void set_priority(Priority priority) {
+        if (value.index() == 1) {
+            std::get<1>(value).set_priority(priority);
+        }
+    }
+
+    // the handler's task, or a task that just gives back the remembered response
+    operator Task<T>() && {
+        if (value.index() == 0) {
+            return ready(std::move(std::get<0>(value)));
+        }
+        return std::move(std::get<1>(value));
+    }
+
+private:
+    static Task<T> ready(T response) {
+        co_return response;
+    }
+
+    typename Task<T>::template awaitable<true> task_awaitable() {
+        return {std::get<1>(value).promise};
+    }
+
+    std::variant<T, Task<T>> value;
+};
+
+}
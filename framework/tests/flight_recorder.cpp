@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "framework/context.h"
+#include "framework/flight_recorder.h"
+#include "framework/tracing.h"
+#include "thread_pool/promise.h"
+
+using namespace pt;
+using namespace std::chrono_literals;
+
+namespace {
+    struct Ping {};
+    struct Nobody {};
+    struct Slow {
+        using ResponseT = int;
+    };
+
+    struct PingHandler {
+        EVENT(Ping) {
+            co_return;
+        }
+
+        REQUEST(Slow) {
+            std::this_thread::sleep_for(2ms);
+            co_return 1;
+        }
+    };
+
+    struct OtherPingHandler {
+        EVENT(Ping) {
+            co_return;
+        }
+    };
+
+    std::vector<flight_recorder::Record> records_of(const std::type_info& message) {
+        std::vector<flight_recorder::Record> ret;
+        for (auto& record: flight_recorder::snapshot()) {
+            if (*record.message == message) {
+                ret.push_back(record);
+            }
+        }
+        return ret;
+    }
+}
+
+TEST(FlightRecorder, should_record_events_and_requests) {
+    auto ctx = make_context(PingHandler{}, OtherPingHandler{});
+    ctx.emit_sync(Ping{});
+    ctx.emit_sync(Nobody{});
+    ASSERT_EQ(ctx.request_sync(Slow{}), 1);
+    ctx.wait_for_all_events_to_finish();
+
+    auto pings = records_of(typeid(Ping));
+    ASSERT_FALSE(pings.empty());
+    auto& ping = pings.back();
+    ASSERT_EQ(ping.kind, flight_recorder::Kind::Event);
+    ASSERT_EQ(ping.handlers, 2);
+    ASSERT_GE(ping.completed, ping.emitted);
+
+    auto nobody = records_of(typeid(Nobody));
+    ASSERT_FALSE(nobody.empty());
+    ASSERT_EQ(nobody.back().handlers, 0);
+
+    auto slow = records_of(typeid(Slow));
+    ASSERT_FALSE(slow.empty());
+    ASSERT_EQ(slow.back().kind, flight_recorder::Kind::Request);
+    ASSERT_EQ(slow.back().handlers, 1);
+    ASSERT_GE(slow.back().completed - slow.back().emitted, std::chrono::nanoseconds(2ms).count());
+
+    // in the order they were emitted
+    ASSERT_LT(ping.seq, nobody.back().seq);
+    ASSERT_LT(nobody.back().seq, slow.back().seq);
+}
+
+TEST(FlightRecorder, should_keep_only_the_most_recent) {
+    auto ctx = make_context(PingHandler{});
+    for (size_t i = 0; i < flight_recorder::capacity + 10; i++) {
+        ctx.emit_sync(Ping{});
+    }
+
+    auto records = flight_recorder::snapshot();
+    ASSERT_EQ(records.size(), flight_recorder::capacity);
+    for (size_t i = 1; i < records.size(); i++) {
+        ASSERT_EQ(records[i].seq, records[i - 1].seq + 1);
+    }
+    ASSERT_EQ(records_of(typeid(Ping)).size(), flight_recorder::capacity);
+}
+
+TEST(FlightRecorder, should_dump) {
+    auto ctx = make_context(PingHandler{});
+    ctx.emit_sync(Ping{});
+
+    std::stringstream dumped;
+    flight_recorder::dump(dumped);
+    auto s = dumped.str();
+    ASSERT_NE(s.find("event " + tracing::type_name(typeid(Ping)) + " (1 handlers)\n"), std::string::npos);
+
+    // as a signal handler would
+    FILE* f = std::tmpfile();
+    flight_recorder::dump(fileno(f));
+    std::rewind(f);
+    std::string raw;
+    char buffer[4096];
+    size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        raw.append(buffer, n);
+    }
+    std::fclose(f);
+    ASSERT_EQ(raw.find("flight recorder, most recent last\n"), 0);
+    ASSERT_NE(raw.find(std::string("event ") + typeid(Ping).name() + " (1 handlers)\n"), std::string::npos);
+}
+
+TEST(FlightRecorder, should_dump_on_a_crash) {
+    ASSERT_DEATH({
+        flight_recorder::install_crash_handler();
+        auto ctx = make_context(PingHandler{});
+        ctx.emit_sync(Ping{});
+        std::abort();
+    }, "flight recorder, most recent last");
+}
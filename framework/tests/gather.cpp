@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "framework/context.h"
+#include "framework/gather.h"
+#include "thread_pool/promise.h"
+
+using namespace pt;
+using namespace std::chrono_literals;
+
+namespace {
+    struct CountEntities {
+        using ResponseT = size_t;
+        static size_t reduce(size_t a, size_t b) {return a + b;}
+    };
+
+    struct ListEntities {
+        using ResponseT = std::vector<int>;
+        static std::vector<int> reduce(std::vector<int> a, std::vector<int> b) {
+            a.insert(a.end(), b.begin(), b.end());
+            return a;
+        }
+    };
+
+    // every shard waits here until all of them have started, so it only finishes if they're
+    // asked at the same time
+    struct Rendezvous {
+        using ResponseT = bool;
+        static bool reduce(bool a, bool b) {return a && b;}
+    };
+
+    struct Failing {
+        using ResponseT = int;
+        static int reduce(int a, int b) {return a + b;}
+    };
+
+    struct Shard {
+        REQUEST(CountEntities) {
+            co_return entities.size();
+        }
+
+        REQUEST(ListEntities) {
+            co_return entities;
+        }
+
+        REQUEST(Rendezvous) {
+            (*arrived)++;
+            auto until = std::chrono::steady_clock::now() + 5s;
+            while (*arrived < num_shards && std::chrono::steady_clock::now() < until) {
+                std::this_thread::yield();
+            }
+            co_return *arrived == num_shards;
+        }
+
+        REQUEST(Failing) {
+            if (entities.empty()) {
+                throw std::runtime_error("empty shard");
+            }
+            co_return 1;
+        }
+
+        std::vector<int> entities;
+        std::atomic<int>* arrived = nullptr;
+        int num_shards = 0;
+    };
+
+    template<size_t I>
+    struct NumberedShard: Shard {};
+}
+
+TEST(Gather, should_combine_every_handlers_response) {
+    auto ctx = make_context(NumberedShard<0>{{{1, 2}}}, NumberedShard<1>{{{3}}}, NumberedShard<2>{{{4, 5, 6}}});
+    ASSERT_EQ(ctx.request_sync(CountEntities{}), 6);
+    ASSERT_EQ(ctx.request_sync(ListEntities{}), (std::vector<int>{1, 2, 3, 4, 5, 6}));
+}
+
+TEST(Gather, should_ask_every_handler_at_once) {
+    std::atomic<int> arrived = 0;
+    auto ctx = make_context(
+        thread_pool_args<WorkStealingCoroutineThreadPool>(2),
+        NumberedShard<0>{{{}, &arrived, 2}},
+        NumberedShard<1>{{{}, &arrived, 2}}
+    );
+    ASSERT_TRUE(ctx.request_sync(Rendezvous{}));
+}
+
+TEST(Gather, should_rethrow_if_a_handler_throws) {
+    auto ctx = make_context(NumberedShard<0>{{{1}}}, NumberedShard<1>{{{}}});
+    ASSERT_THROW(ctx.request_sync(Failing{}), std::runtime_error);
+}
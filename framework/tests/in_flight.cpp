@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "framework/context.h"
+#include "thread_pool/promise.h"
+#include "thread_pool/sleep.h"
+#include "thread_pool/when_all.h"
+
+using namespace pt;
+using namespace std::chrono_literals;
+
+namespace {
+    struct Expensive {
+        using ResponseT = std::vector<int>;
+        int x;
+
+        bool operator==(const Expensive&) const = default;
+    };
+
+    struct Failing {
+        using ResponseT = int;
+    };
+
+    // what AskAtOnce got back
+    struct Responses {
+        std::vector<std::shared_ptr<const std::vector<int>>> responses;
+    };
+
+    // asks for Expensive{x} for each x at the same time
+    struct AskAtOnce {
+        using ResponseT = Responses;
+        std::vector<int> xs;
+    };
+
+    struct FailAtOnce {
+        using ResponseT = int;
+        int n;
+    };
+
+    struct Slow {
+        // the handler takes long enough that everyone has asked before it's done
+        REQUEST(Expensive) {
+            (*asked)++;
+            co_await sleep_until(std::chrono::steady_clock::now() + 10ms);
+            if (answered) {
+                (*answered)++;
+            }
+            co_return std::vector<int>(1000, request.x);
+        }
+
+        REQUEST(Failing) {
+            (*asked)++;
+            co_await sleep_until(std::chrono::steady_clock::now() + 10ms);
+            throw std::runtime_error("failed");
+        }
+
+        std::atomic<int>* asked;
+        std::atomic<int>* answered = nullptr;
+    };
+
+    // drops the first task it asks for before asking again
+    struct DropFirst {
+        using ResponseT = std::vector<int>;
+    };
+
+    struct Asker {
+        REQUEST(DropFirst) {
+            {
+                auto dropped = ctx.coalesced(Expensive{3});
+            }
+            auto response = co_await ctx.coalesced(Expensive{3});
+            co_return *response;
+        }
+
+        REQUEST(AskAtOnce) {
+            std::vector<Task<std::shared_ptr<const std::vector<int>>>> tasks;
+            for (auto x: request.xs) {
+                tasks.push_back(ctx.coalesced(Expensive{x}));
+            }
+            auto responses = co_await when_all(std::move(tasks));
+            co_return Responses{std::move(responses)};
+        }
+
+        REQUEST(FailAtOnce) {
+            std::vector<Task<int>> tasks;
+            for (int i = 0; i < request.n; i++) {
+                tasks.push_back(failed(ctx));
+            }
+            auto results = co_await when_all(std::move(tasks));
+            int failures = 0;
+            for (auto failure: results) {
+                failures += failure;
+            }
+            co_return failures;
+        }
+
+        // counts as 1 if Failing threw
+        template<IsContext C>
+        Task<int> failed(C& ctx) {
+            try {
+                co_await ctx.coalesced(Failing{});
+            } catch (const std::runtime_error&) {
+                co_return 1;
+            }
+            co_return 0;
+        }
+    };
+}
+
+TEST(InFlight, should_run_handler_once_for_requests_at_the_same_time) {
+    std::atomic<int> asked = 0;
+    auto ctx = make_context(Slow{&asked}, Asker{});
+    auto responses = ctx.request_sync(AskAtOnce{{1, 1, 1, 1}}).responses;
+    ASSERT_EQ(asked, 1);
+    ASSERT_EQ(responses.size(), 4);
+    for (auto& response: responses) {
+        ASSERT_EQ(response, responses[0]);
+    }
+    ASSERT_EQ(*responses[0], std::vector<int>(1000, 1));
+}
+
+TEST(InFlight, should_tell_requests_apart) {
+    std::atomic<int> asked = 0;
+    auto ctx = make_context(Slow{&asked}, Asker{});
+    auto responses = ctx.request_sync(AskAtOnce{{1, 2, 1, 2}}).responses;
+    ASSERT_EQ(asked, 2);
+    ASSERT_EQ(responses[0], responses[2]);
+    ASSERT_EQ(responses[1], responses[3]);
+    ASSERT_EQ(responses[1]->front(), 2);
+}
+
+TEST(InFlight, should_ask_again_once_landed) {
+    std::atomic<int> asked = 0;
+    auto ctx = make_context(Slow{&asked}, Asker{});
+    ctx.request_sync(AskAtOnce{{1, 1}});
+    ctx.request_sync(AskAtOnce{{1, 1}});
+    ASSERT_EQ(asked, 2);
+}
+
+TEST(InFlight, should_rethrow_to_everyone_waiting) {
+    std::atomic<int> asked = 0;
+    auto ctx = make_context(Slow{&asked}, Asker{});
+    ASSERT_EQ(ctx.request_sync(FailAtOnce{3}), 3);
+    ASSERT_EQ(asked, 1);
+}
+
+TEST(InFlight, should_not_need_the_first_to_ask_to_await) {
+    std::atomic<int> asked = 0;
+    auto ctx = make_context(Slow{&asked}, Asker{});
+    ASSERT_EQ(ctx.request_sync(DropFirst{}), std::vector<int>(1000, 3));
+    ASSERT_EQ(asked, 1);
+}
+
+TEST(InFlight, should_be_waited_for_like_an_event) {
+    std::atomic<int> asked = 0;
+    std::atomic<int> answered = 0;
+    auto ctx = make_context(Slow{&asked, &answered}, Asker{});
+    {
+        auto dropped = ctx.coalesced(Expensive{3});
+    }
+    ctx.wait_for_all_events_to_finish();
+    ASSERT_EQ(answered, 1);
+}
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "framework/context.h"
+#include "framework/recording.h"
+#include "thread_pool/promise.h"
+
+using namespace pt;
+using namespace std::chrono_literals;
+
+namespace {
+    struct Click {
+        int button;
+        double x;
+        double y;
+    };
+
+    struct Resize {
+        int width;
+        int height;
+    };
+
+    struct Frame {};
+
+    // not recorded
+    struct Internal {
+        int x;
+    };
+
+    struct Seen {
+        std::vector<int> buttons;
+        std::vector<int> widths;
+        int frames = 0;
+        int internals = 0;
+    };
+
+    struct Input {
+        EVENT(Click) {
+            seen->buttons.push_back(event.button);
+            co_return;
+        }
+
+        EVENT(Resize) {
+            seen->widths.push_back(event.width);
+            co_return;
+        }
+
+        EVENT(Frame) {
+            seen->frames++;
+            co_await ctx.emit_await(Internal{1});
+        }
+
+        EVENT(Internal) {
+            seen->internals++;
+            co_return;
+        }
+
+        Seen* seen;
+    };
+
+    std::string record(std::chrono::milliseconds between = 0ms) {
+        std::stringstream log;
+        Recorder<Click, Resize, Frame> recorder{log};
+        Seen seen;
+        auto ctx = make_context(Input{&seen});
+        ctx.addObserver(recorder);
+
+        ctx.emit_sync(Click{1, 2.5, 3.5});
+        std::this_thread::sleep_for(between);
+        ctx.emit_sync(Resize{640, 480});
+        ctx.emit_sync(Frame{});
+        ctx.emit(Click{2, 0, 0});
+        ctx.wait_for_all_events_to_finish();
+        return log.str();
+    }
+}
+
+TEST(Recording, should_replay_recorded_events_in_order) {
+    std::stringstream log{record()};
+
+    Seen seen;
+    auto ctx = make_context(Input{&seen});
+    Replay<Click, Resize, Frame> replay{log};
+    ASSERT_EQ(replay.play(ctx, ReplaySpeed::AsFastAsPossible), 4);
+
+    ASSERT_EQ(seen.buttons, (std::vector<int>{1, 2}));
+    ASSERT_EQ(seen.widths, (std::vector<int>{640}));
+    ASSERT_EQ(seen.frames, 1);
+    // emitted by a handler of Frame, not by the replay
+    ASSERT_EQ(seen.internals, 1);
+}
+
+TEST(Recording, should_keep_recorded_time_between_events) {
+    std::stringstream log{record(50ms)};
+
+    Seen seen;
+    auto ctx = make_context(Input{&seen});
+    Replay<Click, Resize, Frame> replay{log};
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(replay.play(ctx), 4);
+    ASSERT_GE(std::chrono::steady_clock::now() - start, 50ms);
+    ASSERT_EQ(seen.buttons.size(), 2);
+}
+
+TEST(Recording, should_skip_events_that_arent_replayed) {
+    std::stringstream log{record()};
+
+    Seen seen;
+    auto ctx = make_context(Input{&seen});
+    Replay<Resize> replay{log};
+    ASSERT_EQ(replay.play(ctx, ReplaySpeed::AsFastAsPossible), 1);
+    ASSERT_TRUE(seen.buttons.empty());
+    ASSERT_EQ(seen.widths, (std::vector<int>{640}));
+}
+
+TEST(Recording, should_keep_the_time_taken_by_events_that_arent_replayed) {
+    // the 50ms is before the Resize, between the two Clicks
+    std::stringstream log{record(50ms)};
+
+    Seen seen;
+    auto ctx = make_context(Input{&seen});
+    Replay<Click> replay{log};
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(replay.play(ctx), 2);
+    ASSERT_GE(std::chrono::steady_clock::now() - start, 50ms);
+    ASSERT_EQ(seen.buttons, (std::vector<int>{1, 2}));
+}
+
+TEST(Recording, should_reject_logs_it_cant_read) {
+    std::stringstream not_a_log{"hello"};
+    ASSERT_THROW(Replay<Click>{not_a_log}, BadRecording);
+
+    auto log = record();
+    std::stringstream truncated{log.substr(0, log.size() - 3)};
+    Seen seen;
+    auto ctx = make_context(Input{&seen});
+    Replay<Click, Resize, Frame> replay{truncated};
+    ASSERT_THROW(replay.play(ctx, ReplaySpeed::AsFastAsPossible), BadRecording);
+}
@@ -0,0 +1,184 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <tuple>
+
+#include "framework/context.h"
+#include "framework/request_cache.h"
+#include "thread_pool/deadline.h"
+#include "thread_pool/promise.h"
+#include "thread_pool/when_all.h"
+
+using namespace pt;
+using namespace std::chrono_literals;
+
+namespace {
+    struct Resize {
+        int width;
+    };
+    struct Unrelated {};
+
+    struct GetWidth {
+        using ResponseT = int;
+        using InvalidatedBy = std::tuple<Resize>;
+    };
+
+    struct Square {
+        using ResponseT = int;
+        using InvalidatedBy = std::tuple<>;
+        int x;
+
+        bool operator==(const Square&) const = default;
+    };
+
+    struct GetUncachedWidth {
+        using ResponseT = int;
+    };
+
+    struct Window {
+        EVENT(Resize) {
+            width = event.width;
+            co_return;
+        }
+
+        REQUEST(GetWidth) {
+            (*asked)++;
+            co_return width;
+        }
+
+        REQUEST(Square) {
+            (*asked)++;
+            co_return request.x * request.x;
+        }
+
+        REQUEST(GetUncachedWidth) {
+            (*asked)++;
+            co_return width;
+        }
+
+        std::atomic<int>* asked;
+        int width = 1;
+    };
+
+    struct Rotate {};
+
+    struct GetRotation {
+        using ResponseT = int;
+        using InvalidatedBy = std::tuple<Rotate>;
+    };
+
+    struct Compass {
+        EVENT(Rotate) {
+            rotation++;
+            co_return;
+        }
+
+        REQUEST(GetRotation) {
+            co_return rotation;
+        }
+
+        int rotation = 0;
+    };
+
+    // asks for GetWidth while Resize is being handled, before the width has changed
+    struct AsksDuringResize {
+        EVENT(Resize) {
+            width = co_await ctx(GetWidth{});
+        }
+
+        int width = 0;
+    };
+
+    // asks for cached requests the way it would for any other task
+    struct AskTogether {
+        using ResponseT = int;
+    };
+
+    struct Combiner {
+        REQUEST(AskTogether) {
+            auto [width, square, uncached] = co_await when_all(ctx(GetWidth{}), ctx(Square{3}), ctx(GetUncachedWidth{}));
+            int in_time = co_await with_timeout(ctx(GetWidth{}), 10s);
+            co_return width + square + uncached + in_time;
+        }
+    };
+}
+
+TEST(RequestCache, should_only_ask_the_handler_once) {
+    std::atomic<int> asked = 0;
+    auto ctx = make_context(Window{&asked});
+    ASSERT_EQ(ctx.request_sync(GetWidth{}), 1);
+    ASSERT_EQ(ctx.request_sync(GetWidth{}), 1);
+    ASSERT_EQ(asked, 1);
+
+    ctx.request_sync(GetUncachedWidth{});
+    ctx.request_sync(GetUncachedWidth{});
+    ASSERT_EQ(asked, 3);
+}
+
+TEST(RequestCache, should_ask_again_after_invalidating_event) {
+    std::atomic<int> asked = 0;
+    auto ctx = make_context(Window{&asked});
+    ASSERT_EQ(ctx.request_sync(GetWidth{}), 1);
+
+    ctx.emit_sync(Unrelated{});
+    ASSERT_EQ(ctx.request_sync(GetWidth{}), 1);
+    ASSERT_EQ(asked, 1);
+
+    ctx.emit_sync(Resize{2});
+    ASSERT_EQ(ctx.request_sync(GetWidth{}), 2);
+    ASSERT_EQ(ctx.request_sync(GetWidth{}), 2);
+    ASSERT_EQ(asked, 2);
+}
+
+TEST(RequestCache, should_not_keep_responses_from_while_event_is_handled) {
+    std::atomic<int> asked = 0;
+    auto ctx = make_context(AsksDuringResize{}, Window{&asked});
+    ctx.emit_sync(Resize{2});
+    ASSERT_EQ(ctx.request_sync(GetWidth{}), 2);
+}
+
+TEST(RequestCache, should_tell_requests_apart) {
+    std::atomic<int> asked = 0;
+    auto ctx = make_context(Window{&asked});
+    ASSERT_EQ(ctx.request_sync(Square{2}), 4);
+    ASSERT_EQ(ctx.request_sync(Square{3}), 9);
+    ASSERT_EQ(ctx.request_sync(Square{2}), 4);
+    ASSERT_EQ(asked, 2);
+
+    // nothing invalidates Square
+    ctx.emit_sync(Resize{2});
+    ASSERT_EQ(ctx.request_sync(Square{3}), 9);
+    ASSERT_EQ(asked, 2);
+}
+
+TEST(RequestCache, should_give_a_remembered_response_without_starting_anything) {
+    std::atomic<int> asked = 0;
+    auto ctx = make_context(Window{&asked});
+    ASSERT_FALSE(ctx(GetWidth{}).await_ready());
+    ctx.request_sync(GetWidth{});
+    auto remembered = ctx(GetWidth{});
+    ASSERT_TRUE(remembered.await_ready());
+    ASSERT_EQ(remembered.await_resume(), 1);
+}
+
+TEST(RequestCache, should_only_count_events_a_cached_request_depends_on) {
+    auto ctx = make_context(Compass{});
+    ctx.emit_sync(Rotate{});
+    ASSERT_EQ(request_cache::detail::generation<Rotate>, 0);
+
+    ASSERT_EQ(ctx.request_sync(GetRotation{}), 1);
+    ctx.emit_sync(Rotate{});
+    ASSERT_GT(request_cache::detail::generation<Rotate>, 0);
+    ASSERT_EQ(ctx.request_sync(GetRotation{}), 2);
+}
+
+TEST(RequestCache, should_pass_cached_requests_to_anything_that_takes_a_task) {
+    std::atomic<int> asked = 0;
+    auto ctx = make_context(Window{&asked}, Combiner{});
+    // asked for the first time, then remembered
+    ASSERT_EQ(ctx.request_sync(AskTogether{}), 12);
+    ASSERT_EQ(asked, 3);
+    ASSERT_EQ(ctx.request_sync(AskTogether{}), 12);
+    ASSERT_EQ(asked, 4);
+}
@@ -3,6 +3,7 @@
 #include <functional>
 #include <future>
 #include <iostream>
+#include <latch>
 
 #include "framework/context.h"
 #include "framework/concepts.h"
@@ -29,6 +30,8 @@ struct AsyncSpinUpWaitFor {
     WaitFor* wait_for;
 };
 
+struct Throw {};
+
 struct TestHandler {
     EVENT(ConfirmDelivery) {
         if (event.depth == 1) {
@@ -87,6 +90,11 @@ struct TestHandler {
         ctx.emit(std::move(*event.wait_for));
         co_return;
     }
+
+    EVENT(Throw) {
+        throw std::runtime_error("handler failed");
+        co_return;
+    }
 };
 
 class TestContext: public ::testing::Test {
@@ -131,6 +139,10 @@ protected:
         p.set_value();
     }
 
+    void assert_handler_exception_is_swallowed() {
+        ASSERT_NO_THROW(ctx.emit_sync(Throw{}));
+    }
+
 private:
     std::vector<std::promise<void>> promises;
     Context<TestHandler> ctx;
@@ -183,6 +195,11 @@ TEST_F(TestContext, emit_sync_shouldnt_wait_for_unawaited_events) {
     assert_emit_sync_doesnt_wait_for_unawaited_events();
 }
 
+TEST_F(TestContext, should_carry_on_after_a_handler_throws) {
+    assert_handler_exception_is_swallowed();
+    assert_message_can_be_delivered();
+}
+
 
 struct Req {using ResponseT = int;};
 struct Req2 {using ResponseT = int;};
@@ -216,3 +233,235 @@ TEST(TestMakeContext, should_allow_calling_previous_handlers_in_ctor) {
 
     ASSERT_EQ(ctx.request_sync(Req2{}), 75);
 }
+
+struct Rendezvous {
+    std::latch* latch;
+};
+
+struct RendezvousHandler {
+    EVENT(Rendezvous) {
+        event.latch->arrive_and_wait();
+        co_return;
+    }
+};
+
+TEST(TestMakeContext, should_run_handlers_in_parallel_on_chosen_thread_pool) {
+    auto ctx = make_context(
+        thread_pool_args<WorkStealingCoroutineThreadPool>(2),
+        RendezvousHandler{},
+        RendezvousHandler{}
+    );
+
+    // both handlers block until the other has started, so this only finishes if they run on
+    // different threads
+    std::latch latch{2};
+    ctx.emit_sync(Rendezvous{&latch});
+}
+
+TEST(TestMakeContext, should_allow_calling_previous_handlers_in_ctor_with_chosen_thread_pool) {
+    auto ctx = make_context(
+        thread_pool_args<WorkStealingCoroutineThreadPool>(4),
+        Handler1(74),
+        ctor_args<Handler2>()
+    );
+
+    ASSERT_EQ(ctx.request_sync(Req2{}), 75);
+}
+
+struct Increment {};
+struct GetCount {using ResponseT = int;};
+
+struct CountingHandler {
+    EVENT(Increment) {
+        int running = ++(*this->running);
+        if (running > 1) {
+            overlapped = true;
+        }
+        // not atomic, relies on the context never running two of our coroutines at once
+        count++;
+        std::this_thread::yield();
+        --(*this->running);
+        co_return;
+    }
+
+    REQUEST(GetCount) {
+        co_return overlapped ? -1 : count;
+    }
+
+    std::unique_ptr<std::atomic<int>> running = std::make_unique<std::atomic<int>>(0);
+    bool overlapped = false;
+    int count = 0;
+};
+
+TEST(TestMakeContext, should_not_run_a_handler_in_parallel_with_itself_on_a_multi_threaded_pool) {
+    auto ctx = make_context(
+        thread_pool_args<WorkStealingCoroutineThreadPool>(4),
+        CountingHandler{}
+    );
+
+    for (size_t i = 0; i < 10000; i++) {
+        ctx.emit(Increment{});
+    }
+    ctx.wait_for_all_events_to_finish();
+
+    ASSERT_EQ(ctx.request_sync(GetCount{}), 10000);
+}
+
+struct Tick {};
+struct RunFrames {
+    using ResponseT = int;
+    int num_frames;
+};
+
+struct TickHandler {
+    EVENT(Tick) {
+        ticks++;
+        co_return;
+    }
+
+    int ticks = 0;
+};
+
+struct FrameLoopHandler {
+    REQUEST(RunFrames) {
+        for (int i = 0; i < request.num_frames; i++) {
+            co_await ctx.emit_await(Tick{});
+        }
+        co_return request.num_frames;
+    }
+};
+
+TEST(TestMakeContext, should_not_allocate_frames_from_the_heap_once_warmed_up) {
+    auto ctx = make_context(TickHandler{}, TickHandler{}, FrameLoopHandler{});
+
+    ctx.request_sync(RunFrames{10});
+    auto before = frame_allocator_stats();
+
+    ASSERT_EQ(ctx.request_sync(RunFrames{1000}), 1000);
+
+    auto after = frame_allocator_stats();
+    ASSERT_EQ(after.heap_allocations, before.heap_allocations);
+}
+
+struct Urgent {
+    static constexpr Priority priority = Priority::High;
+    Priority* seen;
+};
+
+struct Whenever {
+    Priority* seen;
+};
+
+struct GetPriority {
+    using ResponseT = Priority;
+};
+
+struct PriorityHandler {
+    EVENT(Urgent) {
+        *event.seen = current_priority();
+        co_return;
+    }
+
+    EVENT(Whenever) {
+        *event.seen = current_priority();
+        co_return;
+    }
+};
+
+struct GetPriorityHandler {
+    REQUEST(GetPriority) {
+        co_return current_priority();
+    }
+};
+
+TEST(TestMakeContext, should_run_handlers_at_the_priority_they_were_emitted_at) {
+    auto ctx = make_context(PriorityHandler{}, GetPriorityHandler{});
+
+    Priority seen;
+    ctx.emit_sync(Whenever{&seen});
+    ASSERT_EQ(seen, Priority::Normal);
+    ctx.emit_sync(Urgent{&seen});
+    ASSERT_EQ(seen, Priority::High);
+    ctx.emit_sync(Whenever{&seen}, Priority::Background);
+    ASSERT_EQ(seen, Priority::Background);
+
+    ASSERT_EQ(ctx.request_sync(GetPriority{}), Priority::Normal);
+    ASSERT_EQ(ctx.request_sync(GetPriority{}, Priority::High), Priority::High);
+}
+
+TEST(TestMakeContext, should_run_every_handler_at_the_priority_they_were_emitted_at) {
+    auto ctx = make_context(
+        thread_pool_args<WorkStealingCoroutineThreadPool>(2),
+        PriorityHandler{},
+        PriorityHandler{}
+    );
+
+    // both handlers write the same thing
+    Priority seen;
+    ctx.emit_sync(Urgent{&seen});
+    ASSERT_EQ(seen, Priority::High);
+    ctx.emit_sync(Whenever{&seen}, Priority::Background);
+    ASSERT_EQ(seen, Priority::Background);
+}
+
+struct Dropped {
+    std::atomic<int>* handled;
+};
+
+struct DroppedHandler {
+    EVENT(Dropped) {
+        (*event.handled)++;
+        co_return;
+    }
+};
+
+TEST(TestMakeContext, should_still_run_handlers_if_an_emit_isnt_awaited) {
+    std::atomic<int> handled = 0;
+    {
+        auto one = make_context(DroppedHandler{});
+        auto two = make_context(thread_pool_args<WorkStealingCoroutineThreadPool>(2), DroppedHandler{}, DroppedHandler{});
+        {
+            auto dropped_one = one.emit_await(Dropped{&handled});
+            auto dropped_two = two.emit_await(Dropped{&handled});
+        }
+        // the contexts wait for the handlers as they go rather than hanging
+    }
+    ASSERT_EQ(handled, 3);
+}
+
+struct Hop {
+    bool* ran;
+};
+
+struct Hopper {
+    using ResponseT = bool;
+};
+
+struct HopHandler {
+    EVENT(Hop) {
+        *event.ran = true;
+        co_return;
+    }
+};
+
+struct HopperHandler {
+    // whether Hop's handler had already run by the time emit_await returned
+    REQUEST(Hopper) {
+        bool ran = false;
+        auto emitted = ctx.emit_await(Hop{&ran});
+        bool ran_before_await = ran;
+        co_await std::move(emitted);
+        co_return ran_before_await;
+    }
+};
+
+TEST(TestMakeContext, should_run_a_lone_handler_inline_when_emitted_on_its_pool) {
+    // one thread, so if the handler were pushed it couldn't have run yet
+    auto ctx = make_context(HopHandler{}, HopperHandler{});
+
+    ASSERT_TRUE(ctx.request_sync(Hopper{}));
+
+    bool ran = false;
+    ctx.emit_sync(Hop{&ran});
+    ASSERT_TRUE(ran);
+}
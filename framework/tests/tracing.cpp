@@ -0,0 +1,324 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "framework/context.h"
+#include "framework/tracing.h"
+#include "thread_pool/promise.h"
+#include "thread_pool/watchdog.h"
+#include "thread_pool/work_stealing_thread_pool.h"
+
+using namespace pt;
+using namespace std::chrono_literals;
+
+static_assert(tracing::enabled, "tracing tests have to be built with PT_TRACING");
+
+namespace {
+    struct Tick {};
+
+    struct Slow {
+        using ResponseT = int;
+    };
+
+    struct TickCounter {
+        EVENT(Tick) {
+            count++;
+            co_return;
+        }
+
+        int count = 0;
+    };
+
+    struct SlowHandler {
+        EVENT(Tick) {
+            std::this_thread::sleep_for(1ms);
+            co_return;
+        }
+
+        REQUEST(Slow) {
+            std::this_thread::sleep_for(5ms);
+            co_return 4;
+        }
+    };
+
+    // a frame much like the renderer's, NewFrame leads to PreRender which leads to requests
+    struct Frame {};
+    struct PreRender {};
+    struct GetGui {
+        using ResponseT = int;
+    };
+    struct Transfer {
+        using ResponseT = int;
+    };
+
+    struct Renderer {
+        EVENT(Frame) {
+            co_await ctx.emit_await(PreRender{});
+        }
+    };
+
+    struct Gui {
+        EVENT(PreRender) {
+            co_await ctx(GetGui{});
+            co_await ctx(Transfer{});
+        }
+
+        REQUEST(GetGui) {
+            std::this_thread::sleep_for(2ms);
+            co_return 1;
+        }
+    };
+
+    struct Buffers {
+        EVENT(PreRender) {
+            co_return;
+        }
+
+        REQUEST(Transfer) {
+            std::this_thread::sleep_for(1ms);
+            co_return 2;
+        }
+    };
+
+    // Kicker checks Kicked's handler has started before it awaits the emit
+    struct Kick {};
+    struct Kicked {
+        std::atomic<bool>* started;
+    };
+
+    struct Kicker {
+        EVENT(Kick) {
+            // answered on another strand, so Kicker is pushed back onto the pool after
+            co_await ctx(GetGui{});
+            std::atomic<bool> started = false;
+            auto kicked = ctx.emit_await(Kicked{&started});
+            auto until = std::chrono::steady_clock::now() + 5s;
+            while (!started && std::chrono::steady_clock::now() < until) {
+                std::this_thread::yield();
+            }
+            *started_before_awaited = started;
+            co_await std::move(kicked);
+        }
+
+        bool* started_before_awaited;
+    };
+
+    struct KickedHandler {
+        EVENT(Kicked) {
+            *event.started = true;
+            co_return;
+        }
+    };
+
+    struct Stuck {};
+
+    struct Blocker {
+        EVENT(Stuck) {
+            std::this_thread::sleep_for(200ms);
+            co_return;
+        }
+    };
+
+    const tracing::Span& find(const std::vector<tracing::Span>& spans, const std::type_info& message, const std::type_info* handler) {
+        for (auto& span: spans) {
+            if (*span.message == message && (span.handler == handler || (span.handler && handler && *span.handler == *handler))) {
+                return span;
+            }
+        }
+        throw std::runtime_error("no span for " + tracing::type_name(message));
+    }
+
+    size_t count(const std::string& s, const std::string& of) {
+        size_t n = 0;
+        for (size_t i = s.find(of); i != std::string::npos; i = s.find(of, i + 1)) {
+            n++;
+        }
+        return n;
+    }
+}
+
+TEST(LatencyHistogram, should_give_percentiles_to_within_a_few_percent) {
+    tracing::LatencyHistogram h;
+    for (int i = 1; i <= 1000; i++) {
+        h.record(std::chrono::microseconds(i));
+    }
+
+    ASSERT_EQ(h.count(), 1000);
+    ASSERT_EQ(h.min(), 1us);
+    ASSERT_EQ(h.max(), 1000us);
+    ASSERT_EQ(h.mean(), 500500ns);
+    ASSERT_NEAR(h.percentile(50).count(), 500000, 500000 * 0.04);
+    ASSERT_NEAR(h.percentile(99).count(), 990000, 990000 * 0.04);
+    ASSERT_EQ(h.percentile(100), 1000us);
+
+    tracing::LatencyHistogram other;
+    other.record(1s);
+    h.merge(other);
+    ASSERT_EQ(h.count(), 1001);
+    ASSERT_EQ(h.max(), 1s);
+}
+
+TEST(LatencyHistogram, should_be_exact_for_small_values) {
+    tracing::LatencyHistogram h;
+    for (int i = 0; i < 32; i++) {
+        h.record(std::chrono::nanoseconds(i));
+    }
+    for (int i = 1; i <= 32; i++) {
+        ASSERT_EQ(h.percentile(i * 100.0 / 32), std::chrono::nanoseconds(i - 1));
+    }
+}
+
+TEST(Tracing, should_record_every_handler_of_events_and_requests) {
+    tracing::collect();
+    auto ctx = make_context(TickCounter{}, SlowHandler{});
+
+    ctx.emit_sync(Tick{});
+    ctx.emit_sync(Tick{});
+    ASSERT_EQ(ctx.request_sync(Slow{}), 4);
+    ctx.wait_for_all_events_to_finish();
+
+    auto spans = tracing::collect();
+    auto latencies = tracing::latencies(spans);
+    ASSERT_EQ(latencies.size(), 3);
+
+    auto find_latency = [&](const std::type_info& handler, const std::type_info& message) {
+        for (auto& l: latencies) {
+            if (l.handler == tracing::type_name(handler) && l.message == tracing::type_name(message)) {
+                return l;
+            }
+        }
+        throw std::runtime_error("no latencies for " + tracing::type_name(handler));
+    };
+
+    auto slow = find_latency(typeid(SlowHandler), typeid(Slow));
+    ASSERT_EQ(slow.kind, tracing::Kind::Request);
+    ASSERT_EQ(slow.histogram.count(), 1);
+    ASSERT_GE(slow.histogram.min(), 5ms);
+
+    auto slow_tick = find_latency(typeid(SlowHandler), typeid(Tick));
+    ASSERT_EQ(slow_tick.kind, tracing::Kind::Event);
+    ASSERT_EQ(slow_tick.histogram.count(), 2);
+    ASSERT_GE(slow_tick.histogram.min(), 1ms);
+
+    ASSERT_EQ(find_latency(typeid(TickCounter), typeid(Tick)).histogram.count(), 2);
+
+    // slowest first
+    for (size_t i = 1; i < latencies.size(); i++) {
+        auto total = [](const tracing::HandlerLatency& l){return l.histogram.mean() * l.histogram.count();};
+        ASSERT_GE(total(latencies[i - 1]), total(latencies[i]));
+    }
+
+    for (auto& span: spans) {
+        ASSERT_LE(span.start, span.end);
+    }
+
+    // everything's been taken
+    ASSERT_TRUE(tracing::collect().empty());
+}
+
+TEST(Tracing, should_export_a_chrome_trace) {
+    tracing::collect();
+    auto ctx = make_context(TickCounter{}, SlowHandler{});
+    ctx.emit_sync(Tick{});
+    ctx.request_sync(Slow{});
+    ctx.wait_for_all_events_to_finish();
+
+    auto spans = tracing::collect();
+    std::stringstream trace;
+    tracing::write_chrome_trace(trace, spans);
+
+    auto s = trace.str();
+    ASSERT_EQ(s.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["), 0);
+    ASSERT_EQ(count(s, "\"ph\":\"X\""), 4);
+    ASSERT_EQ(count(s, "\"cat\":\"request\""), 1);
+    ASSERT_EQ(count(s, "\"cat\":\"emit\""), 1);
+    ASSERT_EQ(count(s, tracing::type_name(typeid(SlowHandler))), 2);
+
+    std::stringstream report;
+    tracing::write_latency_report(report, spans);
+    ASSERT_EQ(count(report.str(), "\n"), 4);
+}
+
+TEST(Tracing, should_tie_nested_handlers_to_what_started_them) {
+    tracing::collect();
+    auto ctx = make_context(thread_pool_args<WorkStealingCoroutineThreadPool>(4), Renderer{}, Gui{}, Buffers{});
+    ctx.emit_sync(Frame{});
+    ctx.wait_for_all_events_to_finish();
+
+    auto spans = tracing::collect();
+    ASSERT_EQ(spans.size(), 7);
+
+    auto& frame = find(spans, typeid(Frame), nullptr);
+    auto& renderer = find(spans, typeid(Frame), &typeid(Renderer));
+    auto& pre_render = find(spans, typeid(PreRender), nullptr);
+    auto& gui = find(spans, typeid(PreRender), &typeid(Gui));
+    auto& buffers = find(spans, typeid(PreRender), &typeid(Buffers));
+    auto& get_gui = find(spans, typeid(GetGui), &typeid(Gui));
+    auto& transfer = find(spans, typeid(Transfer), &typeid(Buffers));
+
+    ASSERT_EQ(frame.parent, 0);
+    ASSERT_EQ(renderer.parent, frame.id);
+    ASSERT_EQ(pre_render.parent, renderer.id);
+    ASSERT_EQ(gui.parent, pre_render.id);
+    ASSERT_EQ(buffers.parent, pre_render.id);
+    ASSERT_EQ(get_gui.parent, gui.id);
+    ASSERT_EQ(transfer.parent, gui.id);
+
+    // Gui's requests are made one after the other, Transfer is the last thing PreRender waits for
+    auto path = tracing::critical_path(spans, frame);
+    std::vector<uint64_t> ids;
+    for (auto& span: path) {
+        ids.push_back(span.id);
+    }
+    ASSERT_EQ(ids, (std::vector<uint64_t>{frame.id, renderer.id, pre_render.id, gui.id, transfer.id}));
+
+    std::stringstream report;
+    tracing::write_critical_path(report, spans, frame);
+    ASSERT_EQ(count(report.str(), "\n"), 5);
+}
+
+TEST(Tracing, should_start_handlers_before_the_emit_is_awaited) {
+    tracing::collect();
+    bool started_before_awaited = false;
+    {
+        auto ctx = make_context(thread_pool_args<WorkStealingCoroutineThreadPool>(2), Kicker{&started_before_awaited}, Gui{}, KickedHandler{});
+        ctx.emit_sync(Kick{});
+        ctx.wait_for_all_events_to_finish();
+    }
+    ASSERT_TRUE(started_before_awaited);
+
+    auto spans = tracing::collect();
+    auto& kicker = find(spans, typeid(Kick), &typeid(Kicker));
+    auto& kicked = find(spans, typeid(Kicked), nullptr);
+    auto& handler = find(spans, typeid(Kicked), &typeid(KickedHandler));
+    ASSERT_EQ(kicked.parent, kicker.id);
+    ASSERT_EQ(handler.parent, kicked.id);
+}
+
+TEST(Tracing, should_name_the_handler_the_watchdog_finds_stuck) {
+    std::mutex m;
+    std::vector<std::string> stuck;
+    {
+        auto ctx = make_context(Blocker{});
+        Watchdog watchdog{20ms, [&](const watchdog::Stall& stall) {
+            std::lock_guard l(m);
+            stuck.push_back(tracing::describe(stall.span));
+        }};
+        ctx.emit_sync(Stuck{});
+        ctx.wait_for_all_events_to_finish();
+    }
+    tracing::collect();
+
+    ASSERT_EQ(stuck.size(), 1);
+    auto handler = tracing::type_name(typeid(Blocker)) + " / " + tracing::type_name(typeid(Stuck)) + " (event)";
+    ASSERT_EQ(stuck[0], handler + " <- emit " + tracing::type_name(typeid(Stuck)));
+
+    // nothing's open any more
+    ASSERT_EQ(tracing::describe(tracing::next_span_id()), "");
+}
@@ -0,0 +1,447 @@
+#include "framework/tracing.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <tuple>
+
+#include <cxxabi.h>
+
+#include "queues/spsc_ring.h"
+
+namespace pt {
+
+namespace tracing {
+
+// Only the thread the table belongs to opens spans, but they can be closed and read from any.
+// Readers check id is the same before and after reading the rest, like a seqlock.
+struct OpenSpan {
+    std::atomic<uint64_t> id = 0;
+    std::atomic<uint64_t> parent = 0;
+    std::atomic<const std::type_info*> message = nullptr;
+    std::atomic<const std::type_info*> handler = nullptr;
+    std::atomic<Kind> kind = Kind::Event;
+};
+
+namespace {
+    // spans each thread can hold between collects
+    constexpr size_t buffer_capacity = 1 << 14;
+    // spans each thread can have open at once, ids are sequential per thread so the slot is the
+    // low bits of the id
+    constexpr size_t open_capacity = 256;
+
+    struct ThreadBuffer {
+        ThreadBuffer(uint32_t thread): thread(thread) {}
+
+        bool has_open() const {
+            return std::any_of(open.begin(), open.end(), [](const OpenSpan& slot) {return slot.id.load(std::memory_order_acquire) != 0;});
+        }
+
+        SpscRing<Span> ring{buffer_capacity};
+        std::array<OpenSpan, open_capacity> open;
+        uint32_t thread;
+        // only touched by the thread the buffer belongs to
+        uint64_t last_span_id = 0;
+        // only written by the thread the buffer belongs to
+        std::atomic<uint64_t> dropped = 0;
+        // set once the thread has exited, collect frees the buffer once it's been emptied and
+        // nothing it opened is still open
+        std::atomic<bool> exited = false;
+    };
+
+    struct Registry {
+        std::mutex m;
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+        uint32_t next_thread = 0;
+        // from buffers that have been freed
+        uint64_t dropped = 0;
+    };
+
+    Registry& registry() {
+        static Registry* r = new Registry;
+        return *r;
+    }
+
+    struct Registration {
+        Registration() {
+            auto& r = registry();
+            std::lock_guard l(r.m);
+            r.buffers.push_back(std::make_unique<ThreadBuffer>(r.next_thread++));
+            buffer = r.buffers.back().get();
+        }
+
+        ~Registration() {
+            buffer->exited.store(true, std::memory_order_release);
+        }
+
+        ThreadBuffer* buffer;
+    };
+
+    ThreadBuffer& this_thread_buffer() {
+        thread_local Registration registration;
+        return *registration.buffer;
+    }
+
+    std::string json_escape(const std::string& s) {
+        std::string ret;
+        ret.reserve(s.size());
+        for (char c: s) {
+            if (c == '"' || c == '\\') {
+                ret.push_back('\\');
+                ret.push_back(c);
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                ret += escaped;
+            } else {
+                ret.push_back(c);
+            }
+        }
+        return ret;
+    }
+
+    const char* kind_name(Kind kind) {
+        switch (kind) {
+            case Kind::Event: return "event";
+            case Kind::Request: return "request";
+            case Kind::Emit: return "emit";
+        }
+        return "";
+    }
+
+    std::string span_name(const Span& span) {
+        std::string name = type_name(*span.message);
+        if (span.handler) {
+            return type_name(*span.handler) + " / " + name;
+        }
+        return "emit " + name;
+    }
+
+    // r.m must be held
+    std::optional<Span> find_open(Registry& r, uint64_t id) {
+        uint64_t thread = (id >> 40) - 1;
+        for (auto& buffer: r.buffers) {
+            if (buffer->thread != thread) {
+                continue;
+            }
+
+            auto& slot = buffer->open[id % open_capacity];
+            if (slot.id.load(std::memory_order_acquire) != id) {
+                return std::nullopt;
+            }
+            Span span = {};
+            span.id = id;
+            span.parent = slot.parent.load(std::memory_order_relaxed);
+            span.message = slot.message.load(std::memory_order_relaxed);
+            span.handler = slot.handler.load(std::memory_order_relaxed);
+            span.kind = slot.kind.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.id.load(std::memory_order_relaxed) != id) {
+                return std::nullopt;
+            }
+            return span;
+        }
+        return std::nullopt;
+    }
+}
+
+int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t next_span_id() {
+    // no two threads share a buffer, so the thread number keeps ids unique without them having to
+    // agree on anything
+    auto& buffer = this_thread_buffer();
+    return (static_cast<uint64_t>(buffer.thread + 1) << 40) | ++buffer.last_span_id;
+}
+
+void record(Span span) {
+    auto& buffer = this_thread_buffer();
+    span.thread = buffer.thread;
+    if (!buffer.ring.push(span)) {
+        buffer.dropped.store(buffer.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+
+OpenSpan* open(uint64_t id, uint64_t parent, Kind kind, const std::type_info& message, const std::type_info* handler) {
+    auto& slot = this_thread_buffer().open[id % open_capacity];
+    slot.id.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.parent.store(parent, std::memory_order_relaxed);
+    slot.message.store(&message, std::memory_order_relaxed);
+    slot.handler.store(handler, std::memory_order_relaxed);
+    slot.kind.store(kind, std::memory_order_relaxed);
+    slot.id.store(id, std::memory_order_release);
+    return &slot;
+}
+
+void close(OpenSpan* slot, uint64_t id) {
+    // the slot may have been taken by a newer span already
+    slot->id.compare_exchange_strong(id, 0, std::memory_order_release, std::memory_order_relaxed);
+}
+
+std::string describe(uint64_t span) {
+    auto& r = registry();
+    std::lock_guard l(r.m);
+
+    std::string ret;
+    // ids aren't reused so the parents can't loop, the depth is only a backstop
+    for (int depth = 0; span != 0 && depth < 32; depth++) {
+        auto open = find_open(r, span);
+        if (!open) {
+            break;
+        }
+        if (!ret.empty()) {
+            ret += " <- ";
+        }
+        ret += span_name(*open);
+        if (open->handler) {
+            ret += std::string(" (") + kind_name(open->kind) + ")";
+        }
+        span = open->parent;
+    }
+    return ret;
+}
+
+void report_stall(const watchdog::Stall& stall) {
+    std::string what = describe(stall.span);
+    if (what.empty()) {
+        what = stall.span ? "span " + std::to_string(stall.span) : std::string("an untraced coroutine");
+    }
+    watchdog::write_stall(std::cerr, stall, what);
+}
+
+std::vector<Span> collect() {
+    auto& r = registry();
+    std::lock_guard l(r.m);
+
+    std::vector<Span> spans;
+    std::erase_if(r.buffers, [&](const std::unique_ptr<ThreadBuffer>& buffer) {
+        // checked first, anything recorded before the thread exited is then drained below
+        bool exited = buffer->exited.load(std::memory_order_acquire);
+        buffer->ring.pop_all([&](const Span& span){spans.push_back(span);});
+        if (!exited || buffer->has_open()) {
+            return false;
+        }
+        r.dropped += buffer->dropped.load(std::memory_order_relaxed);
+        return true;
+    });
+
+    std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b){return a.start < b.start;});
+    return spans;
+}
+
+uint64_t dropped() {
+    auto& r = registry();
+    std::lock_guard l(r.m);
+    uint64_t ret = r.dropped;
+    for (auto& buffer: r.buffers) {
+        ret += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    return ret;
+}
+
+size_t LatencyHistogram::bucket_of(uint64_t ns) {
+    if (ns < sub_buckets) {
+        return static_cast<size_t>(ns);
+    }
+    // the top sub_bucket_bits + 1 bits of ns pick the bucket
+    int shift = std::bit_width(ns) - 1 - sub_bucket_bits;
+    return static_cast<size_t>(shift + 1) * sub_buckets + static_cast<size_t>((ns >> shift) - sub_buckets);
+}
+
+uint64_t LatencyHistogram::highest_in(size_t i) {
+    if (i < sub_buckets) {
+        return i;
+    }
+    int shift = static_cast<int>(i / sub_buckets) - 1;
+    uint64_t lowest = (sub_buckets + i % sub_buckets) << shift;
+    return lowest + (uint64_t(1) << shift) - 1;
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds d) {
+    uint64_t ns = d.count() < 0 ? 0 : static_cast<uint64_t>(d.count());
+    counts[bucket_of(ns)]++;
+    total++;
+    min_ns = std::min(min_ns, ns);
+    max_ns = std::max(max_ns, ns);
+    sum_ns += ns;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& o) {
+    for (size_t i = 0; i < num_buckets; i++) {
+        counts[i] += o.counts[i];
+    }
+    total += o.total;
+    min_ns = std::min(min_ns, o.min_ns);
+    max_ns = std::max(max_ns, o.max_ns);
+    sum_ns += o.sum_ns;
+}
+
+std::chrono::nanoseconds LatencyHistogram::min() const {
+    return std::chrono::nanoseconds(total == 0 ? 0 : min_ns);
+}
+
+std::chrono::nanoseconds LatencyHistogram::max() const {
+    return std::chrono::nanoseconds(max_ns);
+}
+
+std::chrono::nanoseconds LatencyHistogram::mean() const {
+    return std::chrono::nanoseconds(total == 0 ? 0 : static_cast<int64_t>(sum_ns / total));
+}
+
+std::chrono::nanoseconds LatencyHistogram::percentile(double p) const {
+    if (total == 0) {
+        return std::chrono::nanoseconds(0);
+    }
+    p = std::clamp(p, 0.0, 100.0);
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p / 100.0 * static_cast<double>(total))));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < num_buckets; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return std::chrono::nanoseconds(std::clamp(highest_in(i), min_ns, max_ns));
+        }
+    }
+    return std::chrono::nanoseconds(max_ns);
+}
+
+std::string type_name(const std::type_info& type) {
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+    if (status != 0 || !demangled) {
+        return type.name();
+    }
+    std::string ret = demangled;
+    std::free(demangled);
+    return ret;
+}
+
+std::vector<HandlerLatency> latencies(std::span<const Span> spans) {
+    std::map<std::tuple<const std::type_info*, const std::type_info*, Kind>, LatencyHistogram> by_handler;
+    for (auto& span: spans) {
+        if (span.kind == Kind::Emit) {
+            continue;
+        }
+        by_handler[{span.handler, span.message, span.kind}].record(std::chrono::nanoseconds(span.end - span.start));
+    }
+
+    std::vector<HandlerLatency> ret;
+    for (auto& [key, histogram]: by_handler) {
+        auto& [handler, message, kind] = key;
+        ret.push_back({type_name(*handler), type_name(*message), kind, histogram});
+    }
+    std::sort(ret.begin(), ret.end(), [](const HandlerLatency& a, const HandlerLatency& b) {
+        return a.histogram.mean() * a.histogram.count() > b.histogram.mean() * b.histogram.count();
+    });
+    return ret;
+}
+
+void write_latency_report(std::ostream& os, std::span<const Span> spans) {
+    auto us = [](std::chrono::nanoseconds d) {
+        char s[32];
+        std::snprintf(s, sizeof(s), "%10.1f", static_cast<double>(d.count()) / 1000.0);
+        return std::string(s);
+    };
+
+    os << "     count    p50 us    p90 us    p99 us    max us  handler / message\n";
+    for (auto& l: latencies(spans)) {
+        char count[16];
+        std::snprintf(count, sizeof(count), "%10llu", static_cast<unsigned long long>(l.histogram.count()));
+        os << count
+           << us(l.histogram.percentile(50))
+           << us(l.histogram.percentile(90))
+           << us(l.histogram.percentile(99))
+           << us(l.histogram.max())
+           << "  " << l.handler << " / " << l.message << " (" << kind_name(l.kind) << ")\n";
+    }
+}
+
+void write_chrome_trace(std::ostream& os, std::span<const Span> spans) {
+    int64_t base = spans.empty() ? 0 : spans.front().start;
+    for (auto& span: spans) {
+        base = std::min(base, span.start);
+    }
+
+    // names are looked up once per type rather than once per span
+    std::map<const std::type_info*, std::string> names;
+    auto name_of = [&](const std::type_info* type) -> const std::string& {
+        auto it = names.find(type);
+        if (it == names.end()) {
+            it = names.emplace(type, json_escape(type_name(*type))).first;
+        }
+        return it->second;
+    };
+
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    char times[64];
+    for (auto& span: spans) {
+        if (!first) {
+            os << ",";
+        }
+        first = false;
+
+        // trace_event times are microseconds
+        std::snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f", (span.start - base) / 1000.0, (span.end - span.start) / 1000.0);
+        os << "\n{\"name\":\"" << name_of(span.message) << "\",\"cat\":\"" << kind_name(span.kind)
+           << "\",\"ph\":\"X\"," << times << ",\"pid\":1,\"tid\":" << span.thread
+           << ",\"args\":{\"id\":" << span.id << ",\"parent\":" << span.parent;
+        if (span.handler) {
+            os << ",\"handler\":\"" << name_of(span.handler) << "\"";
+        }
+        os << "}}";
+    }
+    os << "\n]}\n";
+}
+
+std::vector<Span> critical_path(std::span<const Span> spans, const Span& root) {
+    std::multimap<uint64_t, const Span*> children;
+    for (auto& span: spans) {
+        if (span.parent != 0) {
+            children.emplace(span.parent, &span);
+        }
+    }
+
+    std::vector<Span> path = {root};
+    while (true) {
+        auto& parent = path.back();
+        const Span* last = nullptr;
+        auto [begin, end] = children.equal_range(parent.id);
+        for (auto it = begin; it != end; it++) {
+            auto* child = it->second;
+            if (child->end <= parent.end && (!last || child->end > last->end)) {
+                last = child;
+            }
+        }
+        if (!last) {
+            return path;
+        }
+        path.push_back(*last);
+    }
+}
+
+void write_critical_path(std::ostream& os, std::span<const Span> spans, const Span& root) {
+    auto path = critical_path(spans, root);
+    char times[64];
+    for (size_t i = 0; i < path.size(); i++) {
+        auto& span = path[i];
+        int64_t waiting = i + 1 < path.size() ? path[i + 1].end - path[i + 1].start : 0;
+        std::snprintf(times, sizeof(times), "%10.1f us %10.1f us self  ", (span.end - span.start) / 1000.0, (span.end - span.start - waiting) / 1000.0);
+        os << times << std::string(2 * i, ' ') << span_name(span) << "\n";
+    }
+}
+
+}
+
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <span>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#include "thread_pool/watchdog.h"
+
+namespace pt {
+
+// Handler tracing, built in when PT_TRACING is defined (bazel build --config=tracing). Without it
+// Context doesn't record anything and none of this is called.
+//
+// Each handler invocation is recorded with when it started and finished into a buffer belonging
+// to the thread it finished on, writing to it takes no locks. collect() takes everything recorded
+// so far, which can then be turned into latency histograms or a trace for chrome://tracing or
+// Perfetto.
+//
+// Spans know which span they were started from, handlers' spans are carried through everything
+// they await (see thread_pool/span.h). So a request made by a handler of an event emitted by
+// another handler can be traced back to the first, and critical_path can say which chain of
+// them a frame was waiting on. Spans that haven't finished can be described, which is what names
+// the handler in a stall report from the watchdog (see thread_pool/watchdog.h).
+namespace tracing {
+
+#ifdef PT_TRACING
+    constexpr bool enabled = true;
+#else
+    constexpr bool enabled = false;
+#endif
+
+    enum class Kind: uint8_t {
+        // a handler handling an event
+        Event,
+        // a handler handling a request
+        Request,
+        // an event from being emitted until all its handlers have finished
+        Emit,
+    };
+
+    // One handler invocation, or emit. Times are steady_clock nanoseconds.
+    struct Span {
+        uint64_t id;
+        // 0 if it wasn't started from another span
+        uint64_t parent;
+        const std::type_info* message;
+        // null for Emit
+        const std::type_info* handler;
+        Kind kind;
+        // small numbers given to threads in the order they first record something
+        uint32_t thread;
+        int64_t start;
+        int64_t end;
+    };
+
+    int64_t now();
+
+    // unique, and never 0
+    uint64_t next_span_id();
+
+    // Records span into this thread's buffer. If the buffer is full the span is dropped.
+    void record(Span span);
+
+    // takes everything recorded by every thread since the last collect
+    std::vector<Span> collect();
+
+    // how many spans have been dropped because a thread's buffer was full
+    uint64_t dropped();
+
+    // a slot in the table of spans that have started but not finished
+    struct OpenSpan;
+
+    // Adds a span to this thread's table of open ones, until it's closed. The table is small,
+    // when a thread has too many open the oldest are forgotten.
+    OpenSpan* open(uint64_t id, uint64_t parent, Kind kind, const std::type_info& message, const std::type_info* handler);
+    // can be called from any thread
+    void close(OpenSpan* slot, uint64_t id);
+
+    // What an open span is, and what it was started from, like
+    // "Gui / GetGui (request) <- Gui / PreRender (event) <- emit PreRender". Empty if span isn't open.
+    std::string describe(uint64_t span);
+
+    // For Watchdog, writes the stall to std::cerr naming the handler that's stuck
+    void report_stall(const watchdog::Stall& stall);
+
+    // Records a span from construction to destruction
+    class SpanScope {
+    public:
+        SpanScope(uint64_t parent, Kind kind, const std::type_info& message, const std::type_info* handler):
+            id(next_span_id()), parent(parent), message(&message), handler(handler), kind(kind), start(now()),
+            slot(open(id, parent, kind, message, handler)) {}
+
+        ~SpanScope() {
+            close(slot, id);
+            record({id, parent, message, handler, kind, 0, start, now()});
+        }
+
+        SpanScope(const SpanScope&) = delete;
+        SpanScope& operator=(const SpanScope&) = delete;
+
+        const uint64_t id;
+
+    private:
+        uint64_t parent;
+        const std::type_info* message;
+        const std::type_info* handler;
+        Kind kind;
+        int64_t start;
+        OpenSpan* slot;
+    };
+
+    // Log-linear histogram of durations in the style of HdrHistogram. Values are bucketed to
+    // within about 3% at any magnitude, so it stays small however long the tail is.
+    class LatencyHistogram {
+    public:
+        void record(std::chrono::nanoseconds d);
+        void merge(const LatencyHistogram& o);
+
+        uint64_t count() const {return total;}
+        std::chrono::nanoseconds min() const;
+        std::chrono::nanoseconds max() const;
+        std::chrono::nanoseconds mean() const;
+
+        // the duration p percent of recorded durations are no longer than
+        std::chrono::nanoseconds percentile(double p) const;
+
+    private:
+        static constexpr int sub_bucket_bits = 5;
+        static constexpr size_t sub_buckets = size_t(1) << sub_bucket_bits;
+        static constexpr size_t num_buckets = (64 - sub_bucket_bits + 1) * sub_buckets;
+
+        static size_t bucket_of(uint64_t ns);
+        // the largest value that goes in bucket i
+        static uint64_t highest_in(size_t i);
+
+        std::array<uint64_t, num_buckets> counts{};
+        uint64_t total = 0;
+        uint64_t min_ns = std::numeric_limits<uint64_t>::max();
+        uint64_t max_ns = 0;
+        // long double so a long run of long handlers can't overflow it
+        long double sum_ns = 0;
+    };
+
+    struct HandlerLatency {
+        std::string handler;
+        std::string message;
+        Kind kind;
+        LatencyHistogram histogram;
+    };
+
+    // One histogram per handler and message pair, the slowest (by total time) first. Emit spans
+    // aren't included.
+    std::vector<HandlerLatency> latencies(std::span<const Span> spans);
+
+    // a table of the above, one line per handler and message
+    void write_latency_report(std::ostream& os, std::span<const Span> spans);
+
+    // Chrome trace_event JSON, load it in chrome://tracing or ui.perfetto.dev
+    void write_chrome_trace(std::ostream& os, std::span<const Span> spans);
+
+    // The chain of spans root was waiting on, starting with root. Each is the last of its parent's
+    // children to finish, out of those that finished before their parent did. The rest were
+    // started but not awaited.
+    std::vector<Span> critical_path(std::span<const Span> spans, const Span& root);
+
+    // root's critical path, one line per span with how long it took and how much of that wasn't
+    // spent waiting on the next
+    void write_critical_path(std::ostream& os, std::span<const Span> spans, const Span& root);
+
+    // the readable name of a type
+    std::string type_name(const std::type_info& type);
+}
+
+}
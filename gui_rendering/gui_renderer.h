@@ -73,8 +73,9 @@ public:
         VertexBufferBuilder vbBuilder(glm::uvec2(swapChainInfo.extent.width, swapChainInfo.extent.height));
         GuiVisitor visitor(vbBuilder);
 
-        auto gui = co_await ctx(GetGui{});
-        visitor.visit(gui);
+        // every renderer wants the gui on PreRender, they share one copy of it
+        auto gui = co_await ctx.coalesced(GetGui{});
+        visitor.visit(*gui);
         vertexBuffers = std::move(vbBuilder).build();
 
         vkDeviceWaitIdle(device);
@@ -245,6 +245,18 @@ void defineData(const module::Message& message, const module::Module& module, st
         header.append(";\n");
     }
 
+    // see framework/request_cache.h
+    if (message.cachedUntil) {
+        header.append("    using InvalidatedBy = std::tuple<");
+        bool doComma = false;
+        for (const auto& event: *message.cachedUntil) {
+            if (doComma) header.append(", ");
+            doComma = true;
+            header.append(dumpDataType(event, module));
+        }
+        header.append(">;\n");
+    }
+
     const bool addComparison = canHaveComparisonOperators(message, module);
 
     if (addComparison) {
@@ -285,6 +297,7 @@ CppSource genCpp(const module::Module& module, const std::vector<std::string>& i
     header.append("#include <vector>\n");
     header.append("#include <optional>\n");
     header.append("#include <variant>\n");
+    header.append("#include <tuple>\n");
 
     for (const auto& h: systemHeaders) {
         header.append("#include <");
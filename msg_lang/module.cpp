@@ -332,6 +332,13 @@ private:
                 DataType dataType = parseDataType(**itemNode.responseType, message, itemFromFile.file->sourceFile, itemFromFile.itemNode->sourcePos);
                 message.expectedResponse = dataType;
             }
+
+            if (itemNode.cachedUntil) {
+                message.cachedUntil = std::vector<DataType>();
+                for (const auto& eventNode: *itemNode.cachedUntil) {
+                    message.cachedUntil->push_back(parseDataType(eventNode, message, itemFromFile.file->sourceFile, eventNode.sourcePos));
+                }
+            }
         }
     }
 
@@ -488,6 +495,12 @@ private:
             for (const auto& member: message.members) {
                 checkNumTemplateArgumentsForDataType(member.type);
             }
+
+            if (message.cachedUntil) {
+                for (const auto& event: *message.cachedUntil) {
+                    checkNumTemplateArgumentsForDataType(event);
+                }
+            }
         }
     }
 
@@ -522,6 +535,35 @@ private:
                     break;
                 }
             }
+
+            if (message.cachedUntil && message.type != MessageType::Request) {
+                addError({
+                    .message = "Only requests can be cached",
+                    .location = getLocation(*message.sourceFile, message.sourcePos),
+                });
+            }
+
+            if (message.cachedUntil) {
+                for (const auto& event: *message.cachedUntil) {
+                    bool isEvent = event.visit(
+                        [&](const MessageHandle& h) {return mod.getMessage(h).type == MessageType::Event;},
+                        // could be anything, the C++ compiler will have to check
+                        [](const ImportedType&) {return true;},
+                        [](const TemplateInstance&) {return true;},
+                        [](const TemplateParameter&) {return true;},
+                        [](const TemplateMemberType&) {return true;},
+                        // already reported
+                        [](const ErrorDataType&) {return true;},
+                        [](const BuiltinType&) {return false;}
+                    );
+                    if (!isEvent) {
+                        addError({
+                            .message = "Requests can only be cached until an event",
+                            .location = event.sourceLocation(),
+                        });
+                    }
+                }
+            }
         }
     }
 };
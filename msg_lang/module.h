@@ -151,6 +151,8 @@ struct Message {
     MessageType type;
     std::vector<MessageMember> members;
     std::optional<DataType> expectedResponse;
+    // set for requests whose responses can be cached, the events that invalidate them
+    std::optional<std::vector<DataType>> cachedUntil;
     std::optional<std::vector<TemplateParameter>> templateParams;
 };
 
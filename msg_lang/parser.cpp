@@ -398,6 +398,33 @@ private:
             item.responseType = std::move(*responseTypeName);
         }
 
+        // optional caching, "cached" or "cached until Event1, Event2"
+        if (!tokens.empty() && tokens.front().template is<TokenV::Word>() && tokens.front().template get<TokenV::Word>().s == "cached") {
+            popToken();
+            item.cachedUntil = std::vector<AstNode>();
+
+            if (!tokens.empty() && tokens.front().template is<TokenV::Word>() && tokens.front().template get<TokenV::Word>().s == "until") {
+                popToken();
+                while (true) {
+                    if (tokens.empty() || !tokens.front().template is<TokenV::Word>()) {
+                        addError("Expected event name");
+                        return;
+                    }
+
+                    auto eventTypeName = parseTypeName();
+                    if (!eventTypeName) {
+                        return;
+                    }
+                    item.cachedUntil->push_back(std::move(**eventTypeName));
+
+                    if (tokens.empty() || !tokens.front().template is<TokenV::Comma>()) {
+                        break;
+                    }
+                    popToken();
+                }
+            }
+        }
+
         // opening brace
         if (tokens.empty() || !tokens.front().template is<TokenV::CurlyBracket>()) {
             addError("Expected {");
@@ -50,6 +50,8 @@ namespace AstNodeV {
         TokenV::Word name;
         std::optional<std::vector<AstNode>> templateParams; // TemplateParam
         std::optional<std::unique_ptr<AstNode>> responseType; // TypeName
+        // set if the response can be cached, holds the events that invalidate it
+        std::optional<std::vector<AstNode>> cachedUntil; // TypeName
         std::vector<AstNode> members; // ItemMember
     };
 
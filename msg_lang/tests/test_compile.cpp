@@ -577,3 +577,57 @@ data D -> int {}
 
     assertCompileFails();
 }
+
+TEST_F(TestModule, cached_requests_should_know_what_invalidates_them) {
+    addFile(R"#(
+event Resized {}
+event Moved {}
+request Size -> int cached until Resized, Moved {}
+request Device -> int cached {}
+request Uncached -> int {}
+    )#");
+
+    auto m = compile();
+    ASSERT_TRUE(m.errors.empty());
+
+    auto size = m.messageByName(ItemName{"Size"});
+    ASSERT_NE(size, std::nullopt);
+    ASSERT_NE((*size)->cachedUntil, std::nullopt);
+    ASSERT_EQ((*size)->cachedUntil->size(), 2);
+    ASSERT_EQ(m.getMessage((*size)->cachedUntil->at(0).template get<module::MessageHandle>()).name, ItemName{"Resized"});
+    ASSERT_EQ(m.getMessage((*size)->cachedUntil->at(1).template get<module::MessageHandle>()).name, ItemName{"Moved"});
+
+    auto device = m.messageByName(ItemName{"Device"});
+    ASSERT_NE(device, std::nullopt);
+    ASSERT_NE((*device)->cachedUntil, std::nullopt);
+    ASSERT_TRUE((*device)->cachedUntil->empty());
+
+    auto uncached = m.messageByName(ItemName{"Uncached"});
+    ASSERT_NE(uncached, std::nullopt);
+    ASSERT_EQ((*uncached)->cachedUntil, std::nullopt);
+}
+
+TEST_F(TestModule, should_only_allow_requests_to_be_cached) {
+    addFile(R"#(
+event E cached {}
+    )#");
+
+    assertCompileFails();
+}
+
+TEST_F(TestModule, should_only_allow_requests_to_be_cached_until_events) {
+    addFile(R"#(
+data D {}
+request R -> int cached until D {}
+    )#");
+
+    assertCompileFails();
+}
+
+TEST_F(TestModule, should_error_if_cached_until_nothing) {
+    auto ast = parse(SourceFile{.path = "", .content = R"#(
+request R -> int cached until {}
+    )#"});
+
+    ASSERT_FALSE(ast.errors.empty());
+}
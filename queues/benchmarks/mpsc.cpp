@@ -1,10 +1,12 @@
 #include <benchmark/benchmark.h>
 
 #include "queues/mpsc.h"
+#include "queues/lock_free_mpsc.h"
 
 #include <thread>
 #include <atomic>
 #include <random>
+#include <vector>
 
 using namespace pt;
 
@@ -76,3 +78,40 @@ static void BM_MpscQueueNoThreads(benchmark::State& state) {
 }
 
 BENCHMARK(BM_MpscQueueNoThreads);
+
+
+// The same queue of producers feeding one consumer, with each queue and a varying number of
+// producers.
+template<template<typename> typename QueueT>
+static void BM_Producers(benchmark::State& state) {
+    const size_t num_producers = state.range(0);
+    constexpr size_t total = 1 << 18;
+    const size_t per_producer = total / num_producers;
+
+    for (auto _ : state) {
+        QueueT<size_t> q;
+
+        std::vector<std::thread> producers;
+        for (size_t p = 0; p < num_producers; p++) {
+            producers.emplace_back([&]{
+                for (size_t i = 0; i < per_producer; i++) {
+                    q.push(i);
+                }
+            });
+        }
+
+        size_t sum = 0;
+        for (size_t i = 0; i < per_producer * num_producers; i++) {
+            sum += q.pop();
+        }
+        benchmark::DoNotOptimize(sum);
+
+        for (auto& t: producers) {
+            t.join();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * per_producer * num_producers);
+}
+
+BENCHMARK_TEMPLATE(BM_Producers, MpscQueue)->RangeMultiplier(2)->Range(1, 16)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Producers, LockFreeMpscQueue)->RangeMultiplier(2)->Range(1, 16)->UseRealTime();
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+#include <bit>
+
+namespace pt {
+
+// Chase-Lev work stealing deque, using the memory orderings from "Correct and Efficient
+// Work-Stealing for Weak Memory Models" (Le et al. 2013).
+//
+// One thread (the owner) may push and pop at the bottom, any thread may steal from the top.
+template<typename T>
+class ChaseLevDeque {
+    static_assert(std::is_trivially_copyable_v<T>, "ChaseLevDeque elements are copied racily so must be trivially copyable");
+public:
+    // initial_capacity is rounded up to a power of 2
+    ChaseLevDeque(size_t initial_capacity = 64);
+
+    ChaseLevDeque(const ChaseLevDeque&) = delete;
+    ChaseLevDeque(ChaseLevDeque&&) = delete;
+
+    ChaseLevDeque& operator=(const ChaseLevDeque&) = delete;
+    ChaseLevDeque& operator=(ChaseLevDeque&&) = delete;
+
+    // owner only
+    void push(T t);
+
+    // owner only
+    std::optional<T> pop();
+
+    // any thread, returns nullopt if the deque is empty or another thread won the race for the
+    // top element.
+    std::optional<T> steal();
+
+    // any thread, only a hint when called from a thread other than the owner
+    bool empty() const;
+    size_t size() const;
+private:
+    struct Buffer {
+        Buffer(size_t capacity): capacity_mask(capacity - 1), data(new std::atomic<T>[capacity]) {}
+
+        T get(int64_t i) const {
+            return data[i & capacity_mask].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t i, T t) {
+            data[i & capacity_mask].store(t, std::memory_order_relaxed);
+        }
+
+        size_t capacity() const {
+            return capacity_mask + 1;
+        }
+
+        size_t capacity_mask;
+        std::unique_ptr<std::atomic<T>[]> data;
+    };
+
+    Buffer* grow(Buffer* old, int64_t bottom, int64_t top);
+
+    alignas(64) std::atomic<int64_t> top = 0;
+    alignas(64) std::atomic<int64_t> bottom = 0;
+    std::atomic<Buffer*> buffer;
+
+    // Thieves may still be reading from a buffer after it has been replaced, so old buffers are
+    // kept until the deque is destroyed. Only touched by the owner.
+    std::vector<std::unique_ptr<Buffer>> buffers;
+};
+
+
+template<typename T>
+ChaseLevDeque<T>::ChaseLevDeque(size_t initial_capacity) {
+    buffers.push_back(std::make_unique<Buffer>(std::bit_ceil(std::max<size_t>(initial_capacity, 2))));
+    buffer.store(buffers.back().get(), std::memory_order_relaxed);
+}
+
+template<typename T>
+void ChaseLevDeque<T>::push(T t) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t tp = top.load(std::memory_order_acquire);
+    Buffer* a = buffer.load(std::memory_order_relaxed);
+
+    if (b - tp > static_cast<int64_t>(a->capacity()) - 1) {
+        a = grow(a, b, tp);
+    }
+
+    a->put(b, t);
+    bottom.store(b + 1, std::memory_order_release);
+}
+
+template<typename T>
+std::optional<T> ChaseLevDeque<T>::pop() {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    Buffer* a = buffer.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t tp = top.load(std::memory_order_relaxed);
+
+    if (tp > b) {
+        // was already empty
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+
+    T ret = a->get(b);
+    if (tp == b) {
+        // last element, race the thieves for it
+        bool won = top.compare_exchange_strong(tp, tp + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        if (!won) {
+            return std::nullopt;
+        }
+    }
+    return ret;
+}
+
+template<typename T>
+std::optional<T> ChaseLevDeque<T>::steal() {
+    int64_t tp = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+
+    if (tp >= b) {
+        return std::nullopt;
+    }
+
+    Buffer* a = buffer.load(std::memory_order_acquire);
+    T ret = a->get(tp);
+    if (!top.compare_exchange_strong(tp, tp + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return std::nullopt;
+    }
+    return ret;
+}
+
+template<typename T>
+bool ChaseLevDeque<T>::empty() const {
+    return size() == 0;
+}
+
+template<typename T>
+size_t ChaseLevDeque<T>::size() const {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t tp = top.load(std::memory_order_relaxed);
+    return b > tp ? static_cast<size_t>(b - tp) : 0;
+}
+
+template<typename T>
+typename ChaseLevDeque<T>::Buffer* ChaseLevDeque<T>::grow(Buffer* old, int64_t b, int64_t tp) {
+    buffers.push_back(std::make_unique<Buffer>(old->capacity() * 2));
+    Buffer* a = buffers.back().get();
+    for (int64_t i = tp; i < b; i++) {
+        a->put(i, old->get(i));
+    }
+    buffer.store(a, std::memory_order_release);
+    return a;
+}
+
+}
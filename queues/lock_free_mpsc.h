@@ -0,0 +1,279 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace pt {
+
+// Unbounded multi producer single consumer queue, a linked list of nodes in the style of Dmitry
+// Vyukov's non intrusive MPSC queue. Pushing is one atomic exchange, popping is lock free.
+//
+// Has the same interface as MpscQueue. When the queue is empty the consumer spins for a while
+// before parking on a condition variable, producers only touch the mutex when the consumer is
+// parked.
+//
+// Copying, moving and reserve are not thread safe, nothing else may be using either queue.
+template<typename T>
+class LockFreeMpscQueue {
+public:
+    LockFreeMpscQueue();
+    ~LockFreeMpscQueue();
+
+    LockFreeMpscQueue(const LockFreeMpscQueue& o);
+    LockFreeMpscQueue(LockFreeMpscQueue&& o);
+
+    LockFreeMpscQueue& operator=(const LockFreeMpscQueue& o);
+    LockFreeMpscQueue& operator=(LockFreeMpscQueue&& o);
+
+    // any thread
+    void push(T t);
+
+    // any thread, links all of ts in with one exchange
+    void push_bulk(std::span<T> ts);
+
+    // consumer only
+    T pop();
+    std::optional<T> wait_until(std::chrono::steady_clock::time_point until);
+    bool empty() const;
+
+    // consumer only
+    template<typename OutputIt>
+    size_t try_pop_all(OutputIt out);
+
+    // consumer only
+    std::vector<T> pop_some(size_t max);
+
+    // nodes are allocated one at a time, there's nothing to reserve
+    void reserve(size_t) {}
+private:
+    struct Node {
+        Node() = default;
+
+        template<typename U>
+        Node(U&& u) {
+            new (storage) T(std::forward<U>(u));
+        }
+
+        T& value() {
+            return *std::launder(reinterpret_cast<T*>(storage));
+        }
+
+        std::atomic<Node*> next = nullptr;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    // how many times the consumer checks for an item before parking
+    static constexpr size_t spin_count = 128;
+
+    std::optional<T> try_pop();
+    void clear();
+    void wake();
+
+    // producers push at the head
+    alignas(64) std::atomic<Node*> head;
+
+    // The consumer pops from the tail. tail is a node whose value has already been popped (or
+    // never had one), the next item is in tail->next.
+    alignas(64) Node* tail;
+
+    alignas(64) std::atomic<bool> parked = false;
+    std::mutex m;
+    std::condition_variable cv;
+};
+
+
+template<typename T>
+LockFreeMpscQueue<T>::LockFreeMpscQueue() {
+    tail = new Node();
+    head.store(tail, std::memory_order_relaxed);
+}
+
+template<typename T>
+LockFreeMpscQueue<T>::~LockFreeMpscQueue() {
+    clear();
+    delete tail;
+}
+
+template<typename T>
+void LockFreeMpscQueue<T>::push(T t) {
+    Node* node = new Node(std::move(t));
+    Node* prev = head.exchange(node, std::memory_order_acq_rel);
+
+    // seq_cst, pairs with the consumer setting parked then checking for items
+    prev->next.store(node, std::memory_order_seq_cst);
+    if (parked.load(std::memory_order_seq_cst)) {
+        wake();
+    }
+}
+
+template<typename T>
+void LockFreeMpscQueue<T>::push_bulk(std::span<T> ts) {
+    if (ts.empty()) return;
+
+    // chain the nodes up first, then they're published in one go like a single node
+    Node* first = new Node(std::move(ts[0]));
+    Node* last = first;
+    for (size_t i = 1; i < ts.size(); i++) {
+        Node* node = new Node(std::move(ts[i]));
+        last->next.store(node, std::memory_order_relaxed);
+        last = node;
+    }
+
+    Node* prev = head.exchange(last, std::memory_order_acq_rel);
+    prev->next.store(first, std::memory_order_seq_cst);
+    if (parked.load(std::memory_order_seq_cst)) {
+        wake();
+    }
+}
+
+template<typename T>
+void LockFreeMpscQueue<T>::wake() {
+    {
+        std::lock_guard l(m);
+        parked.store(false, std::memory_order_relaxed);
+    }
+    cv.notify_one();
+}
+
+template<typename T>
+std::optional<T> LockFreeMpscQueue<T>::try_pop() {
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if (!next) {
+        return std::nullopt;
+    }
+
+    std::optional<T> ret(std::move(next->value()));
+    next->value().~T();
+    delete tail;
+    tail = next;
+    return ret;
+}
+
+template<typename T>
+T LockFreeMpscQueue<T>::pop() {
+    while (true) {
+        for (size_t i = 0; i < spin_count; i++) {
+            if (auto t = try_pop()) {
+                return std::move(*t);
+            }
+        }
+
+        std::unique_lock l(m);
+        parked.store(true, std::memory_order_seq_cst);
+        cv.wait(l, [&]{
+            return !parked.load(std::memory_order_relaxed) || tail->next.load(std::memory_order_seq_cst);
+        });
+        parked.store(false, std::memory_order_relaxed);
+    }
+}
+
+template<typename T>
+std::optional<T> LockFreeMpscQueue<T>::wait_until(std::chrono::steady_clock::time_point until) {
+    while (true) {
+        for (size_t i = 0; i < spin_count; i++) {
+            if (auto t = try_pop()) {
+                return t;
+            }
+        }
+
+        std::unique_lock l(m);
+        parked.store(true, std::memory_order_seq_cst);
+        bool woken = cv.wait_until(l, until, [&]{
+            return !parked.load(std::memory_order_relaxed) || tail->next.load(std::memory_order_seq_cst);
+        });
+        parked.store(false, std::memory_order_relaxed);
+
+        if (!woken) {
+            return try_pop();
+        }
+    }
+}
+
+template<typename T>
+template<typename OutputIt>
+size_t LockFreeMpscQueue<T>::try_pop_all(OutputIt out) {
+    size_t popped = 0;
+    while (auto t = try_pop()) {
+        *out++ = std::move(*t);
+        popped++;
+    }
+    return popped;
+}
+
+template<typename T>
+std::vector<T> LockFreeMpscQueue<T>::pop_some(size_t max) {
+    std::vector<T> ret;
+    if (max == 0) return ret;
+
+    ret.push_back(pop());
+    while (ret.size() < max) {
+        auto t = try_pop();
+        if (!t) break;
+        ret.push_back(std::move(*t));
+    }
+    return ret;
+}
+
+template<typename T>
+bool LockFreeMpscQueue<T>::empty() const {
+    // A producer between its exchange and linking the node counts as empty, the same as if it
+    // hadn't started pushing yet.
+    return tail->next.load(std::memory_order_acquire) == nullptr;
+}
+
+template<typename T>
+void LockFreeMpscQueue<T>::clear() {
+    while (try_pop()) {}
+}
+
+
+template<typename T>
+LockFreeMpscQueue<T>::LockFreeMpscQueue(const LockFreeMpscQueue& o): LockFreeMpscQueue() {
+    for (Node* n = o.tail->next.load(std::memory_order_relaxed); n; n = n->next.load(std::memory_order_relaxed)) {
+        push(static_cast<const T&>(n->value()));
+    }
+}
+
+template<typename T>
+LockFreeMpscQueue<T>::LockFreeMpscQueue(LockFreeMpscQueue&& o):
+    head(o.head.load(std::memory_order_relaxed)),
+    tail(o.tail)
+{
+    o.tail = new Node();
+    o.head.store(o.tail, std::memory_order_relaxed);
+}
+
+template<typename T>
+LockFreeMpscQueue<T>& LockFreeMpscQueue<T>::operator=(const LockFreeMpscQueue& o) {
+    if (this == &o) return *this;
+
+    clear();
+    for (Node* n = o.tail->next.load(std::memory_order_relaxed); n; n = n->next.load(std::memory_order_relaxed)) {
+        push(static_cast<const T&>(n->value()));
+    }
+    return *this;
+}
+
+template<typename T>
+LockFreeMpscQueue<T>& LockFreeMpscQueue<T>::operator=(LockFreeMpscQueue&& o) {
+    if (this == &o) return *this;
+
+    clear();
+    delete tail;
+
+    tail = o.tail;
+    head.store(o.head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+    o.tail = new Node();
+    o.head.store(o.tail, std::memory_order_relaxed);
+    return *this;
+}
+
+}
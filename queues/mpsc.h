@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
 #include <utility>
 #include <mutex>
 #include <cstdlib>
@@ -8,6 +9,7 @@
 #include <bit>
 #include <chrono>
 #include <optional>
+#include <span>
 
 namespace pt {
 
@@ -27,6 +29,18 @@ public:
     T pop();
     std::optional<T> wait_until(std::chrono::steady_clock::time_point until);
 
+    // The bulk versions take the lock once for all the elements.
+
+    // moves everything out of ts
+    void push_bulk(std::span<T> ts);
+
+    // pops everything queued without blocking, returns how many were popped
+    template<typename OutputIt>
+    size_t try_pop_all(OutputIt out);
+
+    // blocks until there's at least one element then pops up to max
+    std::vector<T> pop_some(size_t max);
+
     bool empty() const;
     void reserve(size_t new_capacity);
 private:
@@ -38,6 +52,9 @@ private:
     T& get(size_t i);
     const T& get(size_t i) const;
 
+    // lock must be held
+    T pop_front();
+
     T* buffer = nullptr;
     size_t front = 0;
     size_t size = 0;
@@ -96,9 +113,7 @@ void MpscQueue<T>::push(T t) {
 }
 
 template<typename T>
-T MpscQueue<T>::pop() {
-    std::unique_lock<std::mutex> l(m);
-    cv.wait(l, [this]{return size != 0;});
+T MpscQueue<T>::pop_front() {
     T ret = std::move(get(0));
     get(0).~T();
     front = (front + 1) & capacity_mask;
@@ -106,15 +121,62 @@ T MpscQueue<T>::pop() {
     return ret;
 }
 
+template<typename T>
+T MpscQueue<T>::pop() {
+    std::unique_lock<std::mutex> l(m);
+    cv.wait(l, [this]{return size != 0;});
+    return pop_front();
+}
+
+template<typename T>
+void MpscQueue<T>::push_bulk(std::span<T> ts) {
+    if (ts.empty()) return;
+    {
+        std::lock_guard<std::mutex> l(m);
+
+        if (size + ts.size() > capacity()) {
+            // at least 2, a capacity_mask of 0 reads as no capacity at all
+            reallocate(std::max<size_t>(2, std::bit_ceil(size + ts.size())));
+        }
+
+        for (T& t: ts) {
+            new (&buffer[(front + size) & capacity_mask]) T(std::move(t));
+            size++;
+        }
+    }
+    cv.notify_one();
+}
+
+template<typename T>
+template<typename OutputIt>
+size_t MpscQueue<T>::try_pop_all(OutputIt out) {
+    std::lock_guard<std::mutex> l(m);
+    size_t popped = size;
+    while (size != 0) {
+        *out++ = pop_front();
+    }
+    return popped;
+}
+
+template<typename T>
+std::vector<T> MpscQueue<T>::pop_some(size_t max) {
+    std::vector<T> ret;
+    if (max == 0) return ret;
+
+    std::unique_lock<std::mutex> l(m);
+    cv.wait(l, [this]{return size != 0;});
+    ret.reserve(std::min(max, size));
+    while (size != 0 && ret.size() < max) {
+        ret.push_back(pop_front());
+    }
+    return ret;
+}
+
 template<typename T>
 std::optional<T> MpscQueue<T>::wait_until(std::chrono::steady_clock::time_point until) {
     std::unique_lock<std::mutex> l(m);
     if (cv.wait_until(l, until, [this]{return size != 0;})) {
-        auto ret = std::optional<T>(std::move(get(0)));
-        get(0).~T();
-        front = (front + 1) & capacity_mask;
-        size--;
-        return ret;
+        return pop_front();
     }
     return std::nullopt;
 
@@ -128,6 +190,7 @@ size_t MpscQueue<T>::capacity() const {
 template<typename T>
 void MpscQueue<T>::reallocate(size_t new_capacity) {
     if (size == 0) {
+        std::free(buffer);
         buffer = (T*) std::malloc(new_capacity * sizeof(T));
         capacity_mask = new_capacity - 1;
         front = 0;
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <type_traits>
+
+namespace pt {
+
+// Bounded single producer single consumer ring buffer. Neither side ever waits, pushing to a full
+// ring fails and popping from an empty one returns nothing.
+template<typename T>
+class SpscRing {
+    static_assert(std::is_trivially_copyable_v<T>, "SpscRing elements are copied in and out with no locking so must be trivially copyable");
+public:
+    // capacity is rounded up to a power of 2
+    SpscRing(size_t capacity = 1024);
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing(SpscRing&&) = delete;
+
+    SpscRing& operator=(const SpscRing&) = delete;
+    SpscRing& operator=(SpscRing&&) = delete;
+
+    // producer only, returns false if the ring is full
+    bool push(const T& t);
+
+    // consumer only
+    std::optional<T> pop();
+
+    // consumer only, calls f with everything in the ring, returns how many there were
+    template<typename F>
+    size_t pop_all(F&& f);
+
+    // any thread, only a hint when called from a thread that isn't the producer or consumer
+    size_t size() const;
+    size_t capacity() const {return mask + 1;}
+private:
+    size_t mask;
+    std::unique_ptr<T[]> data;
+
+    alignas(64) std::atomic<size_t> head = 0;
+    // producer's copy of head, so it only loads head when the ring looks full
+    size_t cached_head = 0;
+
+    alignas(64) std::atomic<size_t> tail = 0;
+};
+
+
+template<typename T>
+SpscRing<T>::SpscRing(size_t capacity):
+    mask(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1),
+    data(new T[mask + 1]) {}
+
+template<typename T>
+bool SpscRing<T>::push(const T& t) {
+    size_t tl = tail.load(std::memory_order_relaxed);
+    if (tl - cached_head > mask) {
+        cached_head = head.load(std::memory_order_acquire);
+        if (tl - cached_head > mask) {
+            return false;
+        }
+    }
+    data[tl & mask] = t;
+    tail.store(tl + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+std::optional<T> SpscRing<T>::pop() {
+    size_t hd = head.load(std::memory_order_relaxed);
+    if (hd == tail.load(std::memory_order_acquire)) {
+        return std::nullopt;
+    }
+    T ret = data[hd & mask];
+    head.store(hd + 1, std::memory_order_release);
+    return ret;
+}
+
+template<typename T>
+template<typename F>
+size_t SpscRing<T>::pop_all(F&& f) {
+    size_t hd = head.load(std::memory_order_relaxed);
+    size_t tl = tail.load(std::memory_order_acquire);
+    for (size_t i = hd; i != tl; i++) {
+        f(data[i & mask]);
+    }
+    head.store(tl, std::memory_order_release);
+    return tl - hd;
+}
+
+template<typename T>
+size_t SpscRing<T>::size() const {
+    // head first, tail can only have moved on from there. Both may have moved on between the
+    // loads, so what's seen can be more than the ring holds.
+    size_t hd = head.load(std::memory_order_acquire);
+    size_t tl = tail.load(std::memory_order_acquire);
+    return std::min(tl - hd, capacity());
+}
+
+}
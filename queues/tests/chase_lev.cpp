@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include "queues/chase_lev.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace pt;
+
+TEST(ChaseLevDeque, empty_on_construction) {
+    ChaseLevDeque<int> q;
+    ASSERT_TRUE(q.empty());
+    ASSERT_FALSE(q.pop().has_value());
+    ASSERT_FALSE(q.steal().has_value());
+}
+
+TEST(ChaseLevDeque, pop_is_lifo) {
+    ChaseLevDeque<int> q;
+    q.push(1);
+    q.push(2);
+    ASSERT_EQ(q.pop(), 2);
+    ASSERT_EQ(q.pop(), 1);
+    ASSERT_TRUE(q.empty());
+}
+
+TEST(ChaseLevDeque, steal_is_fifo) {
+    ChaseLevDeque<int> q;
+    q.push(1);
+    q.push(2);
+    ASSERT_EQ(q.steal(), 1);
+    ASSERT_EQ(q.steal(), 2);
+    ASSERT_TRUE(q.empty());
+}
+
+TEST(ChaseLevDeque, grows_past_initial_capacity) {
+    ChaseLevDeque<size_t> q(2);
+    for (size_t i = 0; i < 1000; i++) {
+        q.push(i);
+    }
+    ASSERT_EQ(q.size(), 1000);
+    for (size_t i = 0; i < 1000; i++) {
+        ASSERT_EQ(q.steal(), i);
+    }
+}
+
+TEST(ChaseLevDeque, everything_pushed_is_taken_exactly_once_threaded) {
+    constexpr size_t iters = 200000;
+    ChaseLevDeque<size_t> q(4);
+
+    std::vector<std::atomic<int>> seen(iters);
+    std::atomic<bool> done = false;
+
+    auto thief = [&]{
+        while (!done || !q.empty()) {
+            if (auto x = q.steal()) {
+                seen[*x]++;
+            }
+        }
+    };
+
+    std::thread t1{thief};
+    std::thread t2{thief};
+    std::thread t3{thief};
+
+    for (size_t i = 0; i < iters; i++) {
+        q.push(i);
+        if (i % 3 == 0) {
+            if (auto x = q.pop()) {
+                seen[*x]++;
+            }
+        }
+    }
+    while (auto x = q.pop()) {
+        seen[*x]++;
+    }
+    done = true;
+
+    t1.join();
+    t2.join();
+    t3.join();
+
+    for (size_t i = 0; i < iters; i++) {
+        ASSERT_EQ(seen[i], 1) << i;
+    }
+}
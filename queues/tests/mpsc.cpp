@@ -1,45 +1,68 @@
 #include <gtest/gtest.h>
 #include "queues/mpsc.h"
+#include "queues/lock_free_mpsc.h"
 
 #include <atomic>
 #include <random>
 #include <thread>
+#include <vector>
 
 using namespace pt;
 
-TEST(MpscQueue, empty_on_construction) {
-    MpscQueue<int> q;
+// every test runs against both queues
+template<typename QueueT>
+class MpscQueueTest: public ::testing::Test {
+protected:
+    template<typename T>
+    using Queue = typename QueueT::template rebind<T>;
+};
+
+struct LockingQueue {
+    template<typename T>
+    using rebind = MpscQueue<T>;
+};
+
+struct LockFreeQueue {
+    template<typename T>
+    using rebind = LockFreeMpscQueue<T>;
+};
+
+using QueueTypes = ::testing::Types<LockingQueue, LockFreeQueue>;
+TYPED_TEST_SUITE(MpscQueueTest, QueueTypes);
+
+TYPED_TEST(MpscQueueTest, empty_on_construction) {
+    typename TestFixture::template Queue<int> q;
     ASSERT_TRUE(q.empty());
 }
 
-TEST(MpscQueue, not_empty_after_push) {
-    MpscQueue<int> q;
+TYPED_TEST(MpscQueueTest, not_empty_after_push) {
+    typename TestFixture::template Queue<int> q;
     q.push(1);
     ASSERT_FALSE(q.empty());
 }
 
-TEST(MpscQueue, push_twice_not_empty) {
-    MpscQueue<int> q;
+TYPED_TEST(MpscQueueTest, push_twice_not_empty) {
+    typename TestFixture::template Queue<int> q;
     q.push(1);
     q.push(3);
     ASSERT_FALSE(q.empty());
 }
 
-TEST(MpscQueue, push_and_pop_then_empty) {
-    MpscQueue<int> q;
+TYPED_TEST(MpscQueueTest, push_and_pop_then_empty) {
+    typename TestFixture::template Queue<int> q;
     q.push(1);
     q.pop();
     ASSERT_TRUE(q.empty());
 }
 
-TEST(MpscQueue, pop_gets_what_was_pushed) {
-    MpscQueue<int> q;
+TYPED_TEST(MpscQueueTest, pop_gets_what_was_pushed) {
+    typename TestFixture::template Queue<int> q;
     q.push(1);
     ASSERT_EQ(q.pop(), 1);
 }
 
-TEST(MpscQueue, pop_gets_what_was_pushed_in_order) {
-    MpscQueue<int> q;
+TYPED_TEST(MpscQueueTest, pop_gets_what_was_pushed_in_order) {
+    typename TestFixture::template Queue<int> q;
     q.push(1);
     q.push(2);
     ASSERT_EQ(q.pop(), 1);
@@ -56,39 +79,42 @@ struct D {
     std::atomic<size_t>* d;
 };
 
-class MpscQueueF: public ::testing::Test {
+template<typename QueueT>
+class MpscQueueF: public MpscQueueTest<QueueT> {
 protected:
-    D d() {return D(c_count, d_count);}
+    D d() {return D(this->c_count, this->d_count);}
     std::atomic<size_t> c_count = 0;
     std::atomic<size_t> d_count = 0;
 };
 
-TEST_F(MpscQueueF, destructor_gets_called_on_pop) {
-    MpscQueue<D> q;
-    q.push(D(c_count, d_count));
+TYPED_TEST_SUITE(MpscQueueF, QueueTypes);
+
+TYPED_TEST(MpscQueueF, destructor_gets_called_on_pop) {
+    typename TestFixture::template Queue<D> q;
+    q.push(D(this->c_count, this->d_count));
     q.pop();
-    ASSERT_EQ(c_count, d_count);
+    ASSERT_EQ(this->c_count, this->d_count);
 }
 
-TEST_F(MpscQueueF, destructor_gets_called_with_many_pushes_and_pops) {
-    MpscQueue<D> q;
+TYPED_TEST(MpscQueueF, destructor_gets_called_with_many_pushes_and_pops) {
+    typename TestFixture::template Queue<D> q;
     for (size_t i = 0; i < 10000; i++) {
-        q.push(D(c_count, d_count));
+        q.push(D(this->c_count, this->d_count));
     }
 
     for (size_t i = 0; i < 10000; i++) {
         q.pop();
     }
-    ASSERT_EQ(c_count, d_count);
+    ASSERT_EQ(this->c_count, this->d_count);
 }
 
-TEST_F(MpscQueueF, destructor_gets_called_with_many_pushes_and_pops_interleaved) {
+TYPED_TEST(MpscQueueF, destructor_gets_called_with_many_pushes_and_pops_interleaved) {
     std::default_random_engine gen(78);
     std::bernoulli_distribution dist(0.5);
-    MpscQueue<D> q;
+    typename TestFixture::template Queue<D> q;
     for (size_t i = 0; i < 100000; i++) {
         if (dist(gen)) {
-            q.push(D(c_count, d_count));
+            q.push(D(this->c_count, this->d_count));
         } else if (!q.empty()) {
             q.pop();
         }
@@ -98,15 +124,15 @@ TEST_F(MpscQueueF, destructor_gets_called_with_many_pushes_and_pops_interleaved)
         q.pop();
     }
 
-    ASSERT_EQ(c_count, d_count);
+    ASSERT_EQ(this->c_count, this->d_count);
 }
 
-TEST_F(MpscQueueF, destructor_gets_called_on_pop_threaded) {
-    MpscQueue<D> q;
+TYPED_TEST(MpscQueueF, destructor_gets_called_on_pop_threaded) {
+    typename TestFixture::template Queue<D> q;
 
     auto push = [&]{
         for (size_t i = 0; i < 100000; i++) {
-            q.push(D(c_count, d_count));
+            q.push(D(this->c_count, this->d_count));
         }
     };
 
@@ -127,20 +153,20 @@ TEST_F(MpscQueueF, destructor_gets_called_on_pop_threaded) {
     t_push3.join();
 
     keep_popping = false;
-    q.push(D(c_count, d_count));
+    q.push(D(this->c_count, this->d_count));
     t_pop.join();
 
     while (!q.empty()) {
         q.pop();
     }
 
-    ASSERT_EQ(c_count, d_count);
+    ASSERT_EQ(this->c_count, this->d_count);
 }
 
 
-TEST(MpscQueue, everything_enqueued_is_dequeued_threaded) {
+TYPED_TEST(MpscQueueTest, everything_enqueued_is_dequeued_threaded) {
     constexpr size_t iters = 100000;
-    MpscQueue<size_t> q;
+    typename TestFixture::template Queue<size_t> q;
     q.reserve(iters * 3);
 
     auto push = [&](size_t id){
@@ -184,12 +210,12 @@ TEST(MpscQueue, everything_enqueued_is_dequeued_threaded) {
     ASSERT_EQ(thread_counts[2], iters-1);
 }
 
-TEST(MpscQueue, copy_ctor) {
-    MpscQueue<int> q;
+TYPED_TEST(MpscQueueTest, copy_ctor) {
+    typename TestFixture::template Queue<int> q;
     q.push(1);
 
-    MpscQueue<int> q2(q);
-    MpscQueue<int> q3;
+    typename TestFixture::template Queue<int> q2(q);
+    typename TestFixture::template Queue<int> q3;
     q3 = q;
 
     ASSERT_EQ(q.pop(), 1);
@@ -198,22 +224,22 @@ TEST(MpscQueue, copy_ctor) {
 }
 
 
-TEST(MpscQueue, move_ctor) {
-    MpscQueue<int> q;
+TYPED_TEST(MpscQueueTest, move_ctor) {
+    typename TestFixture::template Queue<int> q;
     q.push(1);
 
-    MpscQueue<int> q2(std::move(q));
-    MpscQueue<int> q3;
+    typename TestFixture::template Queue<int> q2(std::move(q));
+    typename TestFixture::template Queue<int> q3;
     q3 = std::move(q2);
 
     ASSERT_EQ(q3.pop(), 1);
 }
 
-TEST(MpscQueue, push_onto_moved_into_queue) {
-    MpscQueue<int> q;
+TYPED_TEST(MpscQueueTest, push_onto_moved_into_queue) {
+    typename TestFixture::template Queue<int> q;
     q.push(1);
 
-    MpscQueue<int> q2 = std::move(q);
+    typename TestFixture::template Queue<int> q2 = std::move(q);
 
     for (size_t i = 0; i < 1000; i++) {
         q2.push(i);
@@ -225,85 +251,150 @@ TEST(MpscQueue, push_onto_moved_into_queue) {
     }
 }
 
-TEST_F(MpscQueueF, destructor_gets_called_move) {
-    MpscQueue<D> q;
+TYPED_TEST(MpscQueueF, destructor_gets_called_move) {
+    typename TestFixture::template Queue<D> q;
 
     for (size_t i = 0; i < 1000; i++) {
-        q.push(d());
+        q.push(this->d());
     }
     
     {
-        MpscQueue<D> q2(std::move(q));
+        typename TestFixture::template Queue<D> q2(std::move(q));
     }
 
-    ASSERT_EQ(c_count, d_count);
+    ASSERT_EQ(this->c_count, this->d_count);
 }
 
-TEST_F(MpscQueueF, destructor_gets_called_copy) {
+TYPED_TEST(MpscQueueF, destructor_gets_called_copy) {
     {
-        MpscQueue<D> q;
+        typename TestFixture::template Queue<D> q;
 
         for (size_t i = 0; i < 1000; i++) {
-            q.push(d());
+            q.push(this->d());
         }
     
-        MpscQueue<D> q2(q);
+        typename TestFixture::template Queue<D> q2(q);
     }
 
-    ASSERT_EQ(c_count, d_count);
+    ASSERT_EQ(this->c_count, this->d_count);
 }
 
-TEST_F(MpscQueueF, destructor_gets_called_move_assign) {
-    MpscQueue<D> q;
+TYPED_TEST(MpscQueueF, destructor_gets_called_move_assign) {
+    typename TestFixture::template Queue<D> q;
 
     for (size_t i = 0; i < 1000; i++) {
-        q.push(d());
+        q.push(this->d());
     }
     
     {
-        MpscQueue<D> q2;
+        typename TestFixture::template Queue<D> q2;
         q2 = std::move(q);
     }
 
-    ASSERT_EQ(c_count, d_count);
+    ASSERT_EQ(this->c_count, this->d_count);
 }
 
-TEST_F(MpscQueueF, destructor_gets_called_copy_assign) {
+TYPED_TEST(MpscQueueF, destructor_gets_called_copy_assign) {
     {
-        MpscQueue<D> q;
+        typename TestFixture::template Queue<D> q;
 
         for (size_t i = 0; i < 1000; i++) {
-            q.push(d());
+            q.push(this->d());
         }
     
-        MpscQueue<D> q2;
+        typename TestFixture::template Queue<D> q2;
         q2 = q;
     }
 
-    ASSERT_EQ(c_count, d_count);
+    ASSERT_EQ(this->c_count, this->d_count);
 }
 
 
-TEST_F(MpscQueueF, wait_returns_nullopt_on_empty_queue) {
-    MpscQueue<int> q;
+TYPED_TEST(MpscQueueTest, push_bulk_then_pop_in_order) {
+    typename TestFixture::template Queue<int> q;
+    q.push(0);
+    std::vector<int> v{1, 2, 3};
+    q.push_bulk(v);
+    q.push(4);
+
+    for (int i = 0; i < 5; i++) {
+        ASSERT_EQ(q.pop(), i);
+    }
+    ASSERT_TRUE(q.empty());
+}
+
+TYPED_TEST(MpscQueueTest, push_bulk_one_into_empty_then_push) {
+    typename TestFixture::template Queue<int> q;
+    std::vector<int> v{1};
+    q.push_bulk(v);
+    q.push(2);
+
+    ASSERT_EQ(q.pop(), 1);
+    ASSERT_EQ(q.pop(), 2);
+    ASSERT_TRUE(q.empty());
+}
+
+TYPED_TEST(MpscQueueTest, try_pop_all_takes_everything) {
+    typename TestFixture::template Queue<int> q;
+    std::vector<int> out;
+    ASSERT_EQ(q.try_pop_all(std::back_inserter(out)), 0);
+
+    for (int i = 0; i < 100; i++) {
+        q.push(i);
+    }
+    ASSERT_EQ(q.try_pop_all(std::back_inserter(out)), 100);
+    ASSERT_TRUE(q.empty());
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQ(out[i], i);
+    }
+}
+
+TYPED_TEST(MpscQueueTest, pop_some_takes_at_most_max) {
+    typename TestFixture::template Queue<int> q;
+    for (int i = 0; i < 10; i++) {
+        q.push(i);
+    }
+
+    ASSERT_EQ(q.pop_some(4), (std::vector<int>{0, 1, 2, 3}));
+    ASSERT_EQ(q.pop_some(100), (std::vector<int>{4, 5, 6, 7, 8, 9}));
+    ASSERT_TRUE(q.empty());
+}
+
+TYPED_TEST(MpscQueueF, destructor_gets_called_with_bulk_push_and_pop) {
+    {
+        typename TestFixture::template Queue<D> q;
+        std::vector<D> v(100, this->d());
+        q.push_bulk(v);
+        q.push_bulk(v);
+
+        std::vector<D> out;
+        q.try_pop_all(std::back_inserter(out));
+        q.push_bulk(v);
+        q.pop_some(10);
+    }
+    ASSERT_EQ(this->c_count, this->d_count);
+}
+
+TYPED_TEST(MpscQueueF, wait_returns_nullopt_on_empty_queue) {
+    typename TestFixture::template Queue<int> q;
     std::optional<int> r = q.wait_until(std::chrono::steady_clock::now());
     ASSERT_FALSE(r.has_value());
 }
 
-TEST_F(MpscQueueF, wait_returns_object_on_non_empty_queue) {
-    MpscQueue<int> q;
+TYPED_TEST(MpscQueueF, wait_returns_object_on_non_empty_queue) {
+    typename TestFixture::template Queue<int> q;
     q.push(2);
     std::optional<int> r = q.wait_until(std::chrono::steady_clock::now());
     ASSERT_TRUE(r.has_value());
     ASSERT_EQ(*r, 2);
 }
 
-TEST_F(MpscQueueF, wait_until_calls_destructor) {
+TYPED_TEST(MpscQueueF, wait_until_calls_destructor) {
     {
-        MpscQueue<D> q;
-        q.push(d());
+        typename TestFixture::template Queue<D> q;
+        q.push(this->d());
 
         std::optional<D> r = q.wait_until(std::chrono::steady_clock::now());
     }
-    ASSERT_EQ(c_count, d_count);
+    ASSERT_EQ(this->c_count, this->d_count);
 }
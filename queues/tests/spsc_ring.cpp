@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include "queues/spsc_ring.h"
+
+#include <thread>
+#include <vector>
+
+using namespace pt;
+
+TEST(SpscRing, empty_on_construction) {
+    SpscRing<int> q;
+    ASSERT_EQ(q.size(), 0);
+    ASSERT_FALSE(q.pop().has_value());
+}
+
+TEST(SpscRing, pop_is_fifo) {
+    SpscRing<int> q;
+    q.push(1);
+    q.push(2);
+    ASSERT_EQ(q.pop(), 1);
+    ASSERT_EQ(q.pop(), 2);
+    ASSERT_FALSE(q.pop().has_value());
+}
+
+TEST(SpscRing, push_fails_when_full) {
+    SpscRing<int> q(3);
+    ASSERT_EQ(q.capacity(), 4);
+    for (int i = 0; i < 4; i++) {
+        ASSERT_TRUE(q.push(i));
+    }
+    ASSERT_FALSE(q.push(4));
+
+    ASSERT_EQ(q.pop(), 0);
+    ASSERT_TRUE(q.push(4));
+
+    std::vector<int> rest;
+    ASSERT_EQ(q.pop_all([&](int x){rest.push_back(x);}), 4);
+    ASSERT_EQ(rest, (std::vector<int>{1, 2, 3, 4}));
+    ASSERT_EQ(q.size(), 0);
+}
+
+TEST(SpscRing, everything_pushed_is_popped_in_order_threaded) {
+    constexpr size_t iters = 200000;
+    SpscRing<size_t> q(16);
+
+    std::thread producer{[&]{
+        for (size_t i = 0; i < iters; i++) {
+            while (!q.push(i)) {
+                std::this_thread::yield();
+            }
+        }
+    }};
+
+    size_t expected = 0;
+    while (expected < iters) {
+        size_t popped = q.pop_all([&](size_t x){
+            ASSERT_EQ(x, expected);
+            expected++;
+        });
+        if (popped == 0) {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+}
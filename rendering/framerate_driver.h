@@ -3,9 +3,12 @@
 #include "core_messages/control.h"
 #include "framework/context.h"
 #include "thread_pool/sleep.h"
+#include "thread_pool/cancellation.h"
 #include "rendering/vulkan.h"
 #include "window/window.h"
 
+#include <stop_token>
+
 namespace pt {
 
 namespace framerate_driver::detail {
@@ -22,21 +25,17 @@ public:
     }
 
     EVENT(ProgramEnd) {
-        stop = true;
+        // also wakes the loop if it's waiting for the next frame
+        stop.request_stop();
         co_return;
     }
 
     EVENT(framerate_driver::detail::StartDriverLoop) {
-        while (!stop) {
-            auto next_frame = 
-                std::chrono::steady_clock::now() + 
-                std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1/target_fps));
-
-            if (!pause) {
-                co_await ctx.emit_await(NewFrame{});
-            }
-            co_await sleep_until(next_frame);
-        }        
+        auto loop = driver_loop(ctx);
+        loop.set_stop_token(stop.get_token());
+        try {
+            co_await std::move(loop);
+        } catch (const Cancelled&) {}
     }
 
     EVENT(WindowResize) {
@@ -59,7 +58,22 @@ public:
     }
 
 private:
-    bool stop = false;
+    template<IsContext C>
+    Task<> driver_loop(C& ctx) {
+        while (!stop.stop_requested()) {
+            auto next_frame = 
+                std::chrono::steady_clock::now() + 
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1/target_fps));
+
+            if (!pause) {
+                // everything the frame needs inherits this, so it goes ahead of background work
+                co_await ctx.emit_await(NewFrame{}, Priority::High);
+            }
+            co_await sleep_until(next_frame);
+        }
+    }
+
+    std::stop_source stop;
     bool pause = false;
     double target_fps;
 };
@@ -0,0 +1,390 @@
+#include "thread_pool/async_io.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <system_error>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace pt {
+using namespace async_io::detail;
+
+namespace {
+    // how much async_read and async_write ask for at once
+    constexpr size_t chunk_size = 1 << 20;
+
+    // the most a single read or write can return, the result has to fit in an int
+    constexpr size_t max_len = 1 << 30;
+
+    int io_uring_setup(unsigned entries, io_uring_params* p) {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+    }
+
+    int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+        return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+    }
+
+    unsigned* at(void* ring, unsigned offset) {
+        return reinterpret_cast<unsigned*>(static_cast<char*>(ring) + offset);
+    }
+
+    // user_data of the no-op that tells the reaper to stop
+    constexpr uint64_t stop_reaper = 0;
+
+    int errno_result(long ret) {
+        return ret < 0 ? -errno : static_cast<int>(ret);
+    }
+}
+
+void Op::prepare(io_uring_sqe& sqe) const {
+    std::memset(&sqe, 0, sizeof(sqe));
+    switch (code) {
+        case OpCode::Open: {
+            sqe.opcode = IORING_OP_OPENAT;
+            sqe.fd = AT_FDCWD;
+            sqe.addr = reinterpret_cast<uint64_t>(path);
+            sqe.len = mode;
+            sqe.open_flags = static_cast<uint32_t>(flags);
+            break;
+        }
+        case OpCode::Read: {
+            sqe.opcode = IORING_OP_READ;
+            sqe.fd = fd;
+            sqe.addr = reinterpret_cast<uint64_t>(buf);
+            sqe.len = static_cast<uint32_t>(len);
+            sqe.off = offset;
+            break;
+        }
+        case OpCode::Write: {
+            sqe.opcode = IORING_OP_WRITE;
+            sqe.fd = fd;
+            sqe.addr = reinterpret_cast<uint64_t>(buf);
+            sqe.len = static_cast<uint32_t>(len);
+            sqe.off = offset;
+            break;
+        }
+        case OpCode::Close: {
+            sqe.opcode = IORING_OP_CLOSE;
+            sqe.fd = fd;
+            break;
+        }
+    }
+    sqe.user_data = reinterpret_cast<uint64_t>(this);
+}
+
+void Op::run() noexcept {
+    int res = 0;
+    switch (code) {
+        case OpCode::Open: {
+            res = errno_result(::open(path, flags, mode));
+            break;
+        }
+        case OpCode::Read: {
+            res = errno_result(::pread(fd, buf, len, static_cast<off_t>(offset)));
+            break;
+        }
+        case OpCode::Write: {
+            res = errno_result(::pwrite(fd, buf, len, static_cast<off_t>(offset)));
+            break;
+        }
+        case OpCode::Close: {
+            res = errno_result(::close(fd));
+            break;
+        }
+    }
+    complete(res);
+}
+
+void Op::complete(int res) noexcept {
+    result = res;
+    pool->push(handle, priority);
+}
+
+IoService::IoService(bool use_io_uring, unsigned entries) {
+    if (use_io_uring && setup_ring(entries)) {
+        reaper = std::thread(&IoService::reap, this);
+    }
+}
+
+IoService::~IoService() {
+    if (ring_fd < 0) {
+        return;
+    }
+
+    {
+        std::lock_guard l(m);
+        assert(in_flight == 0);
+        in_flight++;
+        push_sqe(nullptr);
+    }
+    reaper.join();
+
+    munmap(sqes, sqes_size);
+    if (cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+    }
+    munmap(sq_ring, sq_ring_size);
+    ::close(ring_fd);
+}
+
+bool IoService::setup_ring(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int fd = io_uring_setup(entries, &params);
+    if (fd < 0) {
+        return false;
+    }
+
+    // needs 5.6 for open, read, write and close, check they're all there
+    size_t probe_size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    auto probe_storage = std::make_unique<unsigned char[]>(probe_size);
+    std::memset(probe_storage.get(), 0, probe_size);
+    auto* probe = reinterpret_cast<io_uring_probe*>(probe_storage.get());
+    bool supported = io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) >= 0;
+    for (int op: {IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE, IORING_OP_NOP}) {
+        supported = supported && op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+    }
+    // without NODROP completions can be lost if the completion queue overflows
+    supported = supported && (params.features & IORING_FEAT_NODROP);
+    if (!supported) {
+        ::close(fd);
+        return false;
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+
+    if (single_mmap) {
+        cq_ring = sq_ring;
+    } else {
+        cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            munmap(sq_ring, sq_ring_size);
+            ::close(fd);
+            return false;
+        }
+    }
+
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* s = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (s == MAP_FAILED) {
+        if (cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+        munmap(sq_ring, sq_ring_size);
+        ::close(fd);
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe*>(s);
+
+    sq_tail = at(sq_ring, params.sq_off.tail);
+    sq_mask = *at(sq_ring, params.sq_off.ring_mask);
+    sq_array = at(sq_ring, params.sq_off.array);
+    cq_head = at(cq_ring, params.cq_off.head);
+    cq_tail = at(cq_ring, params.cq_off.tail);
+    cq_mask = *at(cq_ring, params.cq_off.ring_mask);
+    cqes = static_cast<char*>(cq_ring) + params.cq_off.cqes;
+    cq_entries = params.cq_entries;
+
+    ring_fd = fd;
+    return true;
+}
+
+void IoService::submit(Op& op) {
+    if (ring_fd < 0) {
+        fallback.submit(op);
+        return;
+    }
+
+    std::unique_lock l(m);
+    // NODROP keeps completions that don't fit, but there's no point queueing up more than fit
+    has_room.wait(l, [&]{return in_flight < cq_entries;});
+    in_flight++;
+    push_sqe(&op);
+}
+
+void IoService::push_sqe(const Op* op) {
+    // Every sqe is submitted as soon as it's pushed, so the kernel has always consumed the
+    // submission queue by the time we get here and there's always room.
+    unsigned tail = *sq_tail;
+    unsigned index = tail & sq_mask;
+    if (op) {
+        op->prepare(sqes[index]);
+    } else {
+        std::memset(&sqes[index], 0, sizeof(io_uring_sqe));
+        sqes[index].opcode = IORING_OP_NOP;
+        sqes[index].user_data = stop_reaper;
+    }
+    sq_array[index] = index;
+    std::atomic_ref<unsigned>(*sq_tail).store(tail + 1, std::memory_order_release);
+
+    int ret;
+    do {
+        ret = io_uring_enter(ring_fd, 1, 0, 0);
+    } while (ret < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+    assert(ret == 1);
+}
+
+void IoService::reap() {
+    bool stopping = false;
+    while (!stopping) {
+        // EINTR just means there's nothing to reap yet
+        io_uring_enter(ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+
+        // Held while completing so that everything written to an op before it was submitted is
+        // seen here, and so the service can't be destroyed until in_flight has caught up with the
+        // ops that have been completed.
+        std::lock_guard l(m);
+        unsigned head = *cq_head;
+        unsigned tail = std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire);
+        if (head == tail) {
+            continue;
+        }
+
+        for (; head != tail; head++) {
+            auto& cqe = static_cast<io_uring_cqe*>(cqes)[head & cq_mask];
+            if (cqe.user_data == stop_reaper) {
+                stopping = true;
+            } else {
+                reinterpret_cast<Op*>(cqe.user_data)->complete(cqe.res);
+            }
+            in_flight--;
+        }
+        std::atomic_ref<unsigned>(*cq_head).store(head, std::memory_order_release);
+        has_room.notify_all();
+    }
+}
+
+IoService& default_io_service() {
+    static IoService service;
+    return service;
+}
+
+int awaitable::await_resume() const {
+    if (op.result < 0) {
+        throw std::system_error(-op.result, std::generic_category(), path.empty() ? "async io" : path);
+    }
+    return op.result;
+}
+
+awaitable async_open(const std::filesystem::path& path, int flags, mode_t mode, IoService& service) {
+    Op op;
+    op.code = OpCode::Open;
+    op.flags = flags | O_CLOEXEC;
+    op.mode = mode;
+    return awaitable(service, op, path.string());
+}
+
+awaitable async_pread(int fd, std::span<char> buf, uint64_t offset, IoService& service) {
+    Op op;
+    op.code = OpCode::Read;
+    op.fd = fd;
+    op.buf = buf.data();
+    op.len = std::min(buf.size(), max_len);
+    op.offset = offset;
+    return awaitable(service, op);
+}
+
+awaitable async_pwrite(int fd, std::span<const char> buf, uint64_t offset, IoService& service) {
+    Op op;
+    op.code = OpCode::Write;
+    op.fd = fd;
+    op.buf = const_cast<char*>(buf.data());
+    op.len = std::min(buf.size(), max_len);
+    op.offset = offset;
+    return awaitable(service, op);
+}
+
+awaitable async_close(int fd, IoService& service) {
+    Op op;
+    op.code = OpCode::Close;
+    op.fd = fd;
+    return awaitable(service, op);
+}
+
+Task<std::vector<char>> async_read(std::filesystem::path path, IoService& service) {
+    int fd = co_await async_open(path, O_RDONLY, 0, service);
+
+    std::vector<char> data;
+    std::exception_ptr error;
+    try {
+        // 0 if it isn't known
+        size_t expected = 0;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            expected = static_cast<size_t>(st.st_size);
+            data.reserve(expected + 1);
+        }
+
+        size_t size = 0;
+        while (true) {
+            // A file still the size it was stat'd at is read in one go, with a byte over so it's
+            // seen if it's grown, and then one more byte to find the end. Files of unknown size,
+            // or that have grown, are read a chunk at a time.
+            size_t want = chunk_size;
+            if (size < expected) {
+                want = expected - size + 1;
+            } else if (size == expected && expected != 0) {
+                want = 1;
+            }
+            data.resize(size + want);
+            int n = co_await async_pread(fd, std::span(data).subspan(size), size, service);
+            if (n == 0) {
+                break;
+            }
+            size += static_cast<size_t>(n);
+        }
+        data.resize(size);
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    co_await async_close(fd, service);
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    co_return data;
+}
+
+Task<> async_write(std::filesystem::path path, std::span<const char> data, IoService& service) {
+    int fd = co_await async_open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644, service);
+
+    std::exception_ptr error;
+    try {
+        size_t written = 0;
+        while (written < data.size()) {
+            auto chunk = data.subspan(written, std::min(data.size() - written, chunk_size));
+            written += static_cast<size_t>(co_await async_pwrite(fd, chunk, written, service));
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    co_await async_close(fd, service);
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+}
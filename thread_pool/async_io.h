@@ -0,0 +1,165 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "thread_pool/thread_pool.h"
+#include "thread_pool/blocking_pool.h"
+#include "thread_pool/promise.h"
+
+struct io_uring_sqe;
+
+namespace pt {
+
+namespace async_io::detail {
+    enum class OpCode {
+        Open,
+        Read,
+        Write,
+        Close,
+    };
+
+    // One call in flight. Whoever's waiting on it is resumed on its own pool once it's done, with
+    // result set to what the call returned, or -errno if it failed.
+    struct Op final: blocking_pool::detail::Job {
+        // for io_uring
+        void prepare(io_uring_sqe& sqe) const;
+        // for the fallback, makes the call here and now
+        void run() noexcept override;
+        void complete(int res) noexcept;
+
+        OpCode code;
+        int fd = -1;
+        const char* path = nullptr;
+        int flags = 0;
+        mode_t mode = 0;
+        void* buf = nullptr;
+        size_t len = 0;
+        uint64_t offset = 0;
+
+        int result = 0;
+        std::coroutine_handle<> handle;
+        CoroutineThreadPool* pool = nullptr;
+        Priority priority = Priority::Normal;
+    };
+}
+
+// Makes file I/O calls without blocking the thread that makes them. Calls are submitted to an
+// io_uring, and a thread of the service's own waits for them to complete and pushes whoever was
+// waiting back onto their pool. If io_uring isn't available (or isn't wanted) the calls are made
+// on a BlockingPool instead.
+class IoService {
+public:
+    IoService(bool use_io_uring = true, unsigned entries = 256);
+
+    // everything submitted has to have finished
+    ~IoService();
+
+    IoService(const IoService&) = delete;
+    IoService(IoService&&) = delete;
+
+    IoService& operator=(const IoService&) = delete;
+    IoService& operator=(IoService&&) = delete;
+
+    void submit(async_io::detail::Op& op);
+
+    bool using_io_uring() const {return ring_fd >= 0;}
+
+private:
+    bool setup_ring(unsigned entries);
+    void reap();
+    // m must be held
+    void push_sqe(const async_io::detail::Op* op);
+
+    int ring_fd = -1;
+
+    void* sq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    void* cq_ring = nullptr;
+    size_t cq_ring_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    void* cqes;
+    unsigned cq_entries;
+
+    // guards submission, completion and in_flight
+    std::mutex m;
+    std::condition_variable has_room;
+    size_t in_flight = 0;
+
+    std::thread reaper;
+    BlockingPool fallback;
+};
+
+// shared by everything that doesn't bring its own
+IoService& default_io_service();
+
+namespace async_io::detail {
+    // Awaits op on service, throwing std::system_error if it fails
+    class awaitable {
+    public:
+        using pool_aware = void;
+
+        awaitable(IoService& service, Op op, std::string path = {}): service(&service), op(op), path(std::move(path)) {}
+
+        bool await_ready() const noexcept {return false;}
+
+        template<typename U>
+        void await_suspend(std::coroutine_handle<U> h) {
+            op.handle = h;
+            op.pool = h.promise().pool;
+            op.priority = current_priority();
+            if (!path.empty()) {
+                // set here, the awaitable may have been moved since it was made
+                op.path = path.c_str();
+            }
+            service->submit(op);
+        }
+
+        int await_resume() const;
+
+    private:
+        IoService* service;
+        Op op;
+        std::string path;
+    };
+}
+
+// Opens path with open(2)'s flags, returning the file descriptor
+async_io::detail::awaitable async_open(const std::filesystem::path& path, int flags, mode_t mode = 0644, IoService& service = default_io_service());
+
+// Reads up to buf.size() bytes from offset, returning how many were read. Fewer than asked for
+// are read at the end of the file.
+async_io::detail::awaitable async_pread(int fd, std::span<char> buf, uint64_t offset, IoService& service = default_io_service());
+
+// Writes up to buf.size() bytes at offset, returning how many were written
+async_io::detail::awaitable async_pwrite(int fd, std::span<const char> buf, uint64_t offset, IoService& service = default_io_service());
+
+async_io::detail::awaitable async_close(int fd, IoService& service = default_io_service());
+
+// The whole file, read a chunk at a time so the awaiter's pool gets on with other things in
+// between.
+Task<std::vector<char>> async_read(std::filesystem::path path, IoService& service = default_io_service());
+
+// Replaces the file with data, creating it if it doesn't exist. data has to outlive the task.
+Task<> async_write(std::filesystem::path path, std::span<const char> data, IoService& service = default_io_service());
+
+}
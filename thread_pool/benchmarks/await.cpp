@@ -0,0 +1,43 @@
+#include <benchmark/benchmark.h>
+
+#include "thread_pool/thread_pool.h"
+#include "thread_pool/promise.h"
+
+using namespace pt;
+
+// knows nothing about pools and is always ready
+struct ready {
+    bool await_ready() {return true;}
+    void await_suspend(std::coroutine_handle<>) {}
+    int await_resume() {return 1;}
+};
+
+// knows nothing about pools and resumes the awaiter straight away
+struct resume_immediately {
+    bool await_ready() {return false;}
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) {return h;}
+    int await_resume() {return 1;}
+};
+
+template<typename AwaitableT>
+Task<int> await_in_loop(size_t n) {
+    int total = 0;
+    for (size_t i = 0; i < n; i++) {
+        total += co_await AwaitableT{};
+    }
+    co_return total;
+}
+
+template<typename AwaitableT>
+static void BM_AwaitForeign(benchmark::State& state) {
+    constexpr size_t n = 10000;
+    FixedCoroutineThreadPool<1> pool;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(run_awaitable_sync(pool, await_in_loop<AwaitableT>(n)));
+    }
+    pool.stop_and_join();
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+BENCHMARK_TEMPLATE(BM_AwaitForeign, ready)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_AwaitForeign, resume_immediately)->UseRealTime();
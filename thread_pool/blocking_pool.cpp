@@ -0,0 +1,99 @@
+#include "thread_pool/blocking_pool.h"
+
+#include <cassert>
+
+namespace pt {
+
+BlockingPool::BlockingPool(size_t max_threads, std::chrono::steady_clock::duration keep_alive):
+    max_threads(max_threads),
+    keep_alive(keep_alive)
+{
+    assert(max_threads > 0);
+}
+
+BlockingPool::~BlockingPool() {
+    std::vector<std::thread> to_join;
+    {
+        std::lock_guard l(m);
+        stopping = true;
+        cv.notify_all();
+
+        // the threads finish whatever's queued before they see stopping, a thread that stops
+        // itself in the meantime finds it's already been taken out of threads
+        for (auto& [id, thread]: threads) {
+            to_join.push_back(std::move(thread));
+        }
+        threads.clear();
+        join_exited();
+    }
+
+    for (auto& thread: to_join) {
+        thread.join();
+    }
+}
+
+void BlockingPool::submit(blocking_pool::detail::Job& job) {
+    std::lock_guard l(m);
+    assert(!stopping);
+    join_exited();
+
+    jobs.push_back(&job);
+    if (jobs.size() > idle && threads.size() < max_threads) {
+        size_t id = next_id++;
+        threads.emplace(id, std::thread(&BlockingPool::run, this, id));
+    } else {
+        cv.notify_one();
+    }
+}
+
+size_t BlockingPool::num_threads() const {
+    std::lock_guard l(m);
+    return threads.size();
+}
+
+void BlockingPool::run(size_t id) {
+    std::unique_lock l(m);
+    while (true) {
+        if (!jobs.empty()) {
+            auto* job = jobs.front();
+            jobs.pop_front();
+            l.unlock();
+            job->run();
+            l.lock();
+            continue;
+        }
+
+        if (stopping) {
+            return;
+        }
+
+        idle++;
+        bool woken = cv.wait_for(l, keep_alive, [&]{return !jobs.empty() || stopping;});
+        idle--;
+
+        if (!woken) {
+            // Idle for too long. Something else has to join us, we can't join ourselves. m is
+            // held until we return, so whoever does won't have long to wait.
+            auto it = threads.find(id);
+            if (it != threads.end()) {
+                exited.push_back(std::move(it->second));
+                threads.erase(it);
+            }
+            return;
+        }
+    }
+}
+
+void BlockingPool::join_exited() {
+    for (auto& thread: exited) {
+        thread.join();
+    }
+    exited.clear();
+}
+
+BlockingPool& default_blocking_pool() {
+    static BlockingPool pool;
+    return pool;
+}
+
+}
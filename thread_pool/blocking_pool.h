@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace pt {
+
+namespace blocking_pool::detail {
+    // something to run on a BlockingPool, owned by whatever submitted it
+    struct Job {
+        virtual void run() noexcept = 0;
+    protected:
+        ~Job() = default;
+    };
+}
+
+// Threads for calls that block, like waiting on the GPU or reading a file, so they don't hold up
+// the threads of a coroutine pool. Threads are started as they're needed, up to max_threads, and
+// stop again once they've been idle for keep_alive. Jobs are run in the order they're submitted.
+class BlockingPool {
+public:
+    BlockingPool(size_t max_threads = 64, std::chrono::steady_clock::duration keep_alive = std::chrono::seconds(10));
+
+    // waits for every job that's been submitted to finish
+    ~BlockingPool();
+
+    BlockingPool(const BlockingPool&) = delete;
+    BlockingPool(BlockingPool&&) = delete;
+
+    BlockingPool& operator=(const BlockingPool&) = delete;
+    BlockingPool& operator=(BlockingPool&&) = delete;
+
+    void submit(blocking_pool::detail::Job& job);
+
+    // the number of threads running right now
+    size_t num_threads() const;
+
+private:
+    void run(size_t id);
+    // m must be held
+    void join_exited();
+
+    const size_t max_threads;
+    const std::chrono::steady_clock::duration keep_alive;
+
+    mutable std::mutex m;
+    std::condition_variable cv;
+    std::deque<blocking_pool::detail::Job*> jobs;
+    // threads waiting for a job
+    size_t idle = 0;
+    bool stopping = false;
+
+    size_t next_id = 0;
+    std::unordered_map<size_t, std::thread> threads;
+    // threads that have stopped themselves but haven't been joined yet
+    std::vector<std::thread> exited;
+};
+
+// shared by everything that doesn't bring its own
+BlockingPool& default_blocking_pool();
+
+}
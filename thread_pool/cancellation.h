@@ -0,0 +1,59 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <stop_token>
+
+#include "thread_pool/promise.h"
+
+namespace pt {
+
+// Cancellation is cooperative. A Task can be given a std::stop_token with set_stop_token, and
+// everything it awaits inherits it. Things that wait (like sleep_until) give up early when it's
+// stopped by throwing Cancelled, anything else can check co_await get_stop_token{}.
+
+struct Cancelled: std::exception {
+    const char* what() const noexcept override {
+        return "cancelled";
+    }
+};
+
+// the stop token of the awaiting coroutine
+struct get_stop_token {
+    using pool_aware = void;
+
+    bool await_ready() const noexcept {return false;}
+
+    template<typename U>
+    bool await_suspend(std::coroutine_handle<U> h) noexcept {
+        token = h.promise().stop_token;
+        return false;
+    }
+
+    std::stop_token await_resume() noexcept {return std::move(token);}
+
+    std::stop_token token;
+};
+
+// throws Cancelled if the awaiting coroutine has been cancelled
+struct throw_if_cancelled {
+    using pool_aware = void;
+
+    bool await_ready() const noexcept {return false;}
+
+    template<typename U>
+    bool await_suspend(std::coroutine_handle<U> h) noexcept {
+        cancelled = h.promise().stop_token.stop_requested();
+        return false;
+    }
+
+    void await_resume() const {
+        if (cancelled) {
+            throw Cancelled{};
+        }
+    }
+
+    bool cancelled = false;
+};
+
+}
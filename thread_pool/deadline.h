@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <stop_token>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "thread_pool/promise.h"
+#include "thread_pool/cancellation.h"
+#include "thread_pool/sleep.h"
+#include "thread_pool/when_all.h"
+
+namespace pt {
+
+namespace deadline::detail {
+    // stops whatever's waiting on timer when task finishes, however it finishes
+    template<typename T>
+    Task<T> then_stop(Task<T> task, std::stop_source& timer) {
+        struct stop_on_exit {
+            ~stop_on_exit() {timer.request_stop();}
+            std::stop_source& timer;
+        } stop{timer};
+
+        co_return co_await std::move(task);
+    }
+
+    inline Task<> stop_at(std::chrono::steady_clock::time_point deadline, std::stop_source& source) {
+        try {
+            co_await sleep_until(deadline);
+        } catch (const Cancelled&) {
+            // finished in time
+            co_return;
+        }
+        source.request_stop();
+    }
+}
+
+// Awaits task, cancelling it if it's still going at deadline. Cancellation is cooperative, so if
+// task doesn't notice it's been cancelled this still waits for it to finish. Anything that would
+// cancel the awaiter cancels task too.
+template<typename T>
+Task<T> with_deadline(Task<T> task, std::chrono::steady_clock::time_point deadline) {
+    std::stop_source source;
+    std::stop_callback forward(co_await get_stop_token{}, [&]{source.request_stop();});
+    task.set_stop_token(source.get_token());
+
+    std::stop_source timer;
+    auto stop = deadline::detail::stop_at(deadline, source);
+    stop.set_stop_token(timer.get_token());
+
+    auto results = co_await when_all(deadline::detail::then_stop(std::move(task), timer), std::move(stop));
+    if constexpr (!std::is_void_v<T>) {
+        co_return std::get<0>(std::move(results));
+    }
+}
+
+template<typename T, typename Rep, typename Period>
+Task<T> with_timeout(Task<T> task, std::chrono::duration<Rep, Period> timeout) {
+    return with_deadline(std::move(task), std::chrono::steady_clock::now() + timeout);
+}
+
+// for stand ins for tasks, see StandsInForTask
+template<StandsInForTask A>
+auto with_deadline(A a, std::chrono::steady_clock::time_point deadline) {
+    return with_deadline(typename A::task_type(std::move(a)), deadline);
+}
+
+template<StandsInForTask A, typename Rep, typename Period>
+auto with_timeout(A a, std::chrono::duration<Rep, Period> timeout) {
+    return with_timeout(typename A::task_type(std::move(a)), timeout);
+}
+
+}
@@ -0,0 +1,178 @@
+#include "thread_pool/frame_allocator.h"
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <utility>
+
+namespace pt {
+
+namespace {
+    constexpr size_t granularity = 64;
+    constexpr size_t num_size_classes = 16;
+    constexpr size_t max_cached_size = granularity * num_size_classes;
+    // per size class, per thread
+    constexpr size_t max_cached_blocks = 256;
+
+    std::atomic<size_t> heap_allocations = 0;
+    std::atomic<size_t> heap_frees = 0;
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    // The blocks a thread has handed out. Other threads push the ones they free back here and
+    // the thread takes them when it runs out of its own. Never deleted, once its thread exits
+    // it's kept for the next thread that needs one, along with anything still being returned.
+    struct Owner {
+        std::atomic<FreeBlock*> returned[num_size_classes];
+        Owner* next_orphan;
+    };
+
+    std::mutex orphans_mutex;
+    Owner* orphans = nullptr;
+
+    Owner* adopt_owner() {
+        {
+            std::lock_guard lock{orphans_mutex};
+            if (Owner* o = orphans) {
+                orphans = o->next_orphan;
+                return o;
+            }
+        }
+        return new Owner{};
+    }
+
+    void orphan_owner(Owner* o) {
+        std::lock_guard lock{orphans_mutex};
+        o->next_orphan = orphans;
+        orphans = o;
+    }
+
+    // in front of every cached size block, set each time the block is handed out
+    struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) Header {
+        Owner* owner;
+    };
+
+    Header* header_of(void* p) {
+        return static_cast<Header*>(p) - 1;
+    }
+
+    // Trivially destructible so it's still usable while other thread locals are being destroyed,
+    // flushed by CacheGuard on thread exit.
+    struct Cache {
+        FreeBlock* free_lists[num_size_classes];
+        size_t lengths[num_size_classes];
+        // set by the first allocation, null again once flushed
+        Owner* owner;
+        bool flushed;
+    };
+
+    thread_local Cache cache{};
+
+    struct CacheGuard {
+        ~CacheGuard() {
+            for (size_t i = 0; i < num_size_classes; i++) {
+                while (cache.free_lists[i]) {
+                    FreeBlock* b = cache.free_lists[i];
+                    cache.free_lists[i] = b->next;
+                    ::operator delete(header_of(b));
+                    heap_frees.fetch_add(1, std::memory_order_relaxed);
+                }
+                cache.lengths[i] = 0;
+            }
+            if (cache.owner) {
+                orphan_owner(std::exchange(cache.owner, nullptr));
+            }
+            cache.flushed = true;
+        }
+
+        // odr-use so the guard is constructed on each thread that caches something
+        void touch() {}
+    };
+
+    thread_local CacheGuard cache_guard;
+
+    size_t size_class(size_t size) {
+        return (size - 1) / granularity;
+    }
+
+    // takes back everything other threads have freed of size class c, false if there's nothing
+    bool take_returned(size_t c) {
+        if (!cache.owner) {
+            return false;
+        }
+        FreeBlock* b = cache.owner->returned[c].exchange(nullptr, std::memory_order_acquire);
+        if (!b) {
+            return false;
+        }
+        cache.free_lists[c] = b;
+        for (; b; b = b->next) {
+            cache.lengths[c]++;
+        }
+        return true;
+    }
+}
+
+FrameAllocatorStats frame_allocator_stats() {
+    return {
+        .heap_allocations = heap_allocations.load(std::memory_order_relaxed),
+        .heap_frees = heap_frees.load(std::memory_order_relaxed),
+    };
+}
+
+namespace frame_allocator::detail {
+
+void* allocate(size_t size) {
+    if (size != 0 && size <= max_cached_size) {
+        if (!cache.owner && !cache.flushed) {
+            cache_guard.touch();
+            cache.owner = adopt_owner();
+        }
+
+        size_t c = size_class(size);
+        if (cache.free_lists[c] || take_returned(c)) {
+            FreeBlock* b = cache.free_lists[c];
+            cache.free_lists[c] = b->next;
+            cache.lengths[c]--;
+            header_of(b)->owner = cache.owner;
+            return b;
+        }
+        heap_allocations.fetch_add(1, std::memory_order_relaxed);
+        // always allocate the whole size class so the block can be reused by any frame in it
+        auto h = ::new(::operator new(sizeof(Header) + (c + 1) * granularity)) Header{cache.owner};
+        return h + 1;
+    }
+
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(size);
+}
+
+void deallocate(void* p, size_t size) noexcept {
+    if (size != 0 && size <= max_cached_size) {
+        size_t c = size_class(size);
+        Owner* owner = header_of(p)->owner;
+        if (owner && owner != cache.owner) {
+            // give it back to the thread that allocated it
+            auto b = ::new(p) FreeBlock{owner->returned[c].load(std::memory_order_relaxed)};
+            while (!owner->returned[c].compare_exchange_weak(b->next, b, std::memory_order_release, std::memory_order_relaxed)) {}
+            return;
+        }
+        if (!cache.flushed && cache.lengths[c] < max_cached_blocks) {
+            cache_guard.touch();
+            cache.free_lists[c] = ::new(p) FreeBlock{cache.free_lists[c]};
+            cache.lengths[c]++;
+            return;
+        }
+        heap_frees.fetch_add(1, std::memory_order_relaxed);
+        ::operator delete(header_of(p));
+        return;
+    }
+
+    heap_frees.fetch_add(1, std::memory_order_relaxed);
+    ::operator delete(p);
+}
+
+}
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+
+namespace pt {
+
+struct FrameAllocatorStats {
+    // frames that had to come from the global heap because no recycled block was cached
+    size_t heap_allocations;
+    // frames given back to the global heap because the cache was full or too big
+    size_t heap_frees;
+};
+
+// totals over all threads since the start of the program
+FrameAllocatorStats frame_allocator_stats();
+
+namespace frame_allocator::detail {
+    void* allocate(size_t size);
+    void deallocate(void* p, size_t size) noexcept;
+}
+
+// Base for coroutine promise types. Coroutine frames are allocated from a thread local cache of
+// recycled blocks, bucketed by size, so steady state code that keeps creating and destroying the
+// same coroutines doesn't touch the global heap.
+//
+// A frame can be destroyed on a different thread to the one that allocated it, the block is
+// handed back to the allocating thread, which takes it once it's run out of blocks of its own.
+// So a thread that only ever creates coroutines, for others to finish, still stops allocating.
+struct FrameAllocated {
+    static void* operator new(size_t size) {
+        return frame_allocator::detail::allocate(size);
+    }
+
+    static void operator delete(void* p, size_t size) noexcept {
+        frame_allocator::detail::deallocate(p, size);
+    }
+};
+
+}
@@ -31,6 +31,8 @@ class SingleThreadedMutex {
 public:
     class awaiter {
     public:
+        using pool_aware = void;
+
         bool await_ready();
 
         template<typename U>
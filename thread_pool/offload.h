@@ -0,0 +1,86 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "thread_pool/thread_pool.h"
+#include "thread_pool/blocking_pool.h"
+
+namespace pt {
+
+namespace blocking_pool::detail {
+    template<typename F>
+    class offload_awaitable final: Job {
+    public:
+        using ResultT = std::remove_cvref_t<std::invoke_result_t<F&>>;
+        using pool_aware = void;
+
+        offload_awaitable(BlockingPool& blocking, F f): blocking(&blocking), f(std::move(f)) {}
+
+        // only moved before it's awaited
+        offload_awaitable(offload_awaitable&& o): blocking(o.blocking), f(std::move(o.f)) {}
+
+        bool await_ready() const noexcept {return false;}
+
+        template<typename U>
+        void await_suspend(std::coroutine_handle<U> h) {
+            handle = h;
+            pool = h.promise().pool;
+            priority = current_priority();
+            blocking->submit(*this);
+        }
+
+        ResultT await_resume() {
+            if (result.index() == 2) {
+                std::rethrow_exception(std::get<2>(result));
+            }
+            if constexpr (!std::is_void_v<ResultT>) {
+                return std::move(std::get<1>(result));
+            }
+        }
+
+    private:
+        void run() noexcept override {
+            try {
+                if constexpr (std::is_void_v<ResultT>) {
+                    std::invoke(f);
+                    result.template emplace<1>();
+                } else {
+                    result.template emplace<1>(std::invoke(f));
+                }
+            } catch (...) {
+                result.template emplace<2>(std::current_exception());
+            }
+            pool->push(handle, priority);
+        }
+
+        BlockingPool* blocking;
+        F f;
+        std::variant<std::monostate, std::conditional_t<std::is_void_v<ResultT>, std::monostate, ResultT>, std::exception_ptr> result;
+        std::coroutine_handle<> handle;
+        CoroutineThreadPool* pool = nullptr;
+        Priority priority = Priority::Normal;
+    };
+}
+
+// Calls f on blocking and resumes the awaiter with its result, back on the awaiter's own pool at
+// its own priority. If f throws it's rethrown in the awaiter. Meanwhile the awaiter's pool is free
+// to get on with everything else.
+//
+//      auto code = co_await offload([&]{return read_file(path);});
+template<typename F>
+auto offload(BlockingPool& blocking, F&& f) {
+    return blocking_pool::detail::offload_awaitable<std::decay_t<F>>{blocking, std::forward<F>(f)};
+}
+
+// as above, on default_blocking_pool()
+template<typename F>
+auto offload(F&& f) {
+    return offload(default_blocking_pool(), std::forward<F>(f));
+}
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "thread_pool/thread_pool.h"
+#include "thread_pool/frame_allocator.h"
 #include <type_traits>
 #include <concepts>
 #include <optional>
@@ -10,6 +11,8 @@
 #include <coroutine>
 #include <functional>
 #include <iostream>
+#include <stop_token>
+#include <cstdint>
 
 namespace pt {
 
@@ -30,217 +33,257 @@ namespace promise::detail {
     using ResultT = std::remove_pointer_t<decltype(result_t_helper<AwaitableT>())>;
 
 
-    template<typename InnerT>
-    struct wrapper_task {
-        struct promise_type;
+    // Resumes target on pool. Awaitables that don't know about pools can resume whatever awaits
+    // them on any thread, so they're given one of these to resume instead of the awaiter itself.
+    //
+    // Owned by the awaiting coroutine's promise and reused for every await in it, so only the
+    // first await of such an awaitable allocates a frame.
+    struct trampoline {
+        enum State {
+            // not in use, or waiting to be resumed by the awaitable
+            Idle,
+            // the awaitable's await_suspend hasn't returned yet
+            Suspending,
+            // resumed before the awaitable's await_suspend returned, the awaiter resumes itself
+            ResumedEarly,
+        };
 
-        template<bool MoveOnResume>
-        struct awaitable {
-            bool await_ready() {return promise->continuation.load() != nullptr;}
-            bool await_suspend(std::coroutine_handle<> handle) {
-                void* expected = nullptr;
-                if (promise->continuation.compare_exchange_strong(expected, handle.address())) {
-                    return true;
-                } else {
-                    return false;
-                }
+        struct promise_type: FrameAllocated {
+            trampoline get_return_object() noexcept {
+                return trampoline{std::coroutine_handle<promise_type>::from_promise(*this)};
             }
 
-            InnerT await_resume() {
-                switch (promise->return_value_.index()) {
-                    case 1: {
-                        if constexpr (MoveOnResume) {
-                            return std::move(std::get<1>(promise->return_value_));
-                        } else {
-                            return std::get<1>(promise->return_value_);
-                        }
-                    }
-                    case 2: {
-                        std::rethrow_exception(std::get<2>(promise->return_value_));
-                    }
-                }
-                assert(false);
-            }
-            promise_type* promise;
+            std::suspend_always initial_suspend() const noexcept {return {};}
+            std::suspend_always final_suspend() const noexcept {return {};}
+            void return_void() {}
+            void unhandled_exception() {std::terminate();}
+
+            std::coroutine_handle<> target;
+            CoroutineThreadPool* pool;
+            Priority priority;
+            std::atomic<State> state = Idle;
         };
 
-        struct final_awaitable {
-            bool await_ready() const noexcept {
-                return false;
-            }
-            void await_suspend(std::coroutine_handle<>) noexcept {
-                if (promise->continuation.load() != promise) {
-                    promise->pool->push(std::coroutine_handle<>::from_address(promise->continuation.load()));
+        struct push_target {
+            bool await_ready() const noexcept {return false;}
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                // We're already suspended, so the target can be sent straight back to us once
+                // it's on the pool. Nothing touches the frame after the push.
+                auto& promise = h.promise();
+                State expected = Suspending;
+                if (!promise.state.compare_exchange_strong(expected, ResumedEarly)) {
+                    return promise.pool->schedule(promise.target, promise.priority);
                 }
+                return std::noop_coroutine();
             }
             void await_resume() const noexcept {}
-            promise_type* promise;
         };
 
-        struct promise_type {
+        trampoline() = default;
+        trampoline(std::coroutine_handle<promise_type> handle): handle(handle) {}
 
-            template<typename ThisT>
-            promise_type(ThisT this_, CoroutineThreadPool& pool): pool(&pool) {}
+        trampoline(const trampoline&) = delete;
+        trampoline& operator=(const trampoline&) = delete;
 
-            wrapper_task get_return_object() {
-                return {this};
-            }
+        trampoline(trampoline&& o): handle(std::exchange(o.handle, nullptr)) {}
+        trampoline& operator=(trampoline&& o) {
+            std::swap(handle, o.handle);
+            return *this;
+        }
 
-            std::suspend_never initial_suspend() noexcept {
-                return {};
-            }
-            final_awaitable final_suspend() noexcept {
-                return {this};
+        ~trampoline() {
+            if (handle) {
+                handle.destroy();
             }
+        }
 
-            template<std::convertible_to<InnerT> V>
-            void return_value(V&& v) {
-                return_value_.template emplace<1>(std::forward<V>(v));
-                void* expected = nullptr;
-                continuation.compare_exchange_strong(expected, this);
-            };
-
-            void unhandled_exception() {
-                return_value_.template emplace<2>(std::current_exception());
-                void* expected = nullptr;
-                continuation.compare_exchange_strong(expected, this);
+        // returns the handle to give to the awaitable in place of target
+        std::coroutine_handle<> prepare(std::coroutine_handle<> target, CoroutineThreadPool* pool) {
+            if (!handle) {
+                *this = run();
             }
-
-            std::variant<std::monostate, InnerT, std::exception_ptr> return_value_;
-            CoroutineThreadPool* pool;
-            std::atomic<void*> continuation = nullptr;
-        };
-
-        wrapper_task(promise_type* promise): promise(promise) {}
-        wrapper_task(const wrapper_task&) = delete;
-        wrapper_task(wrapper_task&& o) {
-            promise = o.promise;
-            o.promise = nullptr;
+            handle.promise().target = target;
+            handle.promise().pool = pool;
+            handle.promise().priority = current_priority();
+            handle.promise().state.store(Suspending, std::memory_order_relaxed);
+            return handle;
         }
 
-        wrapper_task& operator=(const wrapper_task&) = delete;
-        wrapper_task& operator=(wrapper_task&& o) {
-            std::swap(promise, o.promise);
-            return *this;
-        }
+        // Call once the awaitable's await_suspend has returned, with the coroutine it wants
+        // resumed next if any. Returns what target's await_suspend should return.
+        std::coroutine_handle<> suspended(std::coroutine_handle<> next = nullptr) {
+            auto& promise = handle.promise();
+            State expected = Suspending;
+            if (promise.state.compare_exchange_strong(expected, Idle)) {
+                return next ? next : std::noop_coroutine();
+            }
 
-        ~wrapper_task() {
-            if (promise) {
-                std::coroutine_handle<promise_type>::from_promise(*promise).destroy();
+            // resumed before we got here, we're still on the right thread so carry on with target
+            promise.state.store(Idle, std::memory_order_relaxed);
+            if (!next) {
+                return promise.target;
             }
+            promise.pool->push(promise.target, promise.priority);
+            return next;
         }
 
-        awaitable<false> operator co_await() & {
-            return {promise};
+        // the awaitable didn't suspend after all
+        void cancel() {
+            handle.promise().state.store(Idle, std::memory_order_relaxed);
         }
 
-        awaitable<true> operator co_await() && {
-            return {promise};
+        static trampoline run() {
+            while (true) {
+                co_await push_target{};
+            }
         }
 
-        promise_type* promise;
+        std::coroutine_handle<promise_type> handle;
     };
 
+    // Tasks started together by when_all or when_any. Each calls arrive as it finishes, and only
+    // resumes its awaiter if arrive returns true.
+    struct task_group {
+        virtual bool arrive(std::coroutine_handle<> task) noexcept = 0;
+    protected:
+        ~task_group() = default;
+    };
 
-    template<>
-    struct wrapper_task<void> {
-        struct promise_type;
-
-        template<bool MoveOnResume>
-        struct awaitable {
-            bool await_ready() {return promise->continuation.load() != nullptr;}
-            bool await_suspend(std::coroutine_handle<> handle) {
-                void* expected = nullptr;
-                if (promise->continuation.compare_exchange_strong(expected, handle.address())) {
-                    return true;
-                } else {
-                    return false;
-                }
-            }
+    // Set by Task::on_finish, called once with the task's result
+    struct finish_hook {
+        void (*f)(void* arg, void* result) = nullptr;
+        void* arg = nullptr;
 
-            void await_resume() {
-                if (promise->exception) {
-                    std::rethrow_exception(promise->exception);
-                }
+        void operator()(void* result) noexcept {
+            if (f) {
+                std::exchange(f, nullptr)(arg, result);
             }
-            promise_type* promise;
-        };
-
-        struct final_awaitable {
-            bool await_ready() const noexcept {
-                return false;
-            }
-            void await_suspend(std::coroutine_handle<>) noexcept {
-                if (promise->continuation.load() != promise) {
-                    promise->pool->push(std::coroutine_handle<>::from_address(promise->continuation.load()));
-                }
-            }
-            void await_resume() const noexcept {}
-            promise_type* promise;
-        };
-
-        struct promise_type {
-
-            template<typename ThisT>
-            promise_type(ThisT this_, CoroutineThreadPool& pool): pool(&pool) {}
+        }
+    };
 
-            wrapper_task get_return_object() {
-                return {this};
+    // A task awaited by a coroutine that can be cancelled can be cancelled the same way, unless
+    // it was given its own stop token.
+    template<typename PromiseT, typename AwaiterPromiseT>
+    void inherit_stop_token(PromiseT& promise, AwaiterPromiseT& awaiter) {
+        if constexpr (requires {awaiter.stop_token;}) {
+            if (!promise.stop_token.stop_possible() && awaiter.stop_token.stop_possible()) {
+                promise.stop_token = awaiter.stop_token;
             }
+        }
+    }
 
-            std::suspend_never initial_suspend() noexcept {
-                return {};
-            }
-            final_awaitable final_suspend() noexcept {
-                return {this};
+    // Like the stop token, a task's span is its awaiter's unless it was given its own
+    template<typename PromiseT, typename AwaiterPromiseT>
+    void inherit_span([[maybe_unused]] PromiseT& promise, [[maybe_unused]] AwaiterPromiseT& awaiter) {
+#ifdef PT_TRACING
+        if constexpr (requires {awaiter.span;}) {
+            promise.continuation_span = awaiter.span;
+            if (promise.span == 0) {
+                promise.span = awaiter.span;
             }
+        }
+#endif
+    }
 
-            void return_void() {
-                void* expected = nullptr;
-                continuation.compare_exchange_strong(expected, this);
-            }
+    // Sets a task up to resume awaiter once it finishes. Returns true if the task has to be pushed
+    // onto its pool at start_priority rather than resumed straight away, because it's bound to a
+    // different pool or has to run at a different priority.
+    template<typename PromiseT, typename U>
+    bool attach(PromiseT& promise, std::coroutine_handle<U> awaiter) {
+        CoroutineThreadPool* awaiter_pool = awaiter.promise().pool;
+        promise.continuation = awaiter;
+        inherit_stop_token(promise, awaiter.promise());
+        inherit_span(promise, awaiter.promise());
+
+        bool other_pool = promise.bound_pool && promise.bound_pool != awaiter_pool;
+        if (!other_pool) {
+            promise.pool = awaiter_pool;
+        }
+        if (other_pool || promise.start_priority() != current_priority()) {
+            promise.continuation_pool = awaiter_pool;
+            promise.continuation_priority = current_priority();
+            return true;
+        }
+        return false;
+    }
 
-            void unhandled_exception() {
-                exception = std::current_exception();
-                void* expected = nullptr;
-                continuation.compare_exchange_strong(expected, this);
-            }
+    // Every Task starts suspended, when it's started its span becomes the running one
+    template<typename PromiseT>
+    struct task_start {
+        constexpr bool await_ready() const noexcept {return false;}
+        constexpr void await_suspend(std::coroutine_handle<>) const noexcept {}
+        void await_resume() const noexcept {
+#ifdef PT_TRACING
+            thread_pool::detail::set_running_span(promise->span);
+#endif
+        }
 
-            std::exception_ptr exception = nullptr;
-            CoroutineThreadPool* pool;
-            std::atomic<void*> continuation = nullptr;
-        };
+        PromiseT* promise;
+    };
 
-        wrapper_task(promise_type* promise): promise(promise) {}
-        wrapper_task(const wrapper_task&) = delete;
-        wrapper_task(wrapper_task&& o) {
-            promise = o.promise;
-            o.promise = nullptr;
+    template<typename AwaitableT>
+    decltype(auto) get_awaiter(AwaitableT&& awaitable) {
+        if constexpr (requires {std::forward<AwaitableT>(awaitable).operator co_await();}) {
+            return std::forward<AwaitableT>(awaitable).operator co_await();
+        } else {
+            return std::forward<AwaitableT>(awaitable);
         }
+    }
 
-        wrapper_task& operator=(const wrapper_task&) = delete;
-        wrapper_task& operator=(wrapper_task&& o) {
-            std::swap(promise, o.promise);
-            return *this;
+    // Awaits AwaiterT in place, but has it resume a trampoline that puts the awaiting coroutine
+    // back on its pool.
+    template<typename AwaiterT>
+    struct resume_on_pool {
+        bool await_ready() {
+            return awaiter.await_ready();
         }
 
-        ~wrapper_task() {
-            if (promise) {
-                std::coroutine_handle<promise_type>::from_promise(*promise).destroy();
+        template<typename U>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<U> h) {
+#ifdef PT_TRACING
+            span = &h.promise().span;
+#endif
+            auto& t = h.promise().trampoline;
+            auto resume = t.prepare(h, h.promise().pool);
+
+            using ResultT = decltype(awaiter.await_suspend(resume));
+            if constexpr (std::is_void_v<ResultT>) {
+                awaiter.await_suspend(resume);
+                return t.suspended();
+            } else if constexpr (std::is_same_v<ResultT, bool>) {
+                if (!awaiter.await_suspend(resume)) {
+                    t.cancel();
+                    return h;
+                }
+                return t.suspended();
+            } else {
+                std::coroutine_handle<> next = awaiter.await_suspend(resume);
+                if (next == resume) {
+                    t.cancel();
+                    return h;
+                }
+                return t.suspended(next);
             }
         }
 
-        awaitable<false> operator co_await() & {
-            return {promise};
-        }
-
-        awaitable<true> operator co_await() && {
-            return {promise};
+        decltype(auto) await_resume() {
+#ifdef PT_TRACING
+            if (span) {
+                // resumed by the pool, which doesn't know whose span this is
+                thread_pool::detail::set_running_span(*span);
+            }
+#endif
+            return awaiter.await_resume();
         }
 
-        promise_type* promise;
+        AwaiterT awaiter;
+#ifdef PT_TRACING
+        // set once suspended
+        const uint64_t* span = nullptr;
+#endif
     };
 
+
     template<typename T, bool OwnHandle>
     struct run_sync {
         struct promise_type;
@@ -252,10 +295,12 @@ namespace promise::detail {
 
             auto await_suspend(std::coroutine_handle<>) noexcept {
                 {
+                    // notify under the lock, as soon as the waiter sees finished it may destroy
+                    // this frame (and the cv with it)
                     std::lock_guard l(promise->m);
                     promise->finished = true;
+                    promise->cv.notify_all();
                 }
-                promise->cv.notify_all();
                 if constexpr (!OwnHandle) {
                     return false;
                 }
@@ -282,7 +327,7 @@ namespace promise::detail {
             promise_type* promise;
         };
 
-        struct promise_type {
+        struct promise_type: FrameAllocated {
 
             template<typename ThisT, typename AwaitableT>
             promise_type(ThisT this_, CoroutineThreadPool& pool, AwaitableT&): pool(&pool) {}
@@ -379,10 +424,12 @@ namespace promise::detail {
 
             auto await_suspend(std::coroutine_handle<>) noexcept {
                 {
+                    // notify under the lock, as soon as the waiter sees finished it may destroy
+                    // this frame (and the cv with it)
                     std::lock_guard l(promise->m);
                     promise->finished = true;
+                    promise->cv.notify_all();
                 }
-                promise->cv.notify_all();
                 if constexpr (!OwnHandle) {
                     return false;
                 }
@@ -409,7 +456,7 @@ namespace promise::detail {
             promise_type* promise;
         };
 
-        struct promise_type {
+        struct promise_type: FrameAllocated {
 
             template<typename ThisT, typename AwaitableT>
             promise_type(ThisT this_, CoroutineThreadPool& pool, AwaitableT&): pool(&pool) {}
@@ -493,6 +540,20 @@ struct AwaitTransformPassThrough {
     static constexpr bool pass_through = false;
 };
 
+namespace promise::detail {
+    // An awaiter that gets the awaiter's pool through the promise and resumes it there says so
+    // with `using pool_aware = void;`. Anything else may resume it on some other thread.
+    template<typename AwaiterT>
+    concept PoolAware = requires {
+        typename std::remove_cvref_t<AwaiterT>::pool_aware;
+    };
+
+    // Whether a Task can await AwaitableT as is, rather than through resume_on_pool
+    template<typename AwaitableT>
+    concept AwaitsInline = AwaitTransformPassThrough<std::decay_t<AwaitableT>>::pass_through
+        || PoolAware<decltype(get_awaiter(std::declval<AwaitableT>()))>;
+}
+
 template<typename T=void>
 class Task {
 public:
@@ -504,6 +565,18 @@ public:
         }
 
         std::coroutine_handle<> await_suspend(std::coroutine_handle<>) noexcept {
+            promise->finish(promise->return_value_.index() == 1 ? &std::get<1>(promise->return_value_) : nullptr);
+            if (promise->group && !promise->group->arrive(std::coroutine_handle<promise_type>::from_promise(*promise))) {
+                // someone else resumes the awaiter, this frame may already be gone
+                return std::noop_coroutine();
+            }
+#ifdef PT_TRACING
+            thread_pool::detail::set_running_span(promise->continuation_span);
+#endif
+            if (promise->continuation_pool) {
+                // the awaiter runs on a different executor, hop back onto it
+                return promise->continuation_pool->schedule(promise->continuation, promise->continuation_priority);
+            }
             return promise->continuation;
         }
 
@@ -511,13 +584,13 @@ public:
         promise_type* promise;
     };
 
-    struct promise_type {
+    struct promise_type: FrameAllocated {
         constexpr Task get_return_object() noexcept {
             return Task{this};
         }
 
-        constexpr std::suspend_always initial_suspend() const noexcept {
-            return {};
+        constexpr promise::detail::task_start<promise_type> initial_suspend() noexcept {
+            return {this};
         }
         constexpr final_awaitable final_suspend() noexcept {
             return {this};
@@ -532,22 +605,43 @@ public:
             return_value_.template emplace<2>(std::current_exception());
         }
 
-        template<typename AwaitableT, typename = std::enable_if_t<AwaitTransformPassThrough<std::decay_t<AwaitableT>>::pass_through>>
+        template<typename AwaitableT>
         decltype(auto) await_transform(AwaitableT&& awaitable) {
-            return std::forward<AwaitableT>(awaitable);
-        }
-
-        template<typename AwaitableT, typename = std::enable_if_t<!AwaitTransformPassThrough<std::decay_t<AwaitableT>>::pass_through>>
-        auto await_transform(AwaitableT&& awaitable) {
-            using InnerT = promise::detail::ResultT<std::decay_t<AwaitableT>>;
-
-            return [&awaitable](CoroutineThreadPool& pool) mutable -> promise::detail::wrapper_task<InnerT> {
-                co_return co_await std::forward<AwaitableT>(awaitable);
-            }(*pool);
+            if constexpr (promise::detail::AwaitsInline<AwaitableT>) {
+                return std::forward<AwaitableT>(awaitable);
+            } else {
+                using AwaiterT = decltype(promise::detail::get_awaiter(std::forward<AwaitableT>(awaitable)));
+                return promise::detail::resume_on_pool<AwaiterT>{promise::detail::get_awaiter(std::forward<AwaitableT>(awaitable))};
+            }
         }
 
         std::coroutine_handle<> continuation;
         CoroutineThreadPool* pool;
+        promise::detail::trampoline trampoline;
+        // set by bind, the task runs here rather than on whatever pool its awaiter is on
+        CoroutineThreadPool* bound_pool = nullptr;
+        // set when the continuation has to be pushed rather than resumed directly
+        CoroutineThreadPool* continuation_pool = nullptr;
+        // set when started by when_all or when_any
+        promise::detail::task_group* group = nullptr;
+        // inherited from the awaiter unless the task was given its own
+        std::stop_token stop_token;
+#ifdef PT_TRACING
+        // inherited from the awaiter unless the task was given its own, see span.h
+        uint64_t span = 0;
+        // the awaiter's, running again once the continuation is resumed
+        uint64_t continuation_span = 0;
+#endif
+        // set by set_priority, otherwise the task runs at its awaiter's priority
+        std::optional<Priority> priority;
+        // what the continuation is pushed at when continuation_pool is set
+        Priority continuation_priority = Priority::Normal;
+        // set by on_finish
+        promise::detail::finish_hook finish;
+
+        Priority start_priority() const {
+            return priority.value_or(current_priority());
+        }
         std::variant<std::monostate, T, std::exception_ptr> return_value_;
     };
 
@@ -559,12 +653,18 @@ public:
 
         template<typename U>
         std::coroutine_handle<> await_suspend(std::coroutine_handle<U> handle) noexcept {
-            promise->pool = handle.promise().pool;
-            promise->continuation = handle;
-            return std::coroutine_handle<promise_type>::from_promise(*promise);
+            auto h = std::coroutine_handle<promise_type>::from_promise(*promise);
+            if (promise::detail::attach(*promise, handle)) {
+                return promise->pool->schedule(h, promise->start_priority());
+            }
+            return h;
         }
 
         T await_resume() {
+#ifdef PT_TRACING
+            // the awaiter may have been pushed back onto its pool rather than resumed in place
+            thread_pool::detail::set_running_span(promise->continuation_span);
+#endif
             switch (promise->return_value_.index()) {
                 case 1: {
                     if constexpr (MoveOnResume) {
@@ -596,6 +696,40 @@ public:
 
     Task(promise_type* promise): promise(promise) {}
 
+    // Makes the task run on pool (e.g. a Strand) when it's awaited, instead of on the awaiter's
+    // pool. The awaiter is resumed back on its own pool once the task finishes.
+    void bind(CoroutineThreadPool& pool) {
+        promise->bound_pool = &pool;
+        promise->pool = &pool;
+    }
+
+    // Cancellation for this task and everything it awaits, instead of its awaiter's.
+    void set_stop_token(std::stop_token token) {
+        promise->stop_token = std::move(token);
+    }
+
+    // Priority for this task and everything it starts, instead of its awaiter's. The awaiter
+    // carries on at its own priority once the task finishes.
+    void set_priority(Priority priority) {
+        promise->priority = priority;
+    }
+
+    // Span for this task and everything it awaits, instead of its awaiter's. Does nothing
+    // unless built with PT_TRACING.
+    void set_span([[maybe_unused]] uint64_t span) {
+#ifdef PT_TRACING
+        promise->span = span;
+#endif
+    }
+
+    // Has f(arg, result) called once the task finishes, before its awaiter is resumed. result
+    // points at what the task returned, or is null if it threw. If the task is destroyed without
+    // finishing f is called then with a null result. A task only has one.
+    void on_finish(void (*f)(void* arg, void* result), void* arg) {
+        assert(!promise->finish.f);
+        promise->finish = {f, arg};
+    }
+
     Task(const Task&) = delete;
     Task& operator=(const Task&) = delete;
 
@@ -611,6 +745,7 @@ public:
 
     ~Task() {
         if (promise) {
+            promise->finish(nullptr);
             std::coroutine_handle<promise_type>::from_promise(*promise).destroy();
         }
     }
@@ -630,6 +765,18 @@ public:
         }
 
         std::coroutine_handle<> await_suspend(std::coroutine_handle<>) noexcept {
+            promise->finish(nullptr);
+            if (promise->group && !promise->group->arrive(std::coroutine_handle<promise_type>::from_promise(*promise))) {
+                // someone else resumes the awaiter, this frame may already be gone
+                return std::noop_coroutine();
+            }
+#ifdef PT_TRACING
+            thread_pool::detail::set_running_span(promise->continuation_span);
+#endif
+            if (promise->continuation_pool) {
+                // the awaiter runs on a different executor, hop back onto it
+                return promise->continuation_pool->schedule(promise->continuation, promise->continuation_priority);
+            }
             return promise->continuation;
         }
 
@@ -637,13 +784,13 @@ public:
         promise_type* promise;
     };
 
-    struct promise_type {
+    struct promise_type: FrameAllocated {
         Task get_return_object() noexcept {
             return Task{this};
         }
 
-        constexpr std::suspend_always initial_suspend() const noexcept {
-            return {};
+        constexpr promise::detail::task_start<promise_type> initial_suspend() noexcept {
+            return {this};
         }
         constexpr final_awaitable final_suspend() noexcept {
             return {this};
@@ -655,24 +802,44 @@ public:
             exception = std::current_exception();
         }
 
-        template<typename AwaitableT, typename = std::enable_if_t<AwaitTransformPassThrough<std::decay_t<AwaitableT>>::pass_through>>
+        template<typename AwaitableT>
         decltype(auto) await_transform(AwaitableT&& awaitable) {
-            return std::forward<AwaitableT>(awaitable);
-        }
-
-        template<typename AwaitableT, typename = std::enable_if_t<!AwaitTransformPassThrough<std::decay_t<AwaitableT>>::pass_through>>
-        auto await_transform(AwaitableT&& awaitable) {
-            using InnerT = promise::detail::ResultT<std::decay_t<AwaitableT>>;
-
-            return [&awaitable](CoroutineThreadPool& pool) mutable -> promise::detail::wrapper_task<InnerT> {
-                co_return co_await std::forward<AwaitableT>(awaitable);
-            }(*pool);
+            if constexpr (promise::detail::AwaitsInline<AwaitableT>) {
+                return std::forward<AwaitableT>(awaitable);
+            } else {
+                using AwaiterT = decltype(promise::detail::get_awaiter(std::forward<AwaitableT>(awaitable)));
+                return promise::detail::resume_on_pool<AwaiterT>{promise::detail::get_awaiter(std::forward<AwaitableT>(awaitable))};
+            }
         }
 
         std::coroutine_handle<> continuation;
         CoroutineThreadPool* pool;
+        promise::detail::trampoline trampoline;
+        // set by bind, the task runs here rather than on whatever pool its awaiter is on
+        CoroutineThreadPool* bound_pool = nullptr;
+        // set when the continuation has to be pushed rather than resumed directly
+        CoroutineThreadPool* continuation_pool = nullptr;
+        // set when started by when_all or when_any
+        promise::detail::task_group* group = nullptr;
+        // inherited from the awaiter unless the task was given its own
+        std::stop_token stop_token;
+#ifdef PT_TRACING
+        // inherited from the awaiter unless the task was given its own, see span.h
+        uint64_t span = 0;
+        // the awaiter's, running again once the continuation is resumed
+        uint64_t continuation_span = 0;
+#endif
+        // set by set_priority, otherwise the task runs at its awaiter's priority
+        std::optional<Priority> priority;
+        // what the continuation is pushed at when continuation_pool is set
+        Priority continuation_priority = Priority::Normal;
+        // set by on_finish
+        promise::detail::finish_hook finish;
+
+        Priority start_priority() const {
+            return priority.value_or(current_priority());
+        }
         std::exception_ptr exception = nullptr;
-
     };
 
     struct awaitable {
@@ -682,12 +849,18 @@ public:
 
         template<typename U>
         std::coroutine_handle<> await_suspend(std::coroutine_handle<U> handle) noexcept {
-            promise->pool = handle.promise().pool;
-            promise->continuation = handle;
-            return std::coroutine_handle<promise_type>::from_promise(*promise);
+            auto h = std::coroutine_handle<promise_type>::from_promise(*promise);
+            if (promise::detail::attach(*promise, handle)) {
+                return promise->pool->schedule(h, promise->start_priority());
+            }
+            return h;
         }
 
         void await_resume() {
+#ifdef PT_TRACING
+            // the awaiter may have been pushed back onto its pool rather than resumed in place
+            thread_pool::detail::set_running_span(promise->continuation_span);
+#endif
             if (promise->exception != nullptr) {
                 std::rethrow_exception(promise->exception);
             }
@@ -702,6 +875,40 @@ public:
 
     Task(promise_type* promise): promise(promise) {}
 
+    // Makes the task run on pool (e.g. a Strand) when it's awaited, instead of on the awaiter's
+    // pool. The awaiter is resumed back on its own pool once the task finishes.
+    void bind(CoroutineThreadPool& pool) {
+        promise->bound_pool = &pool;
+        promise->pool = &pool;
+    }
+
+    // Cancellation for this task and everything it awaits, instead of its awaiter's.
+    void set_stop_token(std::stop_token token) {
+        promise->stop_token = std::move(token);
+    }
+
+    // Priority for this task and everything it starts, instead of its awaiter's. The awaiter
+    // carries on at its own priority once the task finishes.
+    void set_priority(Priority priority) {
+        promise->priority = priority;
+    }
+
+    // Span for this task and everything it awaits, instead of its awaiter's. Does nothing
+    // unless built with PT_TRACING.
+    void set_span([[maybe_unused]] uint64_t span) {
+#ifdef PT_TRACING
+        promise->span = span;
+#endif
+    }
+
+    // Has f(arg, result) called once the task finishes, before its awaiter is resumed. result
+    // is always null for a Task<void>. If the task is destroyed without finishing f is called
+    // then. A task only has one.
+    void on_finish(void (*f)(void* arg, void* result), void* arg) {
+        assert(!promise->finish.f);
+        promise->finish = {f, arg};
+    }
+
     Task(const Task&) = delete;
     Task& operator=(const Task&) = delete;
 
@@ -717,6 +924,7 @@ public:
 
     ~Task() {
         if (promise) {
+            promise->finish(nullptr);
             std::coroutine_handle<promise_type>::from_promise(*promise).destroy();
         }
     }
@@ -730,18 +938,48 @@ struct AwaitTransformPassThrough<Task<T>> {
     static constexpr bool pass_through = true;
 };
 
+// Something awaited in place of a Task, e.g. a response that may already be known, which says
+// what it stands for with `using task_type = Task<T>;` and converts to it. Things that take
+// Tasks, like when_all, take these too.
+template<typename A>
+concept StandsInForTask = requires {
+    typename std::remove_cvref_t<A>::task_type;
+} && std::convertible_to<A, typename std::remove_cvref_t<A>::task_type>;
+
+namespace promise::detail {
+    template<typename A>
+    struct task_of {
+        using type = typename A::task_type;
+    };
+
+    template<typename T>
+    struct task_of<Task<T>> {
+        using type = Task<T>;
+    };
+
+    template<typename A>
+    inline constexpr bool is_task = false;
+
+    template<typename T>
+    inline constexpr bool is_task<Task<T>> = true;
+
+    template<typename A>
+    concept TaskOrStandIn = StandsInForTask<A> || is_task<A>;
+}
+
 
 template<typename A>
 auto run_awaitable_sync(CoroutineThreadPool& pool, A a) {
     using T = promise::detail::ResultT<A>;
 
-    promise::detail::run_sync coro = [&](CoroutineThreadPool& pool) -> promise::detail::run_sync<T, true> {
+    // a is passed rather than captured, the lambda is gone by the time the coroutine runs
+    promise::detail::run_sync coro = [](CoroutineThreadPool& pool, A& a) -> promise::detail::run_sync<T, true> {
         if constexpr (std::is_void_v<T>) {
             co_await std::move(a);
         } else {
             co_return co_await std::move(a);
         }
-    }(pool);
+    }(pool, a);
     coro.wait();
     if constexpr (std::is_void_v<T>) {
         std::move(coro).get();
@@ -1,26 +1,81 @@
 #pragma once
 
 #include <chrono>
+#include <optional>
+#include <stop_token>
 
 #include "thread_pool/promise.h"
+#include "thread_pool/cancellation.h"
 
 namespace pt {
 
+// If the awaiting coroutine is cancelled while it's asleep the sleep's timer is removed from the
+// pool, and Cancelled is thrown as soon as it's resumed.
 struct sleep_until {
     sleep_until(std::chrono::steady_clock::time_point until): until(until) {}
 
+    // only moved before it's awaited
+    sleep_until(sleep_until&& o): until(o.until) {}
+
     bool await_ready() {
         return until < std::chrono::steady_clock::now();
     }
 
     template<typename U>
-    void await_suspend(std::coroutine_handle<U> h) noexcept {
+    bool await_suspend(std::coroutine_handle<U> h) noexcept {
+        if constexpr (requires {h.promise().stop_token;}) {
+            if (h.promise().stop_token.stop_possible()) {
+                return suspend_cancellable(h, *h.promise().pool, h.promise().stop_token);
+            }
+        }
         h.promise().pool->push_sleep_until(h, until);
+        return true;
     }
 
-    void await_resume() {}
+    void await_resume() {
+        // waits for the callback if it's still running on another thread
+        on_stop.reset();
+        if (ticket.cancelled) {
+            throw Cancelled{};
+        }
+    }
 
     std::chrono::steady_clock::time_point until;
+
+private:
+    struct cancel {
+        void operator()() noexcept {
+            if (s->pool->cancel_sleep(s->ticket)) {
+                s->pool->push(s->handle, s->priority);
+            }
+        }
+
+        sleep_until* s;
+    };
+
+    bool suspend_cancellable(std::coroutine_handle<> h, CoroutineThreadPool& p, const std::stop_token& token) {
+        if (token.stop_requested()) {
+            ticket.cancelled = true;
+            return false;
+        }
+
+        handle = h;
+        pool = &p;
+        // the stop may come from another thread, which won't be at our priority
+        priority = current_priority();
+        // Registered before the timer, so a stop that comes in while it's being pushed isn't
+        // missed. The pool sorts out which of the two gets there first.
+        on_stop.emplace(token, cancel{this});
+        // we may be resumed as soon as this is called, nothing can be touched after it
+        pool->push_sleep_until(h, until, *pool, &ticket);
+        return true;
+    }
+
+    std::coroutine_handle<> handle;
+    CoroutineThreadPool* pool = nullptr;
+    Priority priority = Priority::Normal;
+    SleepTicket ticket;
+    std::optional<std::stop_callback<cancel>> on_stop;
 };
 
 template<>
@@ -28,4 +83,4 @@ struct AwaitTransformPassThrough<sleep_until> {
     static constexpr bool pass_through = true;
 };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <coroutine>
+#include <cstdint>
+
+#include "thread_pool/promise.h"
+
+namespace pt {
+
+// A span is an id that ties a coroutine to whatever started it, for tracing. It's carried in the
+// promise like the stop token, a Task can be given one with set_span and everything it awaits
+// inherits it. 0 means no span.
+//
+// Spans are only carried when built with PT_TRACING (bazel --config=tracing), otherwise the
+// promises don't have room for one and every span is 0.
+#ifdef PT_TRACING
+inline constexpr bool spans_enabled = true;
+#else
+inline constexpr bool spans_enabled = false;
+#endif
+
+// the span of the awaiting coroutine
+struct get_span {
+    using pool_aware = void;
+
+    bool await_ready() const noexcept {return false;}
+
+    template<typename U>
+    bool await_suspend(std::coroutine_handle<U> h) noexcept {
+        if constexpr (requires {h.promise().span;}) {
+            span = h.promise().span;
+        }
+        return false;
+    }
+
+    uint64_t await_resume() const noexcept {return span;}
+
+    uint64_t span = 0;
+};
+
+}
@@ -0,0 +1,100 @@
+#include "thread_pool/strand.h"
+
+namespace pt {
+
+namespace {
+    thread_local const Strand* current_strand = nullptr;
+}
+
+Strand::Strand(CoroutineThreadPool& pool): pool(&pool), drainer(drain()) {}
+
+Strand::~Strand() {
+    // When pending is non zero the drainer is sitting on the pool, which owns (and destroys) it
+    // like any other coroutine it never got round to resuming.
+    if (pending.load() == 0) {
+        drainer.handle.destroy();
+    }
+
+    for (auto q: queued) {
+        if (q.handle) q.handle.destroy();
+    }
+}
+
+void Strand::push(std::coroutine_handle<> handle, Priority priority) {
+    {
+        std::lock_guard l(m);
+        queued.push_back({handle, priority});
+    }
+
+    if (pending.fetch_add(1) == 0) {
+        pool->push(drainer.handle, priority);
+    }
+}
+
+void Strand::push_sleep_until(std::coroutine_handle<> handle, std::chrono::steady_clock::time_point until, CoroutineThreadPool& resume_on, SleepTicket* ticket) {
+    pool->push_sleep_until(handle, until, resume_on, ticket);
+}
+
+bool Strand::cancel_sleep(SleepTicket& ticket) {
+    return pool->cancel_sleep(ticket);
+}
+
+bool Strand::running_in_this_thread() const {
+    return current_strand == this;
+}
+
+Strand::Queued Strand::pop() {
+    std::lock_guard l(m);
+    auto q = queued.front();
+    queued.pop_front();
+    return q;
+}
+
+strand::detail::drainer Strand::drain() {
+    size_t resumed = 0;
+    while (true) {
+        auto q = pop();
+
+        const Strand* prev = current_strand;
+        current_strand = this;
+        {
+            thread_pool::detail::PriorityScope scope(q.priority);
+            // the drainer can run many of these in one of the pool's resumes, each gets its own
+            thread_pool::detail::ResumeScope resuming;
+            q.handle.resume();
+        }
+        current_strand = prev;
+
+        resumed++;
+        bool continued = false;
+        co_await next_awaitable{this, resumed, &continued};
+        if (!continued) {
+            resumed = 0;
+        }
+    }
+}
+
+bool Strand::next_awaitable::await_suspend(std::coroutine_handle<> h) noexcept {
+    // Once pending is decremented another thread may push the drainer and resume it, so nothing
+    // can touch the drainer's frame after that.
+    Strand* s = strand;
+    if (s->pending.fetch_sub(1) == 1) {
+        // nothing left, the next push will put us back on the pool
+        return true;
+    }
+
+    // once anything on the strand has started checking its time slice the strand gives the
+    // thread up when that runs out too, otherwise everything behind a yield runs on the same slice
+    auto slice_start = thread_pool::detail::slice_start;
+    bool over_budget = slice_start != std::chrono::steady_clock::time_point{}
+        && std::chrono::steady_clock::now() - slice_start >= s->pool->time_slice();
+    if (resumed >= max_batch || over_budget) {
+        s->pool->yield(h, current_priority());
+        return true;
+    }
+
+    *continued = true;
+    return false;
+}
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <deque>
+#include <mutex>
+
+#include "thread_pool/thread_pool.h"
+#include "thread_pool/frame_allocator.h"
+
+namespace pt {
+
+namespace strand::detail {
+    // Long lived coroutine that resumes everything pushed onto a strand, one at a time. It is only
+    // ever on the underlying pool once, so it never runs concurrently with itself.
+    struct drainer {
+        struct promise_type: FrameAllocated {
+            drainer get_return_object() noexcept {
+                return {std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+
+            std::suspend_always initial_suspend() const noexcept {return {};}
+            std::suspend_always final_suspend() const noexcept {return {};}
+            void return_void() {}
+            void unhandled_exception() {std::terminate();}
+        };
+
+        std::coroutine_handle<promise_type> handle;
+    };
+}
+
+// Executor that runs the coroutines pushed onto it one at a time, on the threads of an underlying
+// pool. Coroutines on the same strand never run in parallel, coroutines on different strands can.
+//
+// Nothing is held across a suspension, a coroutine on a strand that co_awaits something lets the
+// next one on the strand run. So this gives the same guarantees as running everything on one
+// thread, without blocking any of the pool's threads.
+//
+// Coroutines on a strand run in the order they were pushed whatever their priority. The strand
+// goes onto the pool at the priority of whatever was pushed when it had nothing queued.
+class Strand: public CoroutineThreadPool {
+public:
+    Strand(CoroutineThreadPool& pool);
+    ~Strand();
+
+    Strand(const Strand&) = delete;
+    Strand(Strand&&) = delete;
+
+    Strand& operator=(const Strand&) = delete;
+    Strand& operator=(Strand&&) = delete;
+
+    using CoroutineThreadPool::push;
+    using CoroutineThreadPool::push_sleep_until;
+
+    void push(std::coroutine_handle<> handle, Priority priority) override;
+    void push_sleep_until(std::coroutine_handle<> handle, std::chrono::steady_clock::time_point until, CoroutineThreadPool& resume_on, SleepTicket* ticket) override;
+    bool cancel_sleep(SleepTicket& ticket) override;
+    size_t num_threads() const override {return 1;}
+    bool running_in_this_thread() const override;
+    std::chrono::steady_clock::duration time_slice() const override {return pool->time_slice();}
+
+private:
+    // how many coroutines the drainer resumes before giving the pool's thread back to others, it
+    // also gives it back once one of them yields
+    static constexpr size_t max_batch = 32;
+
+    struct next_awaitable {
+        bool await_ready() const noexcept {return false;}
+        bool await_suspend(std::coroutine_handle<> h) noexcept;
+        void await_resume() const noexcept {}
+
+        Strand* strand;
+        size_t resumed;
+        bool* continued;
+    };
+
+    struct Queued {
+        std::coroutine_handle<> handle;
+        Priority priority;
+    };
+
+    strand::detail::drainer drain();
+    Queued pop();
+
+    CoroutineThreadPool* pool;
+    strand::detail::drainer drainer;
+
+    // number of coroutines pushed that the drainer hasn't finished resuming yet, the drainer is
+    // on the pool whenever this is non zero.
+    std::atomic<size_t> pending = 0;
+
+    std::mutex m;
+    std::deque<Queued> queued;
+};
+
+}
@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "thread_pool/thread_pool.h"
+#include "thread_pool/work_stealing_thread_pool.h"
+#include "thread_pool/async_io.h"
+#include "thread_pool/promise.h"
+#include "thread_pool/when_all.h"
+
+using namespace pt;
+
+namespace {
+    std::filesystem::path temp_path(const std::string& name) {
+        return std::filesystem::temp_directory_path() / ("pt_async_io_" + std::to_string(getpid()) + "_" + name);
+    }
+
+    std::vector<char> pattern(size_t size) {
+        std::vector<char> data(size);
+        for (size_t i = 0; i < size; i++) {
+            data[i] = static_cast<char>(i * 31 + i / 7);
+        }
+        return data;
+    }
+
+    class AsyncIo: public ::testing::TestWithParam<bool> {};
+}
+
+TEST_P(AsyncIo, should_read_back_what_was_written) {
+    WorkStealingCoroutineThreadPool pool{2};
+    IoService service{GetParam()};
+    auto path = temp_path("round_trip");
+
+    // bigger than a chunk, and not a multiple of one
+    auto data = pattern((3 << 20) + 123);
+    auto read = run_sync(pool, [&]() -> Task<std::vector<char>> {
+        co_await async_write(path, data, service);
+        co_return co_await async_read(path, service);
+    });
+    ASSERT_EQ(read, data);
+
+    std::filesystem::remove(path);
+    pool.stop_and_join();
+}
+
+TEST_P(AsyncIo, should_read_an_empty_file) {
+    FixedCoroutineThreadPool<1> pool;
+    IoService service{GetParam()};
+    auto path = temp_path("empty");
+
+    auto read = run_sync(pool, [&]() -> Task<std::vector<char>> {
+        co_await async_write(path, std::string(), service);
+        co_return co_await async_read(path, service);
+    });
+    ASSERT_TRUE(read.empty());
+
+    std::filesystem::remove(path);
+    pool.stop_and_join();
+}
+
+TEST_P(AsyncIo, should_read_at_an_offset) {
+    FixedCoroutineThreadPool<1> pool;
+    IoService service{GetParam()};
+    auto path = temp_path("offset");
+
+    std::string text = "hello, world";
+    auto read = run_sync(pool, [&]() -> Task<std::string> {
+        co_await async_write(path, text, service);
+
+        int fd = co_await async_open(path, O_RDONLY, 0, service);
+        std::string buf(5, '\0');
+        int n = co_await async_pread(fd, buf, 7, service);
+        buf.resize(static_cast<size_t>(n));
+
+        // past the end reads nothing
+        int past = co_await async_pread(fd, buf, 100, service);
+        EXPECT_EQ(past, 0);
+
+        co_await async_close(fd, service);
+        co_return buf;
+    });
+    ASSERT_EQ(read, "world");
+
+    std::filesystem::remove(path);
+    pool.stop_and_join();
+}
+
+TEST_P(AsyncIo, should_throw_if_the_file_does_not_exist) {
+    FixedCoroutineThreadPool<1> pool;
+    IoService service{GetParam()};
+
+    auto task = [&]() -> Task<> {
+        co_await async_read(temp_path("missing"), service);
+    };
+    try {
+        run_sync(pool, task);
+        FAIL();
+    } catch (const std::system_error& e) {
+        ASSERT_EQ(e.code().value(), ENOENT);
+    }
+    pool.stop_and_join();
+}
+
+TEST_P(AsyncIo, should_resume_on_the_awaiters_pool_at_its_priority) {
+    FixedCoroutineThreadPool<1> pool;
+    IoService service{GetParam()};
+    auto path = temp_path("resume");
+
+    auto task = [&]() -> Task<Priority> {
+        auto here = std::this_thread::get_id();
+        co_await async_write(path, std::string("abc"), service);
+        auto read = co_await async_read(path, service);
+        EXPECT_EQ(read.size(), 3);
+        EXPECT_EQ(std::this_thread::get_id(), here);
+        co_return current_priority();
+    };
+    auto t = task();
+    t.set_priority(Priority::Background);
+    ASSERT_EQ(run_awaitable_sync(pool, std::move(t)), Priority::Background);
+
+    std::filesystem::remove(path);
+    pool.stop_and_join();
+}
+
+TEST_P(AsyncIo, should_handle_many_at_once) {
+    WorkStealingCoroutineThreadPool pool{4};
+    // fewer entries than reads, so submitting has to wait for room
+    IoService service{GetParam(), 4};
+    auto path = temp_path("many");
+    auto data = pattern(64 << 10);
+
+    auto read_one = [&](size_t i) -> Task<size_t> {
+        auto read = co_await async_read(path, service);
+        EXPECT_EQ(read, data);
+        co_return i;
+    };
+
+    run_sync(pool, [&]() -> Task<> {
+        co_await async_write(path, data, service);
+        std::vector<Task<size_t>> reads;
+        for (size_t i = 0; i < 32; i++) {
+            reads.push_back(read_one(i));
+        }
+        auto done = co_await when_all(std::move(reads));
+        EXPECT_EQ(done.size(), 32);
+    });
+
+    std::filesystem::remove(path);
+    pool.stop_and_join();
+}
+
+INSTANTIATE_TEST_SUITE_P(IoUringAndFallback, AsyncIo, ::testing::Bool(), [](const auto& info) {
+    return info.param ? "io_uring" : "fallback";
+});
+
+TEST(IoService, should_fall_back_when_asked) {
+    IoService service{false};
+    ASSERT_FALSE(service.using_io_uring());
+}
@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <stop_token>
+#include <thread>
+
+#include "thread_pool/work_stealing_thread_pool.h"
+#include "thread_pool/strand.h"
+#include "thread_pool/promise.h"
+#include "thread_pool/sleep.h"
+#include "thread_pool/cancellation.h"
+#include "thread_pool/deadline.h"
+
+using namespace pt;
+using namespace std::chrono_literals;
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+    Task<> sleep_for_ages() {
+        co_await sleep_until(Clock::now() + 1h);
+    }
+
+    Task<bool> can_be_cancelled() {
+        co_return (co_await get_stop_token{}).stop_possible();
+    }
+
+    Task<bool> nested_can_be_cancelled() {
+        co_return co_await can_be_cancelled();
+    }
+
+    Task<int> quick(int x) {
+        co_return x;
+    }
+
+    template<typename PoolT>
+    void should_cancel_sleep(PoolT& pool) {
+        std::stop_source source;
+        auto task = sleep_for_ages();
+        task.set_stop_token(source.get_token());
+
+        std::jthread canceller([&]{
+            std::this_thread::sleep_for(10ms);
+            source.request_stop();
+        });
+
+        auto start = Clock::now();
+        ASSERT_THROW(run_awaitable_sync(pool, std::move(task)), Cancelled);
+        ASSERT_LT(Clock::now() - start, 10s);
+    }
+}
+
+class CancellationTest: public ::testing::Test {
+protected:
+    ~CancellationTest() {pool.stop_and_join();}
+    WorkStealingCoroutineThreadPool pool{4};
+};
+
+TEST_F(CancellationTest, should_cancel_a_sleep) {
+    should_cancel_sleep(pool);
+}
+
+TEST_F(CancellationTest, should_cancel_a_sleep_on_a_strand) {
+    Strand strand{pool};
+    should_cancel_sleep(strand);
+    pool.stop_and_join();
+}
+
+TEST(Cancellation, should_cancel_a_sleep_on_a_fixed_pool) {
+    FixedCoroutineThreadPool<1> pool;
+    should_cancel_sleep(pool);
+    pool.stop_and_join();
+}
+
+TEST_F(CancellationTest, should_not_sleep_if_already_cancelled) {
+    std::stop_source source;
+    source.request_stop();
+
+    auto task = sleep_for_ages();
+    task.set_stop_token(source.get_token());
+    ASSERT_THROW(run_awaitable_sync(pool, std::move(task)), Cancelled);
+}
+
+TEST_F(CancellationTest, should_pass_stop_token_to_awaited_tasks) {
+    ASSERT_FALSE(run_awaitable_sync(pool, nested_can_be_cancelled()));
+
+    std::stop_source source;
+    auto task = nested_can_be_cancelled();
+    task.set_stop_token(source.get_token());
+    ASSERT_TRUE(run_awaitable_sync(pool, std::move(task)));
+}
+
+TEST_F(CancellationTest, should_cancel_many_sleeps_at_once) {
+    std::stop_source source;
+    std::vector<Task<>> tasks;
+    for (int i = 0; i < 100; i++) {
+        tasks.push_back(sleep_for_ages());
+    }
+    auto all = [](std::vector<Task<>> tasks) -> Task<> {
+        co_await when_all(std::move(tasks));
+    }(std::move(tasks));
+    all.set_stop_token(source.get_token());
+
+    std::jthread canceller([&]{
+        std::this_thread::sleep_for(10ms);
+        source.request_stop();
+    });
+    ASSERT_THROW(run_awaitable_sync(pool, std::move(all)), Cancelled);
+}
+
+TEST_F(CancellationTest, with_deadline_should_cancel_at_the_deadline) {
+    auto start = Clock::now();
+    ASSERT_THROW(run_awaitable_sync(pool, with_deadline(sleep_for_ages(), Clock::now() + 20ms)), Cancelled);
+
+    auto took = Clock::now() - start;
+    ASSERT_GE(took, 20ms);
+    ASSERT_LT(took, 10s);
+}
+
+TEST_F(CancellationTest, with_deadline_should_not_wait_for_the_deadline) {
+    auto start = Clock::now();
+    ASSERT_EQ(run_awaitable_sync(pool, with_timeout(quick(3), 1h)), 3);
+    ASSERT_LT(Clock::now() - start, 10s);
+}
+
+TEST_F(CancellationTest, with_deadline_should_be_cancelled_by_its_awaiter) {
+    std::stop_source source;
+    auto task = with_timeout(sleep_for_ages(), 1h);
+    task.set_stop_token(source.get_token());
+
+    std::jthread canceller([&]{
+        std::this_thread::sleep_for(10ms);
+        source.request_stop();
+    });
+    ASSERT_THROW(run_awaitable_sync(pool, std::move(task)), Cancelled);
+}
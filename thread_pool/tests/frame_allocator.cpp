@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+#include "thread_pool/thread_pool.h"
+#include "thread_pool/promise.h"
+#include "thread_pool/frame_allocator.h"
+
+using namespace pt;
+
+class FrameAllocatorTest: public ::testing::Test {
+protected:
+    ~FrameAllocatorTest() {pool.stop_and_join();}
+    FixedCoroutineThreadPool<1> pool;
+};
+
+Task<int> leaf(int x) {
+    co_return x + 1;
+}
+
+Task<int> tree(int depth) {
+    if (depth == 0) {
+        co_return co_await leaf(0);
+    }
+    int a = co_await tree(depth - 1);
+    int b = co_await tree(depth - 1);
+    co_return a + b;
+}
+
+TEST_F(FrameAllocatorTest, should_reuse_frames_once_warmed_up) {
+    ASSERT_EQ(run_awaitable_sync(pool, tree(4)), 16);
+    auto before = frame_allocator_stats();
+
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQ(run_awaitable_sync(pool, tree(4)), 16);
+    }
+
+    auto after = frame_allocator_stats();
+    ASSERT_EQ(after.heap_allocations, before.heap_allocations);
+    ASSERT_EQ(after.heap_frees, before.heap_frees);
+}
+
+TEST_F(FrameAllocatorTest, should_give_frames_destroyed_on_another_thread_back) {
+    // more than a thread caches of its own
+    constexpr int n = 300;
+    std::vector<Task<int>> tasks;
+    for (int i = 0; i < n; i++) {
+        tasks.push_back(leaf(i));
+    }
+    std::thread([&]{tasks.clear();}).join();
+
+    auto before = frame_allocator_stats();
+    for (int i = 0; i < n; i++) {
+        tasks.push_back(leaf(i));
+    }
+    auto after = frame_allocator_stats();
+    ASSERT_EQ(after.heap_allocations, before.heap_allocations);
+    // and the other thread had nothing to give back to the heap when it exited
+    ASSERT_EQ(after.heap_frees, before.heap_frees);
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <future>
+#include <latch>
+#include <stdexcept>
+#include <thread>
+
+#include "thread_pool/thread_pool.h"
+#include "thread_pool/work_stealing_thread_pool.h"
+#include "thread_pool/blocking_pool.h"
+#include "thread_pool/offload.h"
+#include "thread_pool/promise.h"
+#include "thread_pool/when_all.h"
+
+using namespace pt;
+
+TEST(Offload, should_run_somewhere_else_and_come_back) {
+    FixedCoroutineThreadPool<1> pool;
+    BlockingPool blocking;
+
+    run_sync(pool, [&]() -> Task<> {
+        auto here = std::this_thread::get_id();
+        auto there = co_await offload(blocking, []{return std::this_thread::get_id();});
+        EXPECT_NE(here, there);
+        EXPECT_EQ(std::this_thread::get_id(), here);
+        EXPECT_TRUE(pool.running_in_this_thread());
+    });
+    pool.stop_and_join();
+}
+
+TEST(Offload, should_rethrow) {
+    FixedCoroutineThreadPool<1> pool;
+    BlockingPool blocking;
+
+    auto task = [&]() -> Task<> {
+        co_await offload(blocking, []{throw std::runtime_error("failed");});
+    };
+    ASSERT_THROW(run_sync(pool, task), std::runtime_error);
+    pool.stop_and_join();
+}
+
+TEST(Offload, should_leave_the_pool_free_while_blocked) {
+    FixedCoroutineThreadPool<1> pool;
+    BlockingPool blocking;
+    std::promise<int> promise;
+
+    auto wait = [&]() -> Task<int> {
+        co_return co_await offload(blocking, [&]{return promise.get_future().get();});
+    };
+    auto unblock = [&]() -> Task<> {
+        promise.set_value(3);
+        co_return;
+    };
+
+    // on a single thread unblock can only run while wait is offloaded
+    auto [value, _] = run_sync(pool, [&]() -> Task<std::tuple<int, std::monostate>> {
+        co_return co_await when_all(wait(), unblock());
+    });
+    ASSERT_EQ(value, 3);
+    pool.stop_and_join();
+}
+
+TEST(Offload, should_keep_the_awaiters_priority) {
+    WorkStealingCoroutineThreadPool pool{2};
+    BlockingPool blocking;
+
+    auto task = [&]() -> Task<Priority> {
+        co_await offload(blocking, []{});
+        co_return current_priority();
+    };
+    auto t = task();
+    t.set_priority(Priority::Background);
+    ASSERT_EQ(run_awaitable_sync(pool, std::move(t)), Priority::Background);
+    pool.stop_and_join();
+}
+
+TEST(BlockingPool, should_grow_while_busy_and_shrink_when_idle) {
+    FixedCoroutineThreadPool<1> pool;
+    BlockingPool blocking{8, std::chrono::milliseconds(10)};
+    std::latch latch{4};
+
+    auto rendezvous = [&]() -> Task<> {
+        co_await offload(blocking, [&]{latch.arrive_and_wait();});
+    };
+
+    // only finishes if all four are blocked at once
+    run_sync(pool, [&]() -> Task<> {
+        co_await when_all(rendezvous(), rendezvous(), rendezvous(), rendezvous());
+    });
+    ASSERT_GE(blocking.num_threads(), 4);
+    ASSERT_LE(blocking.num_threads(), 8);
+
+    while (blocking.num_threads() != 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    pool.stop_and_join();
+}
@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "thread_pool/thread_pool.h"
+#include "thread_pool/work_stealing_thread_pool.h"
+#include "thread_pool/strand.h"
+#include "thread_pool/promise.h"
+#include "thread_pool/sleep.h"
+#include "thread_pool/when_all.h"
+
+using namespace pt;
+
+namespace {
+    // puts the awaiter back on its pool, at its current priority
+    struct reschedule {
+        using pool_aware = void;
+
+        bool await_ready() const noexcept {return false;}
+
+        template<typename U>
+        void await_suspend(std::coroutine_handle<U> h) noexcept {
+            h.promise().pool->push(h);
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    struct Log {
+        void add(std::string s) {
+            std::lock_guard l(m);
+            entries.push_back(std::move(s));
+        }
+
+        std::mutex m;
+        std::vector<std::string> entries;
+    };
+
+    Task<> record(Log& log, std::string name) {
+        log.add(std::move(name));
+        co_return;
+    }
+
+    Task<> record_at(Log& log, std::string name, Priority priority) {
+        auto task = record(log, std::move(name));
+        task.set_priority(priority);
+        return task;
+    }
+
+    Task<Priority> priority_now() {
+        co_return current_priority();
+    }
+
+    Task<std::vector<Priority>> priorities_seen() {
+        std::vector<Priority> seen;
+        seen.push_back(current_priority());
+        seen.push_back(co_await priority_now());
+
+        auto [a, b] = co_await when_all(priority_now(), priority_now());
+        seen.push_back(a);
+        seen.push_back(b);
+
+        co_await sleep_until(std::chrono::steady_clock::now() + std::chrono::milliseconds(1));
+        seen.push_back(current_priority());
+
+        co_await reschedule{};
+        seen.push_back(current_priority());
+        co_return seen;
+    }
+
+    Task<std::vector<Priority>> run_at(Priority priority) {
+        auto task = priorities_seen();
+        task.set_priority(priority);
+        auto seen = co_await std::move(task);
+        // back at our own once it's done
+        seen.push_back(current_priority());
+        co_return seen;
+    }
+
+    void assert_all_at(const std::vector<Priority>& seen, Priority priority) {
+        ASSERT_EQ(seen.size(), 7);
+        for (size_t i = 0; i + 1 < seen.size(); i++) {
+            ASSERT_EQ(seen[i], priority) << i;
+        }
+        ASSERT_EQ(seen.back(), Priority::Normal);
+    }
+}
+
+TEST(Priority, should_run_higher_priorities_first) {
+    FixedCoroutineThreadPool<1> pool;
+    Log log;
+
+    run_sync(pool, [&]() -> Task<> {
+        // Everything but the first is only pushed, nothing else can run on the pool's only
+        // thread until the first has finished.
+        co_await when_all(
+            record_at(log, "n1", Priority::Normal),
+            record_at(log, "b1", Priority::Background),
+            record_at(log, "n2", Priority::Normal),
+            record_at(log, "h1", Priority::High),
+            record_at(log, "b2", Priority::Background),
+            record_at(log, "h2", Priority::High)
+        );
+    });
+
+    std::vector<std::string> expected = {"n1", "h1", "h2", "n2", "b1", "b2"};
+    ASSERT_EQ(log.entries, expected);
+    pool.stop_and_join();
+}
+
+TEST(Priority, should_be_inherited_on_a_fixed_pool) {
+    FixedCoroutineThreadPool<1> pool;
+    assert_all_at(run_awaitable_sync(pool, run_at(Priority::High)), Priority::High);
+    assert_all_at(run_awaitable_sync(pool, run_at(Priority::Background)), Priority::Background);
+    pool.stop_and_join();
+}
+
+TEST(Priority, should_be_inherited_on_a_work_stealing_pool) {
+    WorkStealingCoroutineThreadPool pool{4};
+    assert_all_at(run_awaitable_sync(pool, run_at(Priority::High)), Priority::High);
+    assert_all_at(run_awaitable_sync(pool, run_at(Priority::Background)), Priority::Background);
+    pool.stop_and_join();
+}
+
+TEST(Priority, should_be_inherited_on_a_strand) {
+    WorkStealingCoroutineThreadPool pool{4};
+    Strand strand{pool};
+
+    auto task = run_at(Priority::High);
+    task.bind(strand);
+    assert_all_at(run_awaitable_sync(pool, std::move(task)), Priority::High);
+    pool.stop_and_join();
+}
+
+TEST(Priority, should_not_starve_background_work) {
+    FixedCoroutineThreadPool<1> pool;
+    std::atomic<bool> done = false;
+
+    auto busy = [&]() -> Task<> {
+        // keeps a high priority coroutine waiting until the background one has run
+        while (!done) {
+            co_await reschedule{};
+        }
+    };
+    auto background = [&]() -> Task<> {
+        done = true;
+        co_return;
+    };
+
+    run_sync(pool, [&]() -> Task<> {
+        auto b = busy();
+        b.set_priority(Priority::High);
+        auto bg = background();
+        bg.set_priority(Priority::Background);
+        co_await when_all(std::move(b), std::move(bg));
+    });
+    pool.stop_and_join();
+}
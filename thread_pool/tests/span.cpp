@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+
+#include "thread_pool/thread_pool.h"
+#include "thread_pool/work_stealing_thread_pool.h"
+#include "thread_pool/strand.h"
+#include "thread_pool/promise.h"
+#include "thread_pool/span.h"
+#include "thread_pool/when_all.h"
+
+using namespace pt;
+
+namespace {
+    Task<uint64_t> span_now() {
+        co_return co_await get_span{};
+    }
+
+    Task<uint64_t> nested_span() {
+        co_return co_await span_now();
+    }
+
+    Task<uint64_t> with_span(uint64_t span) {
+        auto task = span_now();
+        task.set_span(span);
+        return task;
+    }
+
+    Task<std::tuple<uint64_t, uint64_t, uint64_t, uint64_t>> spans_seen() {
+        auto [a, b] = co_await when_all(nested_span(), with_span(7));
+        co_return std::make_tuple(co_await get_span{}, co_await nested_span(), a, b);
+    }
+}
+
+TEST(Span, should_be_zero_by_default) {
+    FixedCoroutineThreadPool<1> pool;
+    ASSERT_EQ(run_awaitable_sync(pool, nested_span()), 0);
+    pool.stop_and_join();
+}
+
+#ifndef PT_TRACING
+// spans cost nothing when they're compiled out
+template<typename PromiseT>
+concept HasSpan = requires(PromiseT& p) {p.span;};
+static_assert(!HasSpan<Task<>::promise_type>);
+static_assert(!HasSpan<Task<int>::promise_type>);
+static_assert(sizeof(void*) != 8 || sizeof(Task<>::promise_type) == 96);
+#endif
+
+TEST(Span, should_be_inherited_unless_given_one) {
+    if (!spans_enabled) {
+        GTEST_SKIP() << "spans need PT_TRACING";
+    }
+    WorkStealingCoroutineThreadPool pool{4};
+    Strand strand{pool};
+
+    auto task = spans_seen();
+    task.set_span(3);
+    task.bind(strand);
+    auto [own, nested, in_when_all, given] = run_awaitable_sync(pool, std::move(task));
+    ASSERT_EQ(own, 3);
+    ASSERT_EQ(nested, 3);
+    ASSERT_EQ(in_when_all, 3);
+    ASSERT_EQ(given, 7);
+    pool.stop_and_join();
+}
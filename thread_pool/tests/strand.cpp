@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <latch>
+#include <thread>
+
+#include "thread_pool/work_stealing_thread_pool.h"
+#include "thread_pool/strand.h"
+#include "thread_pool/promise.h"
+#include "thread_pool/sleep.h"
+
+using namespace pt;
+
+namespace {
+    struct yield_to_pool {
+        bool await_ready() {return false;}
+        template<typename U>
+        void await_suspend(std::coroutine_handle<U> h) noexcept {
+            h.promise().pool->push(h);
+        }
+        void await_resume() {}
+    };
+}
+
+template<>
+struct pt::AwaitTransformPassThrough<yield_to_pool> {
+    static constexpr bool pass_through = true;
+};
+
+class StrandTest: public ::testing::Test {
+protected:
+    // the pool has to stop before the strands are destroyed, the last coroutine on a strand can
+    // finish before the strand's drainer does.
+    ~StrandTest() {pool.stop_and_join();}
+    WorkStealingCoroutineThreadPool pool{4};
+    Strand strand{pool};
+    Strand strand2{pool};
+};
+
+struct Counter {
+    std::atomic<int> running = 0;
+    std::atomic<int> max_running = 0;
+    // deliberately not atomic, the strand is what makes incrementing it safe
+    int count = 0;
+};
+
+Task<> increment(Counter& counter, size_t times) {
+    for (size_t i = 0; i < times; i++) {
+        int running = ++counter.running;
+        int max_running = counter.max_running;
+        while (running > max_running && !counter.max_running.compare_exchange_weak(max_running, running)) {}
+
+        counter.count++;
+        counter.running--;
+        co_await yield_to_pool{};
+    }
+}
+
+Task<> increment_then_count_down(Counter& counter, size_t times, std::latch& done) {
+    co_await increment(counter, times);
+    done.count_down();
+}
+
+TEST_F(StrandTest, should_run_coroutines_one_at_a_time) {
+    Counter counter;
+    std::latch done{8};
+
+    for (size_t i = 0; i < 8; i++) {
+        run_awaitable_async(strand, increment_then_count_down(counter, 1000, done));
+    }
+    done.wait();
+
+    ASSERT_EQ(counter.count, 8000);
+    ASSERT_EQ(counter.max_running, 1);
+}
+
+Task<> rendezvous(std::latch& latch, std::latch& done) {
+    latch.arrive_and_wait();
+    done.count_down();
+    co_return;
+}
+
+TEST_F(StrandTest, different_strands_should_run_in_parallel) {
+    std::latch latch{2};
+    std::latch done{2};
+
+    // each blocks until the other arrives, so only finishes if they run at the same time
+    run_awaitable_async(strand, rendezvous(latch, done));
+    run_awaitable_async(strand2, rendezvous(latch, done));
+    done.wait();
+}
+
+Task<bool> on_strand(const Strand& strand) {
+    co_return strand.running_in_this_thread();
+}
+
+TEST_F(StrandTest, bound_task_should_run_on_its_strand) {
+    auto task = on_strand(strand);
+    task.bind(strand);
+    ASSERT_TRUE(run_awaitable_sync(pool, std::move(task)));
+    ASSERT_FALSE(run_awaitable_sync(pool, on_strand(strand)));
+}
+
+Task<bool> sleep_on_strand(const Strand& strand) {
+    co_await sleep_until(std::chrono::steady_clock::now() + std::chrono::milliseconds(1));
+    co_return strand.running_in_this_thread();
+}
+
+TEST_F(StrandTest, should_resume_on_strand_after_sleeping) {
+    ASSERT_TRUE(run_awaitable_sync(strand, sleep_on_strand(strand)));
+}
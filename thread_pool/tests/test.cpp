@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 #include <memory>
 #include <future>
+#include <thread>
+#include <vector>
 
 #include "thread_pool/thread_pool.h"
 #include "thread_pool/promise.h"
@@ -36,6 +38,19 @@ struct swap_threads_throw {
     std::thread* new_thread;
 };
 
+// like swap_threads, but templated on the promise type the way a third party awaiter might be
+struct swap_threads_templated {
+    bool await_ready() {return false;}
+    template<typename U>
+    void await_suspend(std::coroutine_handle<U> h) noexcept {
+        *new_thread = std::thread([=]{
+            h.resume();
+        });
+    }
+    int await_resume() {return 3;}
+    std::thread* new_thread;
+};
+
 
 TEST_F(SingleThreadedThreadPoolTest, should_run_something) {
     auto ret = run_sync(pool, []() -> Task<int> {
@@ -73,6 +88,23 @@ TEST_F(SingleThreadedThreadPoolTest, should_always_run_on_the_thread_pool_thread
     ASSERT_EQ(initial_thread, final_thread);
 }
 
+TEST_F(SingleThreadedThreadPoolTest, should_always_run_on_the_thread_pool_thread_after_a_templated_awaiter) {
+    std::thread new_thread;
+    std::thread::id initial_thread;
+    std::thread::id final_thread;
+
+    auto coro = [&]() -> Task<int> {
+        initial_thread = std::this_thread::get_id();
+        int ans = co_await swap_threads_templated{&new_thread};
+        final_thread = std::this_thread::get_id();
+        co_return ans;
+    };
+
+    ASSERT_EQ(run_sync(pool, coro), 3);
+    new_thread.join();
+    ASSERT_EQ(initial_thread, final_thread);
+}
+
 TEST_F(SingleThreadedThreadPoolTest, should_always_run_on_the_thread_pool_thread_nested) {
     std::thread new_thread;
     std::thread::id thread1;
@@ -100,6 +132,47 @@ TEST_F(SingleThreadedThreadPoolTest, should_always_run_on_the_thread_pool_thread
     ASSERT_EQ(thread1, thread4);
 }
 
+TEST_F(SingleThreadedThreadPoolTest, should_always_run_on_the_thread_pool_thread_repeatedly) {
+    std::thread::id initial_thread;
+    std::vector<std::thread::id> threads;
+
+    auto coro = [&]() -> Task<int> {
+        initial_thread = std::this_thread::get_id();
+        for (int i = 0; i < 3; i++) {
+            std::thread new_thread;
+            co_await swap_threads{&new_thread};
+            threads.push_back(std::this_thread::get_id());
+            new_thread.join();
+        }
+        co_return 1;
+    };
+
+    run_sync(pool, coro);
+    ASSERT_EQ(threads, std::vector<std::thread::id>(3, initial_thread));
+}
+
+struct resume_immediately {
+    bool await_ready() {return false;}
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) {return h;}
+    int await_resume() {return 1;}
+};
+
+struct dont_suspend {
+    bool await_ready() {return false;}
+    bool await_suspend(std::coroutine_handle<>) {return false;}
+    int await_resume() {return 1;}
+};
+
+TEST_F(SingleThreadedThreadPoolTest, should_await_awaitables_that_resume_straight_away) {
+    auto ret = run_sync(pool, []() -> Task<int> {
+        int a = co_await resume_immediately{};
+        int b = co_await dont_suspend{};
+        co_await std::suspend_never{};
+        co_return a + b;
+    });
+    ASSERT_EQ(ret, 2);
+}
+
 TEST_F(SingleThreadedThreadPoolTest, should_work_with_void_return) {
     bool ran = false;
     run_sync(pool,  [&]() -> Task<> {
@@ -198,3 +271,43 @@ TEST_F(SingleThreadedThreadPoolTest, run_async) {
     
     ASSERT_EQ(future.get(), 3);
 }
+
+TEST_F(SingleThreadedThreadPoolTest, should_know_when_running_on_the_pool) {
+    ASSERT_FALSE(pool.running_in_this_thread());
+    ASSERT_TRUE(run_sync(pool, [&]() -> Task<bool> {
+        co_return pool.running_in_this_thread();
+    }));
+}
+
+namespace {
+    // what each on_finish call got, -1 for a null result
+    void record_result(void* results, void* result) {
+        static_cast<std::vector<int>*>(results)->push_back(result ? *static_cast<int*>(result) : -1);
+    }
+
+    Task<int> maybe_throw(bool throw_) {
+        if (throw_) {
+            throw 2;
+        }
+        co_return 5;
+    }
+}
+
+TEST_F(SingleThreadedThreadPoolTest, should_call_on_finish_once_with_the_result) {
+    std::vector<int> results;
+
+    auto task = maybe_throw(false);
+    task.on_finish(record_result, &results);
+    ASSERT_EQ(run_awaitable_sync(pool, std::move(task)), 5);
+
+    auto throws = maybe_throw(true);
+    throws.on_finish(record_result, &results);
+    ASSERT_THROW(run_awaitable_sync(pool, std::move(throws)), int);
+
+    {
+        auto never_started = maybe_throw(false);
+        never_started.on_finish(record_result, &results);
+    }
+
+    ASSERT_EQ(results, (std::vector<int>{5, -1, -1}));
+}
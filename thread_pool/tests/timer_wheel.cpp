@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "thread_pool/timer_wheel.h"
+#include "thread_pool/thread_pool.h"
+#include "thread_pool/promise.h"
+#include "thread_pool/sleep.h"
+
+using namespace pt;
+using namespace std::chrono_literals;
+
+using Clock = std::chrono::steady_clock;
+
+class TimerWheelTest: public ::testing::Test {
+protected:
+    std::vector<int> expire(Clock::duration since_origin) {
+        std::vector<int> ret;
+        wheel.expire(origin + since_origin, [&](int i) {ret.push_back(i);});
+        return ret;
+    }
+
+    Clock::time_point origin = Clock::now();
+    TimerWheel<int> wheel{1ms, Clock::duration::zero(), origin};
+};
+
+TEST_F(TimerWheelTest, should_expire_in_deadline_order) {
+    wheel.add(origin + 30ms, 3);
+    wheel.add(origin + 10ms, 1);
+    wheel.add(origin + 20ms, 2);
+    wheel.add(origin + 10ms, 4);
+
+    ASSERT_EQ(wheel.size(), 4);
+    ASSERT_EQ(expire(5ms), std::vector<int>{});
+    ASSERT_EQ(expire(100ms), (std::vector<int>{1, 4, 2, 3}));
+    ASSERT_TRUE(wheel.empty());
+}
+
+TEST_F(TimerWheelTest, should_not_expire_early) {
+    wheel.add(origin + 10ms + 1us, 1);
+
+    ASSERT_EQ(expire(10ms), std::vector<int>{});
+    ASSERT_EQ(wheel.next_expiry(), origin + 11ms);
+    ASSERT_EQ(expire(11ms), std::vector<int>{1});
+    ASSERT_EQ(wheel.next_expiry(), std::nullopt);
+}
+
+TEST_F(TimerWheelTest, should_expire_timers_already_due) {
+    expire(50ms);
+    wheel.add(origin + 10ms, 1);
+    ASSERT_LE(*wheel.next_expiry(), origin + 51ms);
+    ASSERT_EQ(expire(50ms), std::vector<int>{1});
+}
+
+TEST_F(TimerWheelTest, should_cancel) {
+    auto a = wheel.add(origin + 10ms, 1);
+    auto b = wheel.add(origin + 10ms, 2);
+    auto c = wheel.add(origin + 10s, 3);
+
+    ASSERT_TRUE(wheel.cancel(a));
+    ASSERT_FALSE(wheel.cancel(a));
+    ASSERT_TRUE(wheel.cancel(c));
+    ASSERT_EQ(wheel.size(), 1);
+
+    ASSERT_EQ(expire(20s), std::vector<int>{2});
+    ASSERT_FALSE(wheel.cancel(b));
+
+    // a's entry gets reused, the old id mustn't cancel the new timer
+    wheel.add(origin + 30s, 4);
+    ASSERT_FALSE(wheel.cancel(a));
+    ASSERT_EQ(expire(30s), std::vector<int>{4});
+}
+
+TEST_F(TimerWheelTest, should_cascade_long_timers) {
+    // spread over every level of the wheel, and past the end of it
+    std::vector<Clock::duration> deadlines = {
+        3ms, 70ms, 5s, 4min, 5h, 12 * 24h, 2 * 365 * 24h, 3 * 365 * 24h
+    };
+    for (size_t i = 0; i < deadlines.size(); i++) {
+        wheel.add(origin + deadlines[i], i);
+    }
+
+    for (size_t i = 0; i < deadlines.size(); i++) {
+        ASSERT_EQ(expire(deadlines[i] - 1ms), std::vector<int>{});
+        ASSERT_EQ(expire(deadlines[i]), std::vector<int>{static_cast<int>(i)});
+    }
+    ASSERT_TRUE(wheel.empty());
+}
+
+TEST_F(TimerWheelTest, should_expire_in_order_across_levels) {
+    std::vector<int> expected;
+    for (int i = 0; i < 5000; i++) {
+        // not added in order
+        int ms = (i * 7919) % 5000;
+        wheel.add(origin + std::chrono::milliseconds(ms), ms);
+        expected.push_back(ms);
+    }
+    std::sort(expected.begin(), expected.end());
+
+    std::vector<int> expired;
+    for (auto t = 0ms; t < 5s + 13ms; t += 13ms) {
+        auto some = expire(t);
+        expired.insert(expired.end(), some.begin(), some.end());
+    }
+    ASSERT_EQ(expired, expected);
+}
+
+TEST_F(TimerWheelTest, should_let_expiring_timers_add_more) {
+    wheel.add(origin + 1ms, 1);
+    std::vector<int> expired;
+    wheel.expire(origin + 10ms, [&](int i) {
+        expired.push_back(i);
+        if (i < 3) {
+            wheel.add(origin + 1ms, i + 1);
+        }
+    });
+    ASSERT_EQ(expired, (std::vector<int>{1, 2, 3}));
+}
+
+TEST(TimerWheel, should_coalesce_timers_within_slack) {
+    auto origin = Clock::now();
+    TimerWheel<int> wheel{1ms, 10ms, origin};
+
+    wheel.add(origin + 1ms, 1);
+    wheel.add(origin + 4ms, 2);
+    wheel.add(origin + 9ms, 3);
+    wheel.add(origin + 11ms, 4);
+
+    ASSERT_EQ(wheel.next_expiry(), origin + 10ms);
+
+    std::vector<int> expired;
+    auto count = wheel.expire(origin + 9ms, [&](int i) {expired.push_back(i);});
+    ASSERT_EQ(count, 0);
+
+    count = wheel.expire(origin + 10ms, [&](int i) {expired.push_back(i);});
+    ASSERT_EQ(count, 3);
+    ASSERT_EQ(expired, (std::vector<int>{1, 2, 3}));
+    ASSERT_EQ(wheel.next_expiry(), origin + 20ms);
+}
+
+Task<Clock::time_point> sleep_then_now(Clock::time_point until) {
+    co_await sleep_until(until);
+    co_return Clock::now();
+}
+
+TEST(TimerWheel, pool_should_wake_sleepers_after_their_deadline) {
+    FixedCoroutineThreadPool<1> pool{5ms};
+
+    auto until = Clock::now() + 20ms;
+    ASSERT_GE(run_awaitable_sync(pool, sleep_then_now(until)), until);
+    pool.stop_and_join();
+}
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "thread_pool/thread_pool.h"
+#include "thread_pool/work_stealing_thread_pool.h"
+#include "thread_pool/strand.h"
+#include "thread_pool/promise.h"
+#include "thread_pool/span.h"
+#include "thread_pool/watchdog.h"
+
+using namespace pt;
+using namespace std::chrono_literals;
+
+namespace {
+    struct Stalls {
+        std::vector<watchdog::Stall> get() {
+            std::lock_guard l(m);
+            return stalls;
+        }
+
+        std::function<void(const watchdog::Stall&)> report() {
+            return [this](const watchdog::Stall& stall) {
+                std::lock_guard l(m);
+                stalls.push_back(stall);
+            };
+        }
+
+        std::mutex m;
+        std::vector<watchdog::Stall> stalls;
+    };
+
+    Task<std::thread::id> block(std::chrono::milliseconds d) {
+        std::this_thread::sleep_for(d);
+        co_return std::this_thread::get_id();
+    }
+
+    Task<int> quick() {
+        co_return 1;
+    }
+
+    Task<std::thread::id> block_with_span(std::chrono::milliseconds d, uint64_t span) {
+        auto task = block(d);
+        task.set_span(span);
+        return task;
+    }
+
+    // the child has a span of its own, once it's finished the parent's is running again
+    Task<std::thread::id> block_after_child(std::chrono::milliseconds d) {
+        auto child = quick();
+        child.set_span(3);
+        co_await std::move(child);
+        std::this_thread::sleep_for(d);
+        co_return std::this_thread::get_id();
+    }
+}
+
+TEST(Watchdog, should_report_a_coroutine_blocking_its_thread) {
+    Stalls stalls;
+    FixedCoroutineThreadPool<1> pool;
+    std::thread::id blocked;
+    {
+        Watchdog watchdog{20ms, stalls.report()};
+        blocked = run_awaitable_sync(pool, block_with_span(200ms, 42));
+    }
+
+    auto reported = stalls.get();
+    ASSERT_EQ(reported.size(), 1);
+    ASSERT_EQ(reported[0].thread, blocked);
+    ASSERT_EQ(reported[0].span, spans_enabled ? 42 : 0);
+    ASSERT_GE(reported[0].duration, 20ms);
+    ASSERT_TRUE(reported[0].stack.empty());
+    pool.stop_and_join();
+}
+
+TEST(Watchdog, should_not_report_coroutines_that_dont_block) {
+    Stalls stalls;
+    WorkStealingCoroutineThreadPool pool{2};
+    Strand strand{pool};
+    {
+        Watchdog watchdog{50ms, stalls.report()};
+        // far longer than the threshold altogether, but each resume is short
+        auto until = std::chrono::steady_clock::now() + 200ms;
+        while (std::chrono::steady_clock::now() < until) {
+            auto task = block(1ms);
+            task.bind(strand);
+            run_awaitable_sync(pool, std::move(task));
+        }
+    }
+
+    ASSERT_TRUE(stalls.get().empty());
+    pool.stop_and_join();
+}
+
+TEST(Watchdog, should_know_the_span_after_an_await) {
+    if (!spans_enabled) {
+        GTEST_SKIP() << "spans need PT_TRACING";
+    }
+    Stalls stalls;
+    WorkStealingCoroutineThreadPool pool{2};
+    {
+        Watchdog watchdog{20ms, stalls.report()};
+        auto task = block_after_child(200ms);
+        task.set_span(9);
+        run_awaitable_sync(pool, std::move(task));
+    }
+
+    auto reported = stalls.get();
+    ASSERT_EQ(reported.size(), 1);
+    ASSERT_EQ(reported[0].span, 9);
+    pool.stop_and_join();
+}
+
+TEST(Watchdog, should_capture_the_stack_of_a_blocked_thread) {
+    Stalls stalls;
+    FixedCoroutineThreadPool<1> pool;
+    {
+        Watchdog watchdog{20ms, stalls.report(), true};
+        run_awaitable_sync(pool, block(200ms));
+    }
+
+    auto reported = stalls.get();
+    ASSERT_EQ(reported.size(), 1);
+    ASSERT_FALSE(reported[0].stack.empty());
+
+    // the thread is stuck in sleep_for
+    bool sleeping = false;
+    for (auto& frame: reported[0].stack) {
+        sleeping |= frame.find("nanosleep") != std::string::npos;
+    }
+    ASSERT_TRUE(sleeping);
+
+    std::stringstream report;
+    watchdog::write_stall(report, reported[0], "block");
+    ASSERT_EQ(report.str().find("pool thread "), 0);
+    pool.stop_and_join();
+}
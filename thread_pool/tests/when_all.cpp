@@ -0,0 +1,166 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <latch>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "thread_pool/work_stealing_thread_pool.h"
+#include "thread_pool/frame_allocator.h"
+#include "thread_pool/promise.h"
+#include "thread_pool/sleep.h"
+#include "thread_pool/when_all.h"
+
+using namespace pt;
+
+class WhenAllTest: public ::testing::Test {
+protected:
+    ~WhenAllTest() {pool.stop_and_join();}
+    WorkStealingCoroutineThreadPool pool{4};
+};
+
+namespace {
+    Task<int> value(int x) {
+        co_return x;
+    }
+
+    Task<std::string> string_value(std::string s) {
+        co_return s;
+    }
+
+    Task<> nothing() {
+        co_return;
+    }
+
+    Task<int> throws(int x) {
+        throw std::runtime_error(std::to_string(x));
+        co_return x;
+    }
+
+    // only finishes if count of these are running at once
+    Task<int> rendezvous(std::latch& latch, int x) {
+        latch.arrive_and_wait();
+        co_return x;
+    }
+
+    Task<int> sleep_then_value(std::chrono::milliseconds d, int x, std::latch& done) {
+        co_await sleep_until(std::chrono::steady_clock::now() + d);
+        done.count_down();
+        co_return x;
+    }
+}
+
+TEST_F(WhenAllTest, should_collect_every_result) {
+    auto [a, b, c] = run_sync(pool, []() -> Task<std::tuple<int, std::string, std::monostate>> {
+        co_return co_await when_all(value(1), string_value("two"), nothing());
+    });
+    ASSERT_EQ(a, 1);
+    ASSERT_EQ(b, "two");
+}
+
+TEST_F(WhenAllTest, should_collect_a_range_in_order) {
+    auto results = run_sync(pool, []() -> Task<std::vector<int>> {
+        std::vector<Task<int>> tasks;
+        for (int i = 0; i < 100; i++) {
+            tasks.push_back(value(i));
+        }
+        co_return co_await when_all(std::move(tasks));
+    });
+
+    ASSERT_EQ(results.size(), 100);
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQ(results[i], i);
+    }
+}
+
+TEST_F(WhenAllTest, should_allow_nothing) {
+    run_sync(pool, []() -> Task<> {
+        co_await when_all();
+        co_await when_all(std::vector<Task<>>{});
+    });
+}
+
+TEST_F(WhenAllTest, should_run_tasks_in_parallel) {
+    std::latch latch{4};
+    auto [a, b, c, d] = run_sync(pool, [&]() -> Task<std::tuple<int, int, int, int>> {
+        co_return co_await when_all(rendezvous(latch, 1), rendezvous(latch, 2), rendezvous(latch, 3), rendezvous(latch, 4));
+    });
+    ASSERT_EQ(a + b + c + d, 10);
+}
+
+TEST_F(WhenAllTest, should_rethrow_the_first_exception) {
+    auto task = []() -> Task<> {
+        co_await when_all(value(1), throws(2), throws(3));
+    };
+
+    try {
+        run_sync(pool, task);
+        FAIL();
+    } catch (const std::runtime_error& e) {
+        ASSERT_EQ(std::string(e.what()), "2");
+    }
+}
+
+TEST(WhenAll, should_not_allocate_frames_once_warmed_up) {
+    FixedCoroutineThreadPool<1> pool;
+    auto task = []() -> Task<int> {
+        auto [a, b, c] = co_await when_all(value(1), value(2), value(3));
+        co_return a + b + c;
+    };
+
+    ASSERT_EQ(run_sync(pool, task), 6);
+    auto before = frame_allocator_stats();
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQ(run_sync(pool, task), 6);
+    }
+    auto after = frame_allocator_stats();
+    ASSERT_EQ(after.heap_allocations, before.heap_allocations);
+    pool.stop_and_join();
+}
+
+TEST_F(WhenAllTest, when_any_should_return_the_first_to_finish) {
+    std::latch done{1};
+    auto result = run_sync(pool, [&]() -> Task<WhenAnyResult<int>> {
+        co_return co_await when_any(sleep_then_value(std::chrono::milliseconds(50), 1, done), value(2));
+    });
+    ASSERT_EQ(result.index, 1);
+    ASSERT_EQ(result.value, 2);
+
+    // the loser still runs to completion
+    done.wait();
+}
+
+TEST_F(WhenAllTest, when_any_should_rethrow_if_the_first_threw) {
+    std::latch done{1};
+    auto task = [&]() -> Task<WhenAnyResult<int>> {
+        co_return co_await when_any(sleep_then_value(std::chrono::milliseconds(50), 1, done), throws(2));
+    };
+    ASSERT_THROW(run_sync(pool, task), std::runtime_error);
+    done.wait();
+}
+
+TEST_F(WhenAllTest, when_any_should_handle_many_finishing_at_once) {
+    std::atomic<int> finished = 0;
+    auto count = [&]() -> Task<> {
+        finished++;
+        co_return;
+    };
+
+    for (int i = 0; i < 100; i++) {
+        auto result = run_sync(pool, [&]() -> Task<WhenAnyResult<void>> {
+            std::vector<Task<>> tasks;
+            for (int j = 0; j < 8; j++) {
+                tasks.push_back(count());
+            }
+            co_return co_await when_any(std::move(tasks));
+        });
+        ASSERT_LT(result.index, 8);
+    }
+
+    // the losers have to finish before the pool stops
+    while (finished != 800) {
+        std::this_thread::yield();
+    }
+}
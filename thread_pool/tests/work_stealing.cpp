@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <future>
+#include <latch>
+#include <mutex>
+#include <set>
+
+#include "thread_pool/work_stealing_thread_pool.h"
+#include "thread_pool/promise.h"
+#include "thread_pool/sleep.h"
+
+using namespace pt;
+
+class WorkStealingThreadPoolTest: public ::testing::Test {
+protected:
+    ~WorkStealingThreadPoolTest() {pool.stop_and_join();}
+    WorkStealingCoroutineThreadPool pool{4};
+};
+
+struct yield_to_pool {
+    bool await_ready() {return false;}
+    template<typename U>
+    void await_suspend(std::coroutine_handle<U> h) noexcept {
+        h.promise().pool->push(h);
+    }
+    void await_resume() {}
+};
+
+template<>
+struct pt::AwaitTransformPassThrough<yield_to_pool> {
+    static constexpr bool pass_through = true;
+};
+
+
+TEST_F(WorkStealingThreadPoolTest, should_run_something) {
+    auto ret = run_sync(pool, []() -> Task<int> {
+        co_return 1;
+    });
+    ASSERT_EQ(ret, 1);
+}
+
+TEST_F(WorkStealingThreadPoolTest, should_run_something_nested) {
+    auto nested = []() -> Task<int> {
+        co_return 2;
+    };
+
+    auto ret = run_sync(pool, [&]() -> Task<int> {
+        int ans = co_await nested();
+        co_return ans;
+    });
+    ASSERT_EQ(ret, 2);
+}
+
+TEST_F(WorkStealingThreadPoolTest, should_know_when_running_on_the_pool) {
+    WorkStealingCoroutineThreadPool other{1};
+    ASSERT_FALSE(pool.running_in_this_thread());
+    ASSERT_TRUE(run_sync(pool, [&]() -> Task<bool> {
+        co_return pool.running_in_this_thread() && !other.running_in_this_thread();
+    }));
+    other.stop_and_join();
+}
+
+TEST_F(WorkStealingThreadPoolTest, should_propagate_exceptions) {
+    auto coro = []() -> Task<> {
+        throw 2;
+        co_return;
+    };
+
+    ASSERT_THROW(run_sync(pool, coro), int);
+}
+
+TEST_F(WorkStealingThreadPoolTest, should_run_coroutines_in_parallel) {
+    std::latch latch{4};
+    std::vector<std::promise<void>> done(4);
+
+    auto coro = [](std::latch& latch, std::promise<void>& p) -> Task<> {
+        // only gets past here if all four coroutines are running at the same time
+        latch.arrive_and_wait();
+        p.set_value();
+        co_return;
+    };
+
+    for (auto& p: done) {
+        run_awaitable_async(pool, coro(latch, p));
+    }
+
+    for (auto& p: done) {
+        p.get_future().wait();
+    }
+}
+
+struct StealState {
+    static constexpr size_t num_coros = 1000;
+    std::atomic<size_t> finished = 0;
+    std::mutex m;
+    std::set<std::thread::id> threads;
+    std::promise<void> all_done;
+};
+
+Task<> record_thread(StealState& state) {
+    co_await yield_to_pool{};
+    {
+        std::lock_guard l(state.m);
+        state.threads.insert(std::this_thread::get_id());
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+    if (++state.finished == StealState::num_coros) {
+        state.all_done.set_value();
+    }
+}
+
+Task<> spawn_from_pool_thread(CoroutineThreadPool& pool, StealState& state) {
+    for (size_t i = 0; i < StealState::num_coros; i++) {
+        // every one of these goes onto the deque of the thread running this loop
+        run_awaitable_async(pool, record_thread(state));
+    }
+    co_return;
+}
+
+TEST_F(WorkStealingThreadPoolTest, should_steal_work_pushed_from_a_pool_thread) {
+    StealState state;
+    run_awaitable_sync(pool, spawn_from_pool_thread(pool, state));
+
+    state.all_done.get_future().wait();
+    ASSERT_GT(state.threads.size(), 1);
+}
+
+TEST_F(WorkStealingThreadPoolTest, should_sleep_until) {
+    auto start = std::chrono::steady_clock::now();
+    auto until = start + std::chrono::milliseconds(20);
+
+    run_sync(pool, [&]() -> Task<> {
+        co_await sleep_until(until);
+    });
+
+    ASSERT_GE(std::chrono::steady_clock::now(), until);
+}
+
+TEST_F(WorkStealingThreadPoolTest, should_wake_sleepers_in_deadline_order) {
+    auto start = std::chrono::steady_clock::now();
+    std::mutex m;
+    std::vector<int> order;
+    std::latch done{3};
+
+    auto coro = [](auto start, int i, std::mutex& m, std::vector<int>& order, std::latch& done) -> Task<> {
+        co_await sleep_until(start + std::chrono::milliseconds(10 * i));
+        {
+            std::lock_guard l(m);
+            order.push_back(i);
+        }
+        done.count_down();
+    };
+
+    for (int i: {3, 1, 2}) {
+        run_awaitable_async(pool, coro(start, i, m, order, done));
+    }
+
+    done.wait();
+    ASSERT_EQ(order, (std::vector<int>{1, 2, 3}));
+}
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "thread_pool/thread_pool.h"
+#include "thread_pool/work_stealing_thread_pool.h"
+#include "thread_pool/strand.h"
+#include "thread_pool/promise.h"
+#include "thread_pool/when_all.h"
+#include "thread_pool/yield.h"
+
+using namespace pt;
+
+namespace {
+    // only finishes if whatever sets done gets to run on the same thread
+    Task<> spin_until(std::atomic<bool>& done, Priority& priority_after) {
+        while (!done) {
+            co_await yield_if_over_budget{};
+        }
+        priority_after = current_priority();
+    }
+
+    Task<> set(std::atomic<bool>& done) {
+        done = true;
+        co_return;
+    }
+
+    Task<Priority> spin_and_set(CoroutineThreadPool* bind_to = nullptr) {
+        std::atomic<bool> done = false;
+        Priority priority_after;
+        auto spin = spin_until(done, priority_after);
+        auto other = set(done);
+        if (bind_to) {
+            spin.bind(*bind_to);
+            other.bind(*bind_to);
+        }
+
+        // the spinner runs first, other is only pushed
+        co_await when_all(std::move(spin), std::move(other));
+        co_return priority_after;
+    }
+
+    Task<Priority> spin_and_set_at(Priority priority) {
+        auto task = spin_and_set();
+        task.set_priority(priority);
+        return task;
+    }
+}
+
+TEST(Yield, should_let_others_run_once_over_budget) {
+    FixedCoroutineThreadPool<1> pool{std::chrono::steady_clock::duration::zero(), std::chrono::milliseconds(1)};
+    ASSERT_EQ(run_awaitable_sync(pool, spin_and_set()), Priority::Normal);
+    ASSERT_EQ(run_awaitable_sync(pool, spin_and_set_at(Priority::Background)), Priority::Background);
+    pool.stop_and_join();
+}
+
+TEST(Yield, should_not_suspend_within_budget) {
+    FixedCoroutineThreadPool<1> pool{std::chrono::steady_clock::duration::zero(), std::chrono::hours(1)};
+    std::vector<int> order;
+
+    auto looping = [&]() -> Task<> {
+        for (int i = 0; i < 1000; i++) {
+            co_await yield_if_over_budget{};
+        }
+        order.push_back(1);
+    };
+    auto other = [&]() -> Task<> {
+        order.push_back(2);
+        co_return;
+    };
+
+    run_sync(pool, [&]() -> Task<> {
+        co_await when_all(looping(), other());
+    });
+    ASSERT_EQ(order, (std::vector<int>{1, 2}));
+    pool.stop_and_join();
+}
+
+TEST(Yield, should_let_others_run_on_a_work_stealing_pool) {
+    // one thread, so the yield can't be stolen by another
+    WorkStealingCoroutineThreadPool pool{1, std::chrono::steady_clock::duration::zero(), std::chrono::milliseconds(1)};
+    ASSERT_EQ(run_awaitable_sync(pool, spin_and_set()), Priority::Normal);
+    ASSERT_EQ(run_awaitable_sync(pool, spin_and_set_at(Priority::High)), Priority::High);
+    pool.stop_and_join();
+}
+
+TEST(Yield, should_let_others_run_on_a_strand) {
+    WorkStealingCoroutineThreadPool pool{4, std::chrono::steady_clock::duration::zero(), std::chrono::milliseconds(1)};
+    Strand strand{pool};
+    ASSERT_EQ(run_awaitable_sync(pool, spin_and_set(&strand)), Priority::Normal);
+    pool.stop_and_join();
+}
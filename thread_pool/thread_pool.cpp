@@ -1,24 +1,70 @@
 #include "thread_pool/thread_pool.h"
+#include "thread_pool/watchdog.h"
 #include "utils/overload.h"
 
 #include <coroutine>
 #include <variant>
 #include <algorithm>
 #include <thread>
-#include <functional>
+#include <iterator>
 
 namespace pt {
 using namespace thread_pool::detail;
 
-void FixedCoroutineThreadPool<1>::push(std::coroutine_handle<> handle) {
-    jobs.push(JobType::Coroutine{handle});
+namespace {
+    thread_local const CoroutineThreadPool* current_pool = nullptr;
 }
 
-void FixedCoroutineThreadPool<1>::push_sleep_until(std::coroutine_handle<> handle, std::chrono::steady_clock::time_point until) {
-    jobs.push(JobType::SleepCoroutine{
-        .sleep_until = until,
-        .handle = handle,
-    });
+bool FixedCoroutineThreadPool<1>::running_in_this_thread() const {
+    return current_pool == this;
+}
+
+void FixedCoroutineThreadPool<1>::push(std::coroutine_handle<> handle, Priority priority) {
+    jobs.push(JobType::Coroutine{handle, priority});
+}
+
+void FixedCoroutineThreadPool<1>::push_sleep_until(std::coroutine_handle<> handle, std::chrono::steady_clock::time_point until, CoroutineThreadPool& resume_on, SleepTicket* ticket) {
+    bool wake = false;
+    {
+        std::unique_lock l(timers_m);
+        if (ticket && ticket->cancelled) {
+            l.unlock();
+            resume_on.push(handle);
+            return;
+        }
+
+        auto before = sleeping_coroutines.next_expiry();
+        auto id = sleeping_coroutines.add(until, JobType::SleepCoroutine{
+            .sleep_until = until,
+            .handle = handle,
+            .resume_on = &resume_on,
+            .priority = current_priority(),
+        });
+        if (ticket) {
+            ticket->id = id;
+        }
+
+        // the pool's thread may be waiting on a later timer, if we're not it then it has to be
+        // woken to wait on this one instead
+        wake = !running_in_this_thread() && (!before || sleeping_coroutines.next_expiry() < *before);
+    }
+
+    if (wake) {
+        jobs.push(JobType::Wake{});
+    }
+}
+
+bool FixedCoroutineThreadPool<1>::cancel_sleep(SleepTicket& ticket) {
+    std::lock_guard l(timers_m);
+    if (!ticket.id) {
+        ticket.cancelled = true;
+        return false;
+    }
+    if (sleeping_coroutines.cancel(*ticket.id)) {
+        ticket.cancelled = true;
+        return true;
+    }
+    return false;
 }
 
 void FixedCoroutineThreadPool<1>::stop_and_join() {
@@ -29,21 +75,29 @@ void FixedCoroutineThreadPool<1>::stop_and_join() {
     }
 }
 
-FixedCoroutineThreadPool<1>::FixedCoroutineThreadPool() {
+FixedCoroutineThreadPool<1>::FixedCoroutineThreadPool(std::chrono::steady_clock::duration timer_slack, std::chrono::steady_clock::duration time_slice):
+    time_slice_(time_slice),
+    sleeping_coroutines(std::chrono::milliseconds(1), timer_slack)
+{
     thread = std::thread(&FixedCoroutineThreadPool::run, this);
 }
 
 FixedCoroutineThreadPool<1>::~FixedCoroutineThreadPool() {
     stop_and_join();
 
-    while (!jobs.empty()) {
-        Job j = jobs.pop();
+    for (auto& lane: lanes) {
+        for (auto h: lane) {
+            if (h) h.destroy();
+        }
+    }
+
+    // whatever was after the Stop, then anything pushed after that
+    jobs.try_pop_all(std::back_inserter(batch));
+    for (Job& j: batch) {
         std::visit(
             overload{
                 [](JobType::Stop){},
-                [](JobType::SleepCoroutine& c) {
-                    if (c.handle) c.handle.destroy();
-                },
+                [](JobType::Wake){},
                 [](JobType::Coroutine& c) {
                     if (c.handle) c.handle.destroy();
                 }
@@ -52,58 +106,124 @@ FixedCoroutineThreadPool<1>::~FixedCoroutineThreadPool() {
         );
     }
 
-    for (auto& c: sleeping_coroutines) {
-        if (c.handle) {
-            c.handle.destroy();
-        }
-    }
+    sleeping_coroutines.drain([](JobType::SleepCoroutine c) {
+        if (c.handle) c.handle.destroy();
+    });
 }
 
-void FixedCoroutineThreadPool<1>::run() {
-    while (true) {
-        Job job;
-
-        if (sleeping_coroutines.empty()) {
-            job = jobs.pop();
+void FixedCoroutineThreadPool<1>::fire_timers() {
+    // Collect them first so the lock isn't held while they're pushed, a timer for another pool
+    // may end up pushing onto a pool that's waiting on ours.
+    {
+        std::lock_guard l(timers_m);
+        sleeping_coroutines.expire(std::chrono::steady_clock::now(), [&](JobType::SleepCoroutine c) {
+            woken.push_back(c);
+        });
+    }
+    for (auto& c: woken) {
+        if (c.resume_on == this) {
+            lanes[static_cast<size_t>(c.priority)].push_back(c.handle);
         } else {
-            auto maybe_job = jobs.wait_until(sleeping_coroutines.front().sleep_until);
-            if (maybe_job.has_value()) {
-                job = *maybe_job;
-            } else {
-                std::pop_heap(
-                    sleeping_coroutines.begin(),
-                    sleeping_coroutines.end(),
-                    std::greater<JobType::SleepCoroutine>{}
-                );
-                auto c = sleeping_coroutines.back();
-                sleeping_coroutines.pop_back();
-                c.handle.resume();
-                continue;
-            }
+            c.resume_on->push(c.handle, c.priority);
         }
+    }
+    woken.clear();
+}
 
+bool FixedCoroutineThreadPool<1>::sort_batch() {
+    for (size_t i = 0; i < batch.size(); i++) {
         bool stop = false;
         std::visit(
             overload{
                 [&](JobType::Stop) {stop = true;},
-                [](JobType::Coroutine& c) {c.handle.resume();},
-                [&](JobType::SleepCoroutine& c) {
-                    if (c.sleep_until < std::chrono::steady_clock::now()) {
-                        c.handle.resume();
-                    } else {
-                        sleeping_coroutines.push_back(c);
-                        std::push_heap(
-                            sleeping_coroutines.begin(),
-                            sleeping_coroutines.end(),
-                            std::greater<JobType::SleepCoroutine>{}
-                        );
-                    }
-                },
+                [&](JobType::Coroutine& c) {lanes[static_cast<size_t>(c.priority)].push_back(c.handle);},
+                [](JobType::Wake) {},
             },
-            job
+            batch[i]
         );
-        if (stop) return;
+        if (stop) {
+            // the destructor cleans up the rest
+            batch.erase(batch.begin(), batch.begin() + i + 1);
+            return true;
+        }
+    }
+    batch.clear();
+    return false;
+}
+
+std::coroutine_handle<> FixedCoroutineThreadPool<1>::next_in_lanes(Priority& priority) {
+    auto take = [&](size_t lane) {
+        priority = static_cast<Priority>(lane);
+        auto h = lanes[lane].front();
+        lanes[lane].pop_front();
+        return h;
+    };
+
+    if (++dispatched % starvation_interval == 0) {
+        for (size_t lane = num_priorities; lane-- > 0;) {
+            if (!lanes[lane].empty()) return take(lane);
+        }
+    } else {
+        for (size_t lane = 0; lane < num_priorities; lane++) {
+            if (!lanes[lane].empty()) return take(lane);
+        }
+    }
+    return nullptr;
+}
+
+void FixedCoroutineThreadPool<1>::run() {
+    current_pool = this;
+    watchdog::detail::Registration registration;
+    bool stopping = false;
+    size_t since_timers = 0;
+    while (true) {
+        bool idle = std::all_of(lanes.begin(), lanes.end(), [](auto& lane) {return lane.empty();});
+        if (!stopping && (idle || since_timers >= timer_check_interval)) {
+            since_timers = 0;
+            fire_timers();
+            idle = std::all_of(lanes.begin(), lanes.end(), [](auto& lane) {return lane.empty();});
+        }
+
+        if (!stopping) {
+            if (idle) {
+                std::optional<std::chrono::steady_clock::time_point> next;
+                {
+                    std::lock_guard l(timers_m);
+                    next = sleeping_coroutines.next_expiry();
+                }
+
+                if (next) {
+                    auto maybe_job = jobs.wait_until(*next);
+                    if (!maybe_job.has_value()) {
+                        continue;
+                    }
+                    batch.push_back(std::move(*maybe_job));
+                } else {
+                    batch.push_back(jobs.pop());
+                }
+            }
+
+            // Take the whole backlog before every coroutine we run, so something important that
+            // was pushed while we were busy doesn't have to wait behind what's already sorted.
+            // Once stopped, whatever's already in the lanes is finished off and nothing else is
+            // taken.
+            jobs.try_pop_all(std::back_inserter(batch));
+            stopping = sort_batch();
+        }
+
+        Priority priority;
+        auto h = next_in_lanes(priority);
+        if (!h) {
+            if (stopping) return;
+            continue;
+        }
+
+        since_timers++;
+        slice_start = {};
+        PriorityScope scope(priority);
+        ResumeScope resuming;
+        h.resume();
     }
 }
 
-}
\ No newline at end of file
+}
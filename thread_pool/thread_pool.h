@@ -7,33 +7,205 @@
 #include <set>
 #include <variant>
 #include <compare>
+#include <mutex>
+#include <optional>
+#include <array>
+#include <deque>
+#include <utility>
+#include <atomic>
+#include <cstdint>
 
-#include "queues/mpsc.h"
+#include "queues/lock_free_mpsc.h"
+#include "thread_pool/timer_wheel.h"
 
 
 namespace pt {
 
+struct CoroutineThreadPool;
+
+// Pools run whatever's pushed at a higher priority first. Anything pushed without a priority gets
+// the priority of the coroutine doing the pushing, so everything a coroutine starts inherits it.
+enum class Priority {
+    // work a frame is waiting on
+    High,
+    Normal,
+    // work nobody is waiting on, e.g. autosave
+    Background,
+};
+
+constexpr size_t num_priorities = 3;
+
+// how long a coroutine can keep a pool's thread before yield_if_over_budget gives it up
+constexpr std::chrono::steady_clock::duration default_time_slice = std::chrono::milliseconds(2);
+
 namespace thread_pool::detail {
+    // set by pools while they resume a coroutine
+    inline thread_local Priority running_priority = Priority::Normal;
+
+    // When the coroutine running on this thread first checked its time slice with
+    // yield_if_over_budget, pools reset it each time they resume something new
+    inline thread_local std::chrono::steady_clock::time_point slice_start;
+
+    // Lets the watchdog tell when a pool thread has been stuck in one resume for too long, see
+    // watchdog.h. Only written by the thread it belongs to.
+    struct Heartbeat {
+        // resumes started and finished, a resume is running while they differ
+        std::atomic<uint64_t> started = 0;
+        std::atomic<uint64_t> finished = 0;
+        // the span (see span.h) of the coroutine running, 0 if it isn't known
+        std::atomic<uint64_t> span = 0;
+    };
+
+    // set for pool threads while a watchdog::detail::Registration is alive
+    inline thread_local Heartbeat* heartbeat = nullptr;
+
+#ifdef PT_TRACING
+    // the span (see span.h) of the coroutine running on this thread, 0 if it isn't known
+    inline thread_local uint64_t running_span = 0;
+
+    inline void set_running_span(uint64_t span) {
+        running_span = span;
+        if (heartbeat) {
+            heartbeat->span.store(span, std::memory_order_relaxed);
+        }
+    }
+#else
+    // spans aren't carried, see span.h
+    inline void set_running_span(uint64_t) {}
+#endif
+
+    // pools keep one alive while they resume a coroutine
+    class ResumeScope {
+    public:
+        ResumeScope() {
+            if (heartbeat) {
+                clear_span();
+                heartbeat->started.store(heartbeat->started.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+        }
+
+        ~ResumeScope() {
+            if (heartbeat) {
+                clear_span();
+                heartbeat->finished.store(heartbeat->finished.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+        }
+
+        ResumeScope(const ResumeScope&) = delete;
+        ResumeScope& operator=(const ResumeScope&) = delete;
+
+    private:
+        static void clear_span() {
+#ifdef PT_TRACING
+            running_span = 0;
+            heartbeat->span.store(0, std::memory_order_relaxed);
+#endif
+        }
+    };
+
+    // sets the current priority for as long as it's alive
+    class PriorityScope {
+    public:
+        PriorityScope(Priority priority): prev(std::exchange(running_priority, priority)) {}
+        ~PriorityScope() {running_priority = prev;}
+
+        PriorityScope(const PriorityScope&) = delete;
+        PriorityScope& operator=(const PriorityScope&) = delete;
+
+    private:
+        Priority prev;
+    };
+
     namespace JobType {
         struct Coroutine {
             std::coroutine_handle<> handle;
+            Priority priority;
         };
 
         struct SleepCoroutine {
-            auto operator<=>(const SleepCoroutine&) const = default;
             std::chrono::steady_clock::time_point sleep_until;
             std::coroutine_handle<> handle;
+            CoroutineThreadPool* resume_on;
+            // the priority of the coroutine when it went to sleep
+            Priority priority;
         };
 
+        // a timer was added from another thread, the pool may need to wake up sooner
+        struct Wake {};
+
         struct Stop {};
     };
 
-    using Job = std::variant<JobType::Coroutine, JobType::SleepCoroutine, JobType::Stop>;
+    using Job = std::variant<JobType::Coroutine, JobType::Wake, JobType::Stop>;
 }
 
+// the priority of the coroutine running on this thread, Normal if there isn't one
+inline Priority current_priority() {
+    return thread_pool::detail::running_priority;
+}
+
+using SleepId = TimerWheel<thread_pool::detail::JobType::SleepCoroutine>::Id;
+
+// Lets a sleep be cancelled with cancel_sleep. Only touched by the pool, with its timers locked.
+struct SleepTicket {
+    std::optional<SleepId> id;
+    // set if the sleep was cancelled before it was resumed by its timer
+    bool cancelled = false;
+};
+
 struct CoroutineThreadPool {
-    virtual void push(std::coroutine_handle<> handle) = 0;
-    virtual void push_sleep_until(std::coroutine_handle<> handle, std::chrono::steady_clock::time_point until) = 0;
+    virtual ~CoroutineThreadPool() = default;
+
+    virtual void push(std::coroutine_handle<> handle, Priority priority) = 0;
+
+    void push(std::coroutine_handle<> handle) {
+        push(handle, current_priority());
+    }
+
+    // For a coroutine giving up its thread, pushes handle behind everything else already waiting
+    // at priority.
+    virtual void yield(std::coroutine_handle<> handle, Priority priority) {
+        push(handle, priority);
+    }
+
+    // how long a coroutine can keep one of the pool's threads before yield_if_over_budget gives
+    // it up
+    virtual std::chrono::steady_clock::duration time_slice() const = 0;
+
+    // handle is pushed onto resume_on once until has passed. Lets executors that sit on top of a
+    // pool (like Strand) use the pool's timers. If ticket isn't null the sleep can be cancelled
+    // with it, and if it's already been cancelled handle is pushed onto resume_on straight away.
+    virtual void push_sleep_until(std::coroutine_handle<> handle, std::chrono::steady_clock::time_point until, CoroutineThreadPool& resume_on, SleepTicket* ticket) = 0;
+
+    void push_sleep_until(std::coroutine_handle<> handle, std::chrono::steady_clock::time_point until) {
+        push_sleep_until(handle, until, *this, nullptr);
+    }
+
+    // Returns true if the sleep's timer was removed before it went off, the caller is then
+    // responsible for resuming the coroutine. Returns false if the timer has gone off, or if the
+    // sleep hasn't been pushed yet, in which case push_sleep_until resumes it straight away.
+    // Either way ticket.cancelled is set if the sleep didn't run its full length.
+    virtual bool cancel_sleep(SleepTicket& ticket) = 0;
+
+    // the number of threads coroutines pushed onto this pool may be resumed on
+    virtual size_t num_threads() const = 0;
+
+    // true if the calling thread is currently running a coroutine for this pool
+    virtual bool running_in_this_thread() const = 0;
+
+    // For await_suspend, returns handle to resume straight away by symmetric transfer if we're
+    // already on this pool at the right priority, otherwise pushes it.
+    std::coroutine_handle<> schedule(std::coroutine_handle<> handle, Priority priority) {
+        if (running_in_this_thread() && priority == current_priority()) {
+            return handle;
+        }
+        push(handle, priority);
+        return std::noop_coroutine();
+    }
+
+    std::coroutine_handle<> schedule(std::coroutine_handle<> handle) {
+        return schedule(handle, current_priority());
+    }
 
     template<typename Rep, typename Period>
     void push_sleep(std::coroutine_handle<> handle, std::chrono::duration<Rep, Period> duration) {
@@ -44,10 +216,18 @@ struct CoroutineThreadPool {
 template<size_t NumThreads>
 class FixedCoroutineThreadPool;
 
+// Runs everything on one thread. Higher priority coroutines always go first, except that every
+// starvation_interval-th coroutine run is taken from the lowest priority with anything waiting,
+// so background work still gets done when there's a steady stream of more important work.
 template<>
 class FixedCoroutineThreadPool<1>: public CoroutineThreadPool {
 public:
-    FixedCoroutineThreadPool();
+    // sleeping coroutines may be woken up to timer_slack late so ones with nearby deadlines can
+    // share a wakeup
+    FixedCoroutineThreadPool(
+        std::chrono::steady_clock::duration timer_slack = std::chrono::steady_clock::duration::zero(),
+        std::chrono::steady_clock::duration time_slice = default_time_slice
+    );
 
     ~FixedCoroutineThreadPool();
 
@@ -57,18 +237,41 @@ public:
     FixedCoroutineThreadPool& operator=(const FixedCoroutineThreadPool&) = delete;
     FixedCoroutineThreadPool& operator=(FixedCoroutineThreadPool&&) = delete;
 
-    void push(std::coroutine_handle<> handle) override;
-    void push_sleep_until(std::coroutine_handle<> handle, std::chrono::steady_clock::time_point until) override;
+    using CoroutineThreadPool::push;
+    using CoroutineThreadPool::push_sleep_until;
+
+    void push(std::coroutine_handle<> handle, Priority priority) override;
+    void push_sleep_until(std::coroutine_handle<> handle, std::chrono::steady_clock::time_point until, CoroutineThreadPool& resume_on, SleepTicket* ticket) override;
+    bool cancel_sleep(SleepTicket& ticket) override;
+    size_t num_threads() const override {return 1;}
+    bool running_in_this_thread() const override;
+    std::chrono::steady_clock::duration time_slice() const override {return time_slice_;}
 
     void stop_and_join();
 
 private:
+    static constexpr size_t starvation_interval = 32;
+    // how many coroutines are run between checking the timers when there's a backlog
+    static constexpr size_t timer_check_interval = 64;
+
     void run();
+    void fire_timers();
+    // moves the batch into the lanes, returns true if it had a Stop in it
+    bool sort_batch();
+    std::coroutine_handle<> next_in_lanes(Priority& priority);
 
-    MpscQueue<thread_pool::detail::Job> jobs;
+    LockFreeMpscQueue<thread_pool::detail::Job> jobs;
+    // jobs taken off the queue but not sorted into lanes yet, only touched by the pool's thread
+    std::vector<thread_pool::detail::Job> batch;
+    // coroutines waiting to run, one lane per priority, only touched by the pool's thread
+    std::array<std::deque<std::coroutine_handle<>>, num_priorities> lanes;
+    size_t dispatched = 0;
+    std::chrono::steady_clock::duration time_slice_;
 
-    // maintained by push_heap and pop_heap
-    std::vector<thread_pool::detail::JobType::SleepCoroutine> sleeping_coroutines;
+    std::mutex timers_m;
+    TimerWheel<thread_pool::detail::JobType::SleepCoroutine> sleeping_coroutines;
+    // timers that have expired but haven't been sorted into lanes yet, only touched by the pool's thread
+    std::vector<thread_pool::detail::JobType::SleepCoroutine> woken;
     std::thread thread;
 };
 
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace pt {
+
+// Hierarchical timing wheel. Adding and cancelling a timer is O(1), expiring is done a tick at a
+// time, with every timer due in a tick handed out together.
+//
+// Deadlines are rounded up to a whole number of ticks, and then up to a multiple of slack when
+// slack is longer than a tick. Timers are never expired early, but may be up to slack late,
+// which lets timers with nearby deadlines share a wakeup.
+//
+// Not thread safe.
+template<typename T>
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Id {
+        uint32_t index;
+        uint32_t generation;
+    };
+
+    TimerWheel(Clock::duration tick = std::chrono::milliseconds(1), Clock::duration slack = Clock::duration::zero(), Clock::time_point origin = Clock::now());
+
+    Id add(Clock::time_point deadline, T t);
+
+    // returns false if the timer has already expired or been cancelled
+    bool cancel(Id id);
+
+    // Calls f with every timer due by now, in deadline order (ties in the order they were added).
+    // f may add and cancel timers. Returns how many expired.
+    template<typename F>
+    size_t expire(Clock::time_point now, F&& f);
+
+    // Nothing expires before this. It's exact if the next timer is close, otherwise it's when the
+    // wheel next needs to move timers closer, and expire needs calling then to keep it exact.
+    std::optional<Clock::time_point> next_expiry() const;
+
+    // calls f with every timer, leaving the wheel empty
+    template<typename F>
+    void drain(F&& f);
+
+    bool empty() const {return count == 0;}
+    size_t size() const {return count;}
+
+private:
+    static constexpr unsigned bits = 6;
+    static constexpr uint64_t slots = 1 << bits;
+    static constexpr uint64_t slot_mask = slots - 1;
+    static constexpr unsigned levels = 6;
+    static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+
+    struct Entry {
+        uint64_t tick;
+        uint32_t prev = npos;
+        uint32_t next = npos;
+        uint32_t generation = 0;
+        uint8_t level;
+        uint8_t slot;
+        std::optional<T> value;
+    };
+
+    struct Slot {
+        uint32_t head = npos;
+        uint32_t tail = npos;
+    };
+
+    uint64_t to_tick(Clock::time_point deadline) const;
+    Clock::time_point to_time_point(uint64_t tick) const;
+
+    // the first tick at or after current where a slot needs expiring or cascading
+    std::optional<uint64_t> next_tick() const;
+
+    void place(uint32_t index);
+    // level is levels for the overdue list
+    Slot& slot_at(unsigned level, uint64_t slot);
+    void link(uint32_t index, unsigned level, uint64_t slot);
+    void unlink(uint32_t index);
+    void free_entry(uint32_t index);
+    void cascade(unsigned level);
+
+    Clock::duration tick;
+    uint64_t slack_ticks;
+    Clock::time_point origin;
+
+    // every tick before this has been expired
+    uint64_t current = 0;
+    size_t count = 0;
+
+    std::vector<Entry> entries;
+    uint32_t free_list = npos;
+
+    std::array<std::array<Slot, slots>, levels> wheels;
+    // timers added after their tick had already been expired
+    Slot overdue;
+    // bit i set if slot i of that level has timers in it
+    std::array<uint64_t, levels> occupied = {};
+};
+
+
+template<typename T>
+TimerWheel<T>::TimerWheel(Clock::duration tick, Clock::duration slack, Clock::time_point origin):
+    tick(tick),
+    slack_ticks(std::max<uint64_t>(1, (slack + tick - Clock::duration(1)) / tick)),
+    origin(origin)
+{
+    assert(tick > Clock::duration::zero());
+}
+
+template<typename T>
+uint64_t TimerWheel<T>::to_tick(Clock::time_point deadline) const {
+    if (deadline <= origin) return 0;
+    // round up, never expire early
+    uint64_t t = ((deadline - origin) + tick - Clock::duration(1)) / tick;
+    return (t + slack_ticks - 1) / slack_ticks * slack_ticks;
+}
+
+template<typename T>
+typename TimerWheel<T>::Clock::time_point TimerWheel<T>::to_time_point(uint64_t t) const {
+    return origin + tick * t;
+}
+
+template<typename T>
+typename TimerWheel<T>::Id TimerWheel<T>::add(Clock::time_point deadline, T t) {
+    uint32_t index;
+    if (free_list != npos) {
+        index = free_list;
+        free_list = entries[index].next;
+    } else {
+        index = entries.size();
+        entries.emplace_back();
+    }
+
+    Entry& e = entries[index];
+    e.tick = to_tick(deadline);
+    e.value.emplace(std::move(t));
+    if (e.tick < current) {
+        // its tick has already been expired, it goes out with the next call to expire
+        link(index, levels, 0);
+    } else {
+        place(index);
+    }
+    count++;
+    return {index, e.generation};
+}
+
+template<typename T>
+bool TimerWheel<T>::cancel(Id id) {
+    if (id.index >= entries.size()) return false;
+    Entry& e = entries[id.index];
+    if (e.generation != id.generation || !e.value) return false;
+
+    unlink(id.index);
+    free_entry(id.index);
+    count--;
+    return true;
+}
+
+template<typename T>
+void TimerWheel<T>::place(uint32_t index) {
+    uint64_t t = std::max(entries[index].tick, current);
+    uint64_t delta = t - current;
+    unsigned level = delta == 0 ? 0 : (63 - std::countl_zero(delta)) / bits;
+
+    if (level >= levels) {
+        // Past the end of the wheel, park it in the top level slot that cascades last and it'll
+        // be placed again from there.
+        level = levels - 1;
+        t = ((current >> (bits * level)) + slots - 1) << (bits * level);
+    }
+    link(index, level, (t >> (bits * level)) & slot_mask);
+}
+
+template<typename T>
+typename TimerWheel<T>::Slot& TimerWheel<T>::slot_at(unsigned level, uint64_t slot) {
+    return level == levels ? overdue : wheels[level][slot];
+}
+
+template<typename T>
+void TimerWheel<T>::link(uint32_t index, unsigned level, uint64_t slot) {
+    Entry& e = entries[index];
+    Slot& s = slot_at(level, slot);
+    e.level = level;
+    e.slot = slot;
+    e.next = npos;
+    e.prev = s.tail;
+    if (s.tail != npos) {
+        entries[s.tail].next = index;
+    } else {
+        s.head = index;
+    }
+    s.tail = index;
+    if (level != levels) {
+        occupied[level] |= uint64_t(1) << slot;
+    }
+}
+
+template<typename T>
+void TimerWheel<T>::unlink(uint32_t index) {
+    Entry& e = entries[index];
+    Slot& s = slot_at(e.level, e.slot);
+    if (e.prev != npos) {
+        entries[e.prev].next = e.next;
+    } else {
+        s.head = e.next;
+    }
+    if (e.next != npos) {
+        entries[e.next].prev = e.prev;
+    } else {
+        s.tail = e.prev;
+    }
+    if (s.head == npos && e.level != levels) {
+        occupied[e.level] &= ~(uint64_t(1) << e.slot);
+    }
+}
+
+template<typename T>
+void TimerWheel<T>::free_entry(uint32_t index) {
+    Entry& e = entries[index];
+    e.value.reset();
+    e.generation++;
+    e.prev = npos;
+    e.next = free_list;
+    free_list = index;
+}
+
+template<typename T>
+void TimerWheel<T>::cascade(unsigned level) {
+    uint64_t slot = (current >> (bits * level)) & slot_mask;
+    Slot& s = wheels[level][slot];
+    uint32_t index = s.head;
+    s = Slot{};
+    occupied[level] &= ~(uint64_t(1) << slot);
+
+    while (index != npos) {
+        uint32_t next = entries[index].next;
+        place(index);
+        index = next;
+    }
+}
+
+template<typename T>
+std::optional<uint64_t> TimerWheel<T>::next_tick() const {
+    std::optional<uint64_t> best;
+    for (unsigned level = 0; level < levels; level++) {
+        uint64_t base = current >> (bits * level);
+        uint64_t rotated = std::rotr(occupied[level], base & slot_mask);
+        while (rotated) {
+            unsigned d = std::countr_zero(rotated);
+            uint64_t t = (base + d) << (bits * level);
+            if (t < current) {
+                // this level's current slot was already cascaded this time round
+                rotated &= rotated - 1;
+                if (!rotated) t = (base + slots) << (bits * level);
+                else continue;
+            }
+            if (!best || t < *best) best = t;
+            break;
+        }
+    }
+    return best;
+}
+
+template<typename T>
+template<typename F>
+size_t TimerWheel<T>::expire(Clock::time_point now, F&& f) {
+    if (now < origin) return 0;
+    uint64_t target = (now - origin) / tick;
+
+    size_t expired = 0;
+    auto expire_slot = [&](Slot& slot) {
+        // one at a time so f can add and cancel timers
+        while (slot.head != npos) {
+            uint32_t index = slot.head;
+            unlink(index);
+            T t = std::move(*entries[index].value);
+            free_entry(index);
+            count--;
+            expired++;
+            f(std::move(t));
+        }
+    };
+
+    expire_slot(overdue);
+    while (count != 0 && current <= target) {
+        // skip straight over ticks where nothing happens
+        uint64_t next = *next_tick();
+        if (next > target) break;
+        current = next;
+
+        for (unsigned level = levels - 1; level > 0; level--) {
+            if ((current & ((uint64_t(1) << (bits * level)) - 1)) == 0) {
+                cascade(level);
+            }
+        }
+
+        // anything f adds for this tick ends up on the end of this slot
+        expire_slot(wheels[0][current & slot_mask]);
+        current++;
+
+        // and anything it adds for an earlier one here
+        expire_slot(overdue);
+    }
+
+    current = std::max(current, target + 1);
+    return expired;
+}
+
+template<typename T>
+std::optional<typename TimerWheel<T>::Clock::time_point> TimerWheel<T>::next_expiry() const {
+    if (count == 0) return std::nullopt;
+    if (overdue.head != npos) return to_time_point(current - 1);
+    return to_time_point(*next_tick());
+}
+
+template<typename T>
+template<typename F>
+void TimerWheel<T>::drain(F&& f) {
+    for (uint32_t i = 0; i < entries.size(); i++) {
+        if (entries[i].value) {
+            unlink(i);
+            T t = std::move(*entries[i].value);
+            free_entry(i);
+            count--;
+            f(std::move(t));
+        }
+    }
+}
+
+}
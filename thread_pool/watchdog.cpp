@@ -0,0 +1,205 @@
+#include "thread_pool/watchdog.h"
+
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include <execinfo.h>
+#include <pthread.h>
+
+namespace pt {
+
+namespace {
+    struct Entry {
+        thread_pool::detail::Heartbeat* heartbeat;
+        pthread_t handle;
+        std::thread::id id;
+    };
+
+    struct Registry {
+        std::mutex m;
+        // by registration, so a thread that's gone isn't mistaken for one that's taken its place
+        std::map<uint64_t, Entry> threads;
+        uint64_t next_serial = 0;
+    };
+
+    Registry& registry() {
+        static Registry* r = new Registry;
+        return *r;
+    }
+
+    constexpr int max_frames = 64;
+
+    // Written by the signal handler of the thread being sampled, only one thread is sampled at a
+    // time.
+    struct Sample {
+        void* frames[max_frames];
+        std::atomic<int> depth = -1;
+    };
+
+    std::mutex sample_m;
+    Sample sample;
+
+    int sample_signal() {
+        return SIGRTMIN + 3;
+    }
+
+    void on_sample_signal(int) {
+        int saved = errno;
+        int depth = backtrace(sample.frames, max_frames);
+        sample.depth.store(depth, std::memory_order_release);
+        errno = saved;
+    }
+
+    void install_sample_handler() {
+        static std::once_flag once;
+        std::call_once(once, []{
+            // the first backtrace may allocate while it loads the unwinder, which can't happen in
+            // a signal handler
+            void* frames[1];
+            backtrace(frames, 1);
+
+            struct sigaction action = {};
+            action.sa_handler = on_sample_signal;
+            action.sa_flags = SA_RESTART;
+            sigemptyset(&action.sa_mask);
+            sigaction(sample_signal(), &action, nullptr);
+        });
+    }
+
+    // the thread must not be able to exit until this returns
+    std::vector<std::string> capture_stack(pthread_t thread) {
+        std::lock_guard l(sample_m);
+        sample.depth.store(-1, std::memory_order_relaxed);
+        if (pthread_kill(thread, sample_signal()) != 0) {
+            return {};
+        }
+
+        // a thread that's stuck in the kernel still takes the signal, give up if it doesn't
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+        int depth;
+        while ((depth = sample.depth.load(std::memory_order_acquire)) < 0) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return {};
+            }
+            std::this_thread::yield();
+        }
+
+        std::vector<std::string> stack;
+        // the first frame is the signal handler
+        char** symbols = backtrace_symbols(sample.frames + 1, depth - 1);
+        if (!symbols) {
+            return {};
+        }
+        for (int i = 0; i < depth - 1; i++) {
+            stack.push_back(symbols[i]);
+        }
+        std::free(symbols);
+        return stack;
+    }
+}
+
+void watchdog::write_stall(std::ostream& os, const Stall& stall, const std::string& what) {
+    char ms[32];
+    std::snprintf(ms, sizeof(ms), "%.1f", std::chrono::duration<double, std::milli>(stall.duration).count());
+    os << "pool thread " << stall.thread << " has been stuck for " << ms << " ms in " << what << "\n";
+    for (size_t i = 0; i < stall.stack.size(); i++) {
+        os << "    #" << i << " " << stall.stack[i] << "\n";
+    }
+}
+
+void watchdog::print_stall(const Stall& stall) {
+    write_stall(std::cerr, stall, stall.span ? "span " + std::to_string(stall.span) : std::string("an untraced coroutine"));
+}
+
+watchdog::detail::Registration::Registration() {
+    auto& r = registry();
+    std::lock_guard l(r.m);
+    serial = r.next_serial++;
+    r.threads.emplace(serial, Entry{&heartbeat, pthread_self(), std::this_thread::get_id()});
+    thread_pool::detail::heartbeat = &heartbeat;
+}
+
+watchdog::detail::Registration::~Registration() {
+    auto& r = registry();
+    std::lock_guard l(r.m);
+    thread_pool::detail::heartbeat = nullptr;
+    r.threads.erase(serial);
+}
+
+Watchdog::Watchdog(std::chrono::steady_clock::duration threshold, std::function<void(const watchdog::Stall&)> report, bool capture_stacks):
+    threshold(threshold),
+    report(std::move(report)),
+    capture_stacks(capture_stacks)
+{
+    assert(threshold > std::chrono::steady_clock::duration::zero());
+    if (capture_stacks) {
+        install_sample_handler();
+    }
+    thread = std::thread(&Watchdog::run, this);
+}
+
+Watchdog::~Watchdog() {
+    {
+        std::lock_guard l(m);
+        stopping = true;
+    }
+    cv.notify_all();
+    thread.join();
+}
+
+void Watchdog::run() {
+    std::unique_lock l(m);
+    while (!cv.wait_for(l, threshold / 4, [&]{return stopping;})) {
+        l.unlock();
+        for (auto& stall: check()) {
+            report(stall);
+        }
+        l.lock();
+    }
+}
+
+std::vector<watchdog::Stall> Watchdog::check() {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<watchdog::Stall> stalls;
+
+    // held while stacks are captured, so the threads can't exit in the meantime
+    auto& r = registry();
+    std::lock_guard l(r.m);
+    std::erase_if(busy, [&](auto& watched) {return !r.threads.contains(watched.first);});
+
+    for (auto& [serial, entry]: r.threads) {
+        uint64_t started = entry.heartbeat->started.load(std::memory_order_relaxed);
+        uint64_t finished = entry.heartbeat->finished.load(std::memory_order_relaxed);
+        if (started == finished) {
+            busy.erase(serial);
+            continue;
+        }
+
+        // The resume has only been seen running since now, it may have started up to a check
+        // earlier. So it's reported up to threshold / 4 later than threshold after it started.
+        auto [it, inserted] = busy.try_emplace(serial, Watched{started, now, false});
+        auto& watched = it->second;
+        if (watched.started != started) {
+            watched = {started, now, false};
+            continue;
+        }
+        if (watched.reported || now - watched.since < threshold) {
+            continue;
+        }
+
+        watched.reported = true;
+        watchdog::Stall stall{entry.id, now - watched.since, entry.heartbeat->span.load(std::memory_order_relaxed), {}};
+        if (capture_stacks) {
+            stall.stack = capture_stack(entry.handle);
+        }
+        stalls.push_back(std::move(stall));
+    }
+    return stalls;
+}
+
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "thread_pool/thread_pool.h"
+
+namespace pt {
+
+namespace watchdog {
+    // a pool thread that's been inside one resume for longer than the watchdog's threshold
+    struct Stall {
+        std::thread::id thread;
+        // how long it had been stuck when it was noticed, it may have been a little longer
+        std::chrono::steady_clock::duration duration;
+        // The span (see span.h) of whatever was running, 0 if it isn't known. It's known from the
+        // start of a Task, and again after it awaits another Task or something that isn't pool
+        // aware. Coroutines the pool resumes directly, after a sleep say, have no span until then.
+        // Always 0 unless built with PT_TRACING.
+        uint64_t span;
+        // symbolised frames of the stuck thread, innermost first, only captured if asked for
+        std::vector<std::string> stack;
+    };
+
+    // one line saying which thread is stuck and for how long, what is whatever was running, then
+    // the stack if there is one
+    void write_stall(std::ostream& os, const Stall& stall, const std::string& what);
+
+    // writes the stall to std::cerr
+    void print_stall(const Stall& stall);
+}
+
+namespace watchdog::detail {
+    // Pools keep one alive on each of their threads, the thread is watched while it is
+    class Registration {
+    public:
+        Registration();
+        ~Registration();
+
+        Registration(const Registration&) = delete;
+        Registration& operator=(const Registration&) = delete;
+
+    private:
+        thread_pool::detail::Heartbeat heartbeat;
+        uint64_t serial;
+    };
+}
+
+// Watches every pool thread in the process from a thread of its own, and reports any that have
+// been inside one resume for longer than threshold. A handler that blocks (waiting on the GPU,
+// reading a file, a long loop) holds up everything else on its thread, this says which one it was
+// while it's still happening. Each stall is reported once.
+//
+// Threads are checked every threshold / 4. If capture_stacks is set a stuck thread is sent a
+// signal and its stack taken from the signal handler, so it shows exactly where it's stuck.
+class Watchdog {
+public:
+    Watchdog(
+        std::chrono::steady_clock::duration threshold,
+        std::function<void(const watchdog::Stall&)> report = watchdog::print_stall,
+        bool capture_stacks = false
+    );
+
+    ~Watchdog();
+
+    Watchdog(const Watchdog&) = delete;
+    Watchdog(Watchdog&&) = delete;
+
+    Watchdog& operator=(const Watchdog&) = delete;
+    Watchdog& operator=(Watchdog&&) = delete;
+
+private:
+    struct Watched {
+        uint64_t started;
+        std::chrono::steady_clock::time_point since;
+        bool reported;
+    };
+
+    void run();
+    std::vector<watchdog::Stall> check();
+
+    const std::chrono::steady_clock::duration threshold;
+    const std::function<void(const watchdog::Stall&)> report;
+    const bool capture_stacks;
+
+    std::mutex m;
+    std::condition_variable cv;
+    bool stopping = false;
+
+    // by registration, only touched by thread
+    std::map<uint64_t, Watched> busy;
+    std::thread thread;
+};
+
+}
@@ -0,0 +1,301 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "thread_pool/promise.h"
+#include "thread_pool/frame_allocator.h"
+
+namespace pt {
+
+template<typename T>
+struct WhenAnyResult {
+    // which of the tasks finished first
+    size_t index;
+    T value;
+};
+
+template<>
+struct WhenAnyResult<void> {
+    size_t index;
+};
+
+namespace combinator::detail {
+    // what a task's result is stored as, a tuple can't hold void
+    template<typename T>
+    using ValueT = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+    struct Started {
+        std::coroutine_handle<> handle;
+        CoroutineThreadPool* pool;
+        Priority priority;
+    };
+
+    // Sets task up to resume awaiter through group. It runs on the awaiter's pool at the
+    // awaiter's priority, unless it's been given its own.
+    template<typename T, typename U>
+    Started prepare(Task<T>& task, promise::detail::task_group& group, std::coroutine_handle<U> awaiter) {
+        auto* promise = task.promise;
+        promise::detail::attach(*promise, awaiter);
+        promise->group = &group;
+        return {std::coroutine_handle<typename Task<T>::promise_type>::from_promise(*promise), promise->pool, promise->start_priority()};
+    }
+
+    // the result of a finished task, rethrows if it threw
+    template<typename T>
+    ValueT<T> take(Task<T>& task) {
+        if constexpr (std::is_void_v<T>) {
+            if (task.promise->exception) {
+                std::rethrow_exception(task.promise->exception);
+            }
+            return {};
+        } else {
+            auto& ret = task.promise->return_value_;
+            if (ret.index() == 2) {
+                std::rethrow_exception(std::get<2>(ret));
+            }
+            assert(ret.index() == 1);
+            return std::move(std::get<1>(ret));
+        }
+    }
+
+    // the last task to finish resumes the awaiter
+    struct all_group final: promise::detail::task_group {
+        all_group() = default;
+        // only so the awaitables can be moved before they're awaited, there's nothing to move
+        all_group(all_group&&) noexcept {}
+
+        bool arrive(std::coroutine_handle<>) noexcept override {
+            return remaining.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        }
+
+        std::atomic<size_t> remaining;
+    };
+
+    template<typename...Ts>
+    class when_all_tuple {
+    public:
+        using pool_aware = void;
+
+        when_all_tuple(Task<Ts>...tasks): tasks(std::move(tasks)...) {}
+
+        bool await_ready() const noexcept {
+            return sizeof...(Ts) == 0;
+        }
+
+        template<typename U>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<U> handle) noexcept {
+            group.remaining.store(sizeof...(Ts), std::memory_order_relaxed);
+            auto started = std::apply([&](auto&...tasks) {
+                return std::array<Started, sizeof...(Ts)>{prepare(tasks, group, handle)...};
+            }, tasks);
+
+            // The first runs straight away, the others are free to be picked up by other threads.
+            // None of them can resume us before the first has started.
+            for (size_t i = 1; i < started.size(); i++) {
+                started[i].pool->push(started[i].handle, started[i].priority);
+            }
+            return started[0].pool->schedule(started[0].handle, started[0].priority);
+        }
+
+        std::tuple<ValueT<Ts>...> await_resume() {
+            // braced so results are taken in order, the first task that threw is the one rethrown
+            return std::apply([](auto&...tasks) {
+                return std::tuple<ValueT<Ts>...>{take(tasks)...};
+            }, tasks);
+        }
+
+    private:
+        std::tuple<Task<Ts>...> tasks;
+        all_group group;
+    };
+
+    template<typename T>
+    class when_all_range {
+    public:
+        using pool_aware = void;
+
+        when_all_range(std::vector<Task<T>> tasks): tasks(std::move(tasks)) {}
+
+        bool await_ready() const noexcept {
+            return tasks.empty();
+        }
+
+        template<typename U>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<U> handle) noexcept {
+            group.remaining.store(tasks.size(), std::memory_order_relaxed);
+            for (size_t i = 1; i < tasks.size(); i++) {
+                auto started = prepare(tasks[i], group, handle);
+                started.pool->push(started.handle, started.priority);
+            }
+            auto first = prepare(tasks[0], group, handle);
+            return first.pool->schedule(first.handle, first.priority);
+        }
+
+        auto await_resume() {
+            if constexpr (std::is_void_v<T>) {
+                for (auto& task: tasks) {
+                    take(task);
+                }
+            } else {
+                std::vector<T> ret;
+                ret.reserve(tasks.size());
+                for (auto& task: tasks) {
+                    ret.push_back(take(task));
+                }
+                return ret;
+            }
+        }
+
+    private:
+        std::vector<Task<T>> tasks;
+        all_group group;
+    };
+
+    // The first task to finish resumes the awaiter, the others keep running. Whichever of them and
+    // the awaiter is done with the group last destroys it, along with every task.
+    template<typename T>
+    struct any_group final: promise::detail::task_group, FrameAllocated {
+        bool arrive(std::coroutine_handle<> task) noexcept override {
+            if (!decided.exchange(true, std::memory_order_acq_rel)) {
+                winner = task;
+                // the awaiter releases the winner's reference, it needs its result first
+                return pending.fetch_sub(1, std::memory_order_acq_rel) == 1;
+            }
+            release(1);
+            return false;
+        }
+
+        void release(size_t n) noexcept {
+            if (refs.fetch_sub(n, std::memory_order_acq_rel) == n) {
+                delete this;
+            }
+        }
+
+        std::vector<Task<T>> tasks;
+        // one per task, plus one for the awaiter
+        std::atomic<size_t> refs;
+        // the winner arriving and the awaiter finishing starting the tasks, whichever is second
+        // resumes the awaiter
+        std::atomic<size_t> pending = 2;
+        std::atomic<bool> decided = false;
+        std::coroutine_handle<> winner;
+    };
+
+    template<typename T>
+    class when_any_awaitable {
+    public:
+        using pool_aware = void;
+
+        when_any_awaitable(std::vector<Task<T>> tasks): tasks(std::move(tasks)) {
+            assert(!this->tasks.empty());
+        }
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        template<typename U>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<U> handle) noexcept {
+            group = new any_group<T>;
+            group->tasks = std::move(tasks);
+            group->refs.store(group->tasks.size() + 1, std::memory_order_relaxed);
+
+            auto& ts = group->tasks;
+            for (size_t i = 1; i < ts.size(); i++) {
+                auto started = prepare(ts[i], *group, handle);
+                started.pool->push(started.handle, started.priority);
+            }
+            auto first = prepare(ts[0], *group, handle);
+
+            // once pending is released we may already have been resumed, so nothing of ours can
+            // be touched after it
+            if (group->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                // one of the others has already won, the first still has to be started
+                first.pool->push(first.handle, first.priority);
+                return handle;
+            }
+            return first.pool->schedule(first.handle, first.priority);
+        }
+
+        WhenAnyResult<T> await_resume() {
+            size_t index = 0;
+            while (std::coroutine_handle<>(std::coroutine_handle<typename Task<T>::promise_type>::from_promise(*group->tasks[index].promise)) != group->winner) {
+                index++;
+            }
+
+            std::optional<ValueT<T>> value;
+            std::exception_ptr exception;
+            try {
+                value.emplace(take(group->tasks[index]));
+            } catch (...) {
+                exception = std::current_exception();
+            }
+            // for us and the winner
+            std::exchange(group, nullptr)->release(2);
+
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+            if constexpr (std::is_void_v<T>) {
+                return {index};
+            } else {
+                return {index, std::move(*value)};
+            }
+        }
+
+    private:
+        std::vector<Task<T>> tasks;
+        any_group<T>* group = nullptr;
+    };
+}
+
+// Runs every task at once, spread over the awaiter's pool, and resumes the awaiter with all of
+// their results once they've all finished. void results come back as std::monostate. If any of
+// them threw, the first one's exception is rethrown once they've all finished.
+template<typename...Ts>
+auto when_all(Task<Ts>...tasks) {
+    return combinator::detail::when_all_tuple<Ts...>{std::move(tasks)...};
+}
+
+// As above, where some of them are stand ins for tasks, see StandsInForTask
+template<promise::detail::TaskOrStandIn...As> requires (StandsInForTask<As> || ...)
+auto when_all(As...as) {
+    return when_all(typename promise::detail::task_of<As>::type(std::move(as))...);
+}
+
+// As above, with the results in the same order as the tasks
+template<typename T>
+auto when_all(std::vector<Task<T>> tasks) {
+    return combinator::detail::when_all_range<T>{std::move(tasks)};
+}
+
+// Runs every task at once, spread over the awaiter's pool, and resumes the awaiter with the
+// result of whichever finishes first. The rest keep running to completion in the background and
+// their results are thrown away.
+template<typename T>
+auto when_any(std::vector<Task<T>> tasks) {
+    return combinator::detail::when_any_awaitable<T>{std::move(tasks)};
+}
+
+template<typename T, std::same_as<Task<T>>...Ts>
+auto when_any(Task<T> first, Ts...rest) {
+    std::vector<Task<T>> tasks;
+    tasks.reserve(1 + sizeof...(Ts));
+    tasks.push_back(std::move(first));
+    (tasks.push_back(std::move(rest)), ...);
+    return when_any(std::move(tasks));
+}
+
+}
@@ -0,0 +1,271 @@
+#include "thread_pool/work_stealing_thread_pool.h"
+#include "thread_pool/watchdog.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <cassert>
+
+namespace pt {
+using namespace thread_pool::detail;
+
+namespace {
+    // the worker the current thread is running, if any
+    thread_local void* this_worker = nullptr;
+
+    // how often a worker checks the injection queue before its own deque, stops coroutines
+    // pushed from outside the pool being starved by a worker that keeps itself busy.
+    constexpr size_t injection_check_interval = 61;
+
+    // how often a worker runs a Background coroutine ahead of everything but High ones
+    constexpr size_t starvation_interval = 32;
+
+    constexpr auto no_deadline = std::numeric_limits<std::chrono::steady_clock::rep>::max();
+}
+
+WorkStealingCoroutineThreadPool::WorkStealingCoroutineThreadPool(size_t num_threads, std::chrono::steady_clock::duration timer_slack, std::chrono::steady_clock::duration time_slice):
+    time_slice_(time_slice),
+    sleeping_coroutines(std::chrono::milliseconds(1), timer_slack),
+    next_deadline(no_deadline)
+{
+    assert(num_threads > 0);
+    for (size_t i = 0; i < num_threads; i++) {
+        workers.push_back(std::make_unique<Worker>(this, i));
+    }
+
+    // only start the threads once every worker exists since they steal from each other
+    for (auto& worker: workers) {
+        worker->thread = std::thread(&WorkStealingCoroutineThreadPool::run, this, std::ref(*worker));
+    }
+}
+
+WorkStealingCoroutineThreadPool::~WorkStealingCoroutineThreadPool() {
+    stop_and_join();
+
+    for (auto& worker: workers) {
+        while (auto h = worker->deque.pop()) {
+            if (*h) h->destroy();
+        }
+    }
+
+    for (auto& lane: injected) {
+        for (auto h: lane.queue) {
+            if (h) h.destroy();
+        }
+    }
+
+    sleeping_coroutines.drain([](JobType::SleepCoroutine c) {
+        if (c.handle) c.handle.destroy();
+    });
+}
+
+bool WorkStealingCoroutineThreadPool::running_in_this_thread() const {
+    auto* worker = static_cast<Worker*>(this_worker);
+    return worker && worker->pool == this;
+}
+
+void WorkStealingCoroutineThreadPool::push(std::coroutine_handle<> handle, Priority priority) {
+    auto* worker = static_cast<Worker*>(this_worker);
+    if (priority == Priority::Normal && worker && worker->pool == this) {
+        worker->deque.push(handle);
+    } else {
+        inject(handle, priority);
+    }
+    wake_one();
+}
+
+void WorkStealingCoroutineThreadPool::yield(std::coroutine_handle<> handle, Priority priority) {
+    // not onto our own deque, we'd pop it straight back off
+    inject(handle, priority);
+    wake_one();
+}
+
+void WorkStealingCoroutineThreadPool::inject(std::coroutine_handle<> handle, Priority priority) {
+    auto& lane = injected[static_cast<size_t>(priority)];
+    {
+        std::lock_guard l(lane.m);
+        lane.queue.push_back(handle);
+    }
+    lane.size.fetch_add(1);
+}
+
+void WorkStealingCoroutineThreadPool::push_sleep_until(std::coroutine_handle<> handle, std::chrono::steady_clock::time_point until, CoroutineThreadPool& resume_on, SleepTicket* ticket) {
+    {
+        std::unique_lock l(timers_m);
+        if (ticket && ticket->cancelled) {
+            l.unlock();
+            resume_on.push(handle);
+            return;
+        }
+
+        auto id = sleeping_coroutines.add(until, JobType::SleepCoroutine{
+            .sleep_until = until,
+            .handle = handle,
+            .resume_on = &resume_on,
+            .priority = current_priority(),
+        });
+        if (ticket) {
+            ticket->id = id;
+        }
+        update_next_deadline();
+    }
+
+    // a parked worker may be waiting on a later deadline, wake it so it waits on this one instead
+    std::lock_guard l(park_m);
+    park_cv.notify_one();
+}
+
+bool WorkStealingCoroutineThreadPool::cancel_sleep(SleepTicket& ticket) {
+    std::lock_guard l(timers_m);
+    if (!ticket.id) {
+        ticket.cancelled = true;
+        return false;
+    }
+    if (sleeping_coroutines.cancel(*ticket.id)) {
+        ticket.cancelled = true;
+        update_next_deadline();
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingCoroutineThreadPool::stop_and_join() {
+    {
+        std::lock_guard l(park_m);
+        stopping = true;
+    }
+    park_cv.notify_all();
+
+    for (auto& worker: workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+void WorkStealingCoroutineThreadPool::run(Worker& worker) {
+    this_worker = &worker;
+    watchdog::detail::Registration registration;
+
+    for (size_t tick = 0; !stopping.load(std::memory_order_relaxed); tick++) {
+        fire_timers(worker);
+
+        Priority priority;
+        if (auto h = find_work(worker, tick, priority)) {
+            slice_start = {};
+            PriorityScope scope(priority);
+            ResumeScope resuming;
+            h.resume();
+        } else {
+            park();
+        }
+    }
+
+    this_worker = nullptr;
+}
+
+std::coroutine_handle<> WorkStealingCoroutineThreadPool::find_work(Worker& worker, size_t tick, Priority& priority) {
+    priority = Priority::High;
+    if (auto h = pop_injected(Priority::High)) return h;
+
+    priority = Priority::Background;
+    if (tick % starvation_interval == 0) {
+        if (auto h = pop_injected(Priority::Background)) return h;
+    }
+
+    priority = Priority::Normal;
+    if (tick % injection_check_interval == 0) {
+        if (auto h = pop_injected(Priority::Normal)) return h;
+    }
+
+    if (auto h = worker.deque.pop()) return *h;
+    if (auto h = pop_injected(Priority::Normal)) return h;
+    if (auto h = steal(worker)) return h;
+
+    priority = Priority::Background;
+    return pop_injected(Priority::Background);
+}
+
+std::coroutine_handle<> WorkStealingCoroutineThreadPool::pop_injected(Priority priority) {
+    auto& lane = injected[static_cast<size_t>(priority)];
+    if (lane.size.load() == 0) return nullptr;
+
+    std::lock_guard l(lane.m);
+    if (lane.queue.empty()) return nullptr;
+
+    auto h = lane.queue.front();
+    lane.queue.pop_front();
+    lane.size.fetch_sub(1);
+    return h;
+}
+
+std::coroutine_handle<> WorkStealingCoroutineThreadPool::steal(Worker& worker) {
+    for (size_t i = 1; i < workers.size(); i++) {
+        auto& victim = *workers[(worker.index + i) % workers.size()];
+        if (auto h = victim.deque.steal()) return *h;
+    }
+    return nullptr;
+}
+
+bool WorkStealingCoroutineThreadPool::has_work() const {
+    for (auto& lane: injected) {
+        if (lane.size.load() != 0) return true;
+    }
+    for (auto& worker: workers) {
+        if (!worker->deque.empty()) return true;
+    }
+    return false;
+}
+
+void WorkStealingCoroutineThreadPool::fire_timers(Worker& worker) {
+    auto now = std::chrono::steady_clock::now();
+    if (now.time_since_epoch().count() < next_deadline.load(std::memory_order_relaxed)) return;
+
+    std::unique_lock l(timers_m);
+    sleeping_coroutines.expire(now, [&](JobType::SleepCoroutine c) {
+        if (c.resume_on == this && c.priority == Priority::Normal) {
+            worker.deque.push(c.handle);
+        } else {
+            c.resume_on->push(c.handle, c.priority);
+        }
+    });
+    update_next_deadline();
+    l.unlock();
+
+    if (worker.deque.size() > 1) {
+        wake_one();
+    }
+}
+
+void WorkStealingCoroutineThreadPool::update_next_deadline() {
+    auto next = sleeping_coroutines.next_expiry();
+    next_deadline.store(next ? next->time_since_epoch().count() : no_deadline);
+}
+
+void WorkStealingCoroutineThreadPool::park() {
+    std::unique_lock l(park_m);
+    num_parked.fetch_add(1);
+
+    // pairs with the fence in wake_one, either the pusher sees num_parked > 0 or we see its work
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!has_work() && !stopping) {
+        auto deadline = next_deadline.load();
+        if (deadline == no_deadline) {
+            park_cv.wait(l);
+        } else {
+            park_cv.wait_until(l, std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(deadline)));
+        }
+    }
+
+    num_parked.fetch_sub(1);
+}
+
+void WorkStealingCoroutineThreadPool::wake_one() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (num_parked.load() != 0) {
+        std::lock_guard l(park_m);
+        park_cv.notify_one();
+    }
+}
+
+}
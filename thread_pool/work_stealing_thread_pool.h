@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <coroutine>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <array>
+
+#include "queues/chase_lev.h"
+#include "thread_pool/thread_pool.h"
+#include "thread_pool/timer_wheel.h"
+
+
+namespace pt {
+
+// Runs coroutines on a fixed number of worker threads. Each worker owns a Chase-Lev deque, coroutines
+// pushed from a worker go onto that worker's deque and idle workers steal from the others. Coroutines
+// pushed from outside the pool go onto a shared injection queue.
+//
+// Only Normal priority coroutines go onto the workers' deques. High and Background ones have their
+// own shared queues, High is checked before anything else and Background only once there's nothing
+// else to do, or every so often so it isn't starved.
+//
+// Sleeping coroutines may be woken up to timer_slack late so ones with nearby deadlines can share a
+// wakeup. A coroutine that yields goes onto the shared queue for its priority, behind whatever's
+// already waiting there.
+class WorkStealingCoroutineThreadPool: public CoroutineThreadPool {
+public:
+    WorkStealingCoroutineThreadPool(
+        size_t num_threads = std::max(1u, std::thread::hardware_concurrency()),
+        std::chrono::steady_clock::duration timer_slack = std::chrono::steady_clock::duration::zero(),
+        std::chrono::steady_clock::duration time_slice = default_time_slice
+    );
+
+    ~WorkStealingCoroutineThreadPool();
+
+    WorkStealingCoroutineThreadPool(const WorkStealingCoroutineThreadPool&) = delete;
+    WorkStealingCoroutineThreadPool(WorkStealingCoroutineThreadPool&&) = delete;
+
+    WorkStealingCoroutineThreadPool& operator=(const WorkStealingCoroutineThreadPool&) = delete;
+    WorkStealingCoroutineThreadPool& operator=(WorkStealingCoroutineThreadPool&&) = delete;
+
+    using CoroutineThreadPool::push;
+    using CoroutineThreadPool::push_sleep_until;
+
+    void push(std::coroutine_handle<> handle, Priority priority) override;
+    void yield(std::coroutine_handle<> handle, Priority priority) override;
+    void push_sleep_until(std::coroutine_handle<> handle, std::chrono::steady_clock::time_point until, CoroutineThreadPool& resume_on, SleepTicket* ticket) override;
+    bool cancel_sleep(SleepTicket& ticket) override;
+    size_t num_threads() const override {return workers.size();}
+    bool running_in_this_thread() const override;
+    std::chrono::steady_clock::duration time_slice() const override {return time_slice_;}
+
+    void stop_and_join();
+
+private:
+    struct Worker {
+        Worker(WorkStealingCoroutineThreadPool* pool, size_t index): pool(pool), index(index) {}
+
+        WorkStealingCoroutineThreadPool* pool;
+        size_t index;
+        ChaseLevDeque<std::coroutine_handle<>> deque;
+        std::thread thread;
+    };
+
+    struct Injected {
+        std::mutex m;
+        std::deque<std::coroutine_handle<>> queue;
+        std::atomic<size_t> size = 0;
+    };
+
+    void run(Worker& worker);
+
+    std::coroutine_handle<> find_work(Worker& worker, size_t tick, Priority& priority);
+    std::coroutine_handle<> pop_injected(Priority priority);
+    void inject(std::coroutine_handle<> handle, Priority priority);
+    std::coroutine_handle<> steal(Worker& worker);
+    bool has_work() const;
+
+    void fire_timers(Worker& worker);
+    // timers_m must be held
+    void update_next_deadline();
+    void park();
+    void wake_one();
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::chrono::steady_clock::duration time_slice_;
+
+    // one per priority
+    std::array<Injected, num_priorities> injected;
+
+    std::mutex timers_m;
+    TimerWheel<thread_pool::detail::JobType::SleepCoroutine> sleeping_coroutines;
+    std::atomic<std::chrono::steady_clock::rep> next_deadline;
+
+    std::mutex park_m;
+    std::condition_variable park_cv;
+    std::atomic<size_t> num_parked = 0;
+    std::atomic<bool> stopping = false;
+};
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+
+#include "thread_pool/thread_pool.h"
+
+namespace pt {
+
+// For coroutines that run for a long time without awaiting anything, e.g. a loop over a big data
+// set. Cheap enough to await on every iteration, it only suspends once the coroutine has had its
+// thread for longer than the pool's time_slice(), and then goes to the back of the queue for its
+// priority so everything else waiting gets a turn first.
+//
+// The slice is counted from the first check after the pool resumed the coroutine, not from when
+// it was resumed.
+struct yield_if_over_budget {
+    using pool_aware = void;
+
+    bool await_ready() const noexcept {return false;}
+
+    template<typename U>
+    bool await_suspend(std::coroutine_handle<U> h) noexcept {
+        auto now = std::chrono::steady_clock::now();
+        auto& start = thread_pool::detail::slice_start;
+        if (start == std::chrono::steady_clock::time_point{}) {
+            start = now;
+            return false;
+        }
+        if (now - start < h.promise().pool->time_slice()) {
+            return false;
+        }
+
+        h.promise().pool->yield(h, current_priority());
+        return true;
+    }
+
+    void await_resume() const noexcept {}
+};
+
+}